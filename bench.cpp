@@ -0,0 +1,335 @@
+// OrderBook microbenchmarks: drives the book directly with synthetic flows and
+// reports throughput, latency percentiles and heap allocations per operation.
+//
+//   make bench                         # default run, table output
+//   ./order_book_bench --json > a.json # one JSON object per line, for diffing between commits
+//
+// Every scenario starts from a fresh book holding --depth levels per side with
+// --per-level orders each around a fixed mid. Only the measured operation is
+// timed; setup and refills are not.
+
+#include "order-book.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+// Heap allocation counter: every operator new in the process goes through here
+static std::atomic<uint64_t> g_allocs{0};
+
+void* operator new(size_t size) {
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size) { return ::operator new(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept { return ::operator new(size, tag); }
+void* operator new(size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    size_t a = static_cast<size_t>(align);
+    return std::aligned_alloc(a, (size + a - 1) / a * a);
+}
+void* operator new(size_t size, std::align_val_t align) {
+    if (void* p = ::operator new(size, align, std::nothrow)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size, std::align_val_t align) { return ::operator new(size, align); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+
+namespace {
+
+struct BenchConfig {
+    size_t ops = 200000;          // measured operations per scenario
+    size_t depth = 100;           // price levels per side
+    size_t per_level = 10;        // resting orders per level
+    size_t sweep_levels = 10;     // levels taken by one sweep
+    size_t history = 0;           // ids submitted and cancelled before measuring (directory size)
+    uint64_t seed = 1;
+    bool json = false;
+    bool locked = false;          // keep the book's internal locking (default: single-writer, as under the engine thread)
+    std::string only;             // run a single scenario
+};
+
+constexpr int64_t kMid = 100000;  // price ticks of the mid
+constexpr uint32_t kQty = 10;     // size of every prefilled order
+
+using Clock = std::chrono::steady_clock;
+
+struct Result {
+    std::string name;
+    std::vector<uint64_t> ns;
+    uint64_t allocs = 0;
+};
+
+// Fresh book with the configured ladder; resting ids are tracked for cancels and modifies
+struct Fixture {
+    explicit Fixture(const BenchConfig& cfg) : cfg(cfg), rng(cfg.seed) {
+        book.single_writer = !cfg.locked;
+        ids.reserve(cfg.depth * cfg.per_level * 2 + cfg.ops);
+        for (size_t i = 0; i < cfg.history; ++i) {
+            uint64_t id = book.submitOrderTicks(kMid - 1 - static_cast<int64_t>(cfg.depth), 1, true);
+            book.cancelOrder(id);
+        }
+        for (size_t level = 1; level <= cfg.depth; ++level) {
+            for (size_t k = 0; k < cfg.per_level; ++k) {
+                ids.push_back(book.submitOrderTicks(kMid - static_cast<int64_t>(level), kQty, true));
+                ids.push_back(book.submitOrderTicks(kMid + static_cast<int64_t>(level), kQty, false));
+            }
+        }
+    }
+
+    // Random passive price: 1..depth ticks away from the mid on the order's own side
+    int64_t passiveTicks(bool is_buy) {
+        int64_t off = 1 + static_cast<int64_t>(rng() % cfg.depth);
+        return is_buy ? kMid - off : kMid + off;
+    }
+
+    // Remove and return a random resting id (swap-remove); 0 if none left
+    uint64_t takeId() {
+        while (!ids.empty()) {
+            size_t i = rng() % ids.size();
+            uint64_t id = ids[i];
+            ids[i] = ids.back();
+            ids.pop_back();
+            if (book.getOrderStatus(id) == OrderStatus::Open) return id;
+        }
+        return 0;
+    }
+
+    uint64_t pickId() {
+        while (!ids.empty()) {
+            size_t i = rng() % ids.size();
+            if (book.getOrderStatus(ids[i]) == OrderStatus::Open) return ids[i];
+            ids[i] = ids.back();
+            ids.pop_back();
+        }
+        return 0;
+    }
+
+    const BenchConfig& cfg;
+    std::mt19937_64 rng;
+    OrderBook book;
+    std::vector<uint64_t> ids;
+};
+
+// prep(i) runs untimed before op(i); only op's time and allocations are counted
+template <typename Prep, typename Op>
+void measure(Result& r, size_t ops, Prep&& prep, Op&& op) {
+    r.ns.reserve(ops);
+    for (size_t i = 0; i < ops; ++i) {
+        prep(i);
+        uint64_t allocs_before = g_allocs.load(std::memory_order_relaxed);
+        auto t0 = Clock::now();
+        op(i);
+        auto t1 = Clock::now();
+        r.allocs += g_allocs.load(std::memory_order_relaxed) - allocs_before;
+        r.ns.push_back(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count()));
+    }
+}
+
+template <typename Op>
+void measure(Result& r, size_t ops, Op&& op) {
+    measure(r, ops, [](size_t) {}, std::forward<Op>(op));
+}
+
+// Passive orders at random levels on both sides; nothing crosses
+Result benchAdd(const BenchConfig& cfg) {
+    Fixture f(cfg);
+    Result r{"add"};
+    measure(r, cfg.ops, [&](size_t i) {
+        bool is_buy = i & 1;
+        f.book.submitOrderTicks(f.passiveTicks(is_buy), kQty, is_buy);
+    });
+    return r;
+}
+
+// Cancels of random resting orders (book is topped up first so it never runs dry)
+Result benchCancel(const BenchConfig& cfg) {
+    Fixture f(cfg);
+    for (size_t i = 0; i < cfg.ops; ++i) {
+        bool is_buy = i & 1;
+        f.ids.push_back(f.book.submitOrderTicks(f.passiveTicks(is_buy), kQty, is_buy));
+    }
+    Result r{"cancel"};
+    std::vector<uint64_t> victims(cfg.ops);
+    for (auto& id : victims) id = f.takeId();
+    measure(r, cfg.ops, [&](size_t i) {
+        f.book.cancelOrder(victims[i]);
+    });
+    return r;
+}
+
+// Price and size amends of random resting orders to other passive levels
+Result benchModify(const BenchConfig& cfg) {
+    Fixture f(cfg);
+    Result r{"modify"};
+    std::vector<uint64_t> targets(cfg.ops);
+    for (auto& id : targets) id = f.ids[f.rng() % f.ids.size()];
+    measure(r, cfg.ops, [&](size_t i) {
+        const Order* o = f.book.getOrderById(targets[i]);
+        if (!o) return;
+        f.book.modifyOrderTicks(targets[i], f.passiveTicks(o->is_buy), 1 + static_cast<uint32_t>(f.rng() % (2 * kQty)));
+    });
+    return r;
+}
+
+// Same-price quantity reductions, the most common amend
+Result benchModifyDown(const BenchConfig& cfg) {
+    Fixture f(cfg);
+    Result r{"modify_qty_down"};
+    std::vector<uint64_t> targets(cfg.ops);
+    for (auto& id : targets) id = f.ids[f.rng() % f.ids.size()];
+    measure(r, cfg.ops, [&](size_t i) {
+        const Order* o = f.book.getOrderById(targets[i]);
+        if (!o || o->quantity < 2) return;
+        f.book.modifyOrderTicks(targets[i], o->price_ticks, o->quantity - 1);
+    });
+    return r;
+}
+
+// Aggressive orders that clear sweep_levels full levels; the ladder is refilled untimed after each
+Result benchSweep(const BenchConfig& cfg) {
+    Fixture f(cfg);
+    Result r{"sweep"};
+    size_t levels = std::min(cfg.sweep_levels, cfg.depth);
+    uint32_t qty = static_cast<uint32_t>(levels * cfg.per_level * kQty);
+    size_t ops = std::max<size_t>(1, cfg.ops / std::max<size_t>(1, levels * cfg.per_level)); // comparable total fills
+    auto refill = [&](size_t i) {
+        bool is_buy = i & 1; // the sweep takes the opposite side
+        for (size_t level = 1; level <= levels; ++level) {
+            int64_t ticks = is_buy ? kMid + static_cast<int64_t>(level) : kMid - static_cast<int64_t>(level);
+            for (uint64_t q = f.book.getLevel(!is_buy, ticks).quantity; q < cfg.per_level * kQty; q += kQty) {
+                f.book.submitOrderTicks(ticks, kQty, !is_buy);
+            }
+        }
+    };
+    measure(r, ops, refill, [&](size_t i) {
+        bool is_buy = i & 1;
+        int64_t limit = is_buy ? kMid + static_cast<int64_t>(levels) : kMid - static_cast<int64_t>(levels);
+        f.book.submitOrderTicks(limit, qty, is_buy);
+    });
+    return r;
+}
+
+// Add / cancel / amend / take mix resembling a quoting session
+Result benchMixed(const BenchConfig& cfg) {
+    Fixture f(cfg);
+    Result r{"mixed"};
+    measure(r, cfg.ops, [&](size_t i) {
+        unsigned roll = static_cast<unsigned>(f.rng() % 100);
+        bool is_buy = i & 1;
+        if (roll < 50) {
+            f.ids.push_back(f.book.submitOrderTicks(f.passiveTicks(is_buy), kQty, is_buy));
+        } else if (roll < 85) {
+            f.book.cancelOrder(f.takeId());
+        } else if (roll < 95) {
+            uint64_t id = f.pickId();
+            const Order* o = f.book.getOrderById(id);
+            if (o) f.book.modifyOrderTicks(id, f.passiveTicks(o->is_buy), 1 + static_cast<uint32_t>(f.rng() % (2 * kQty)));
+        } else {
+            // Small take at the touch
+            int64_t touch = is_buy ? f.book.getBestAskTicks() : f.book.getBestBidTicks();
+            if (touch) f.book.submitOrderTicks(touch, kQty / 2, is_buy);
+        }
+    });
+    return r;
+}
+
+uint64_t percentile(const std::vector<uint64_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t idx = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+void report(const BenchConfig& cfg, Result& r) {
+    std::sort(r.ns.begin(), r.ns.end());
+    uint64_t total = 0;
+    for (uint64_t v : r.ns) total += v;
+    size_t ops = r.ns.size();
+    double ops_per_sec = total ? static_cast<double>(ops) * 1e9 / static_cast<double>(total) : 0.0;
+    double allocs_per_op = ops ? static_cast<double>(r.allocs) / static_cast<double>(ops) : 0.0;
+    if (cfg.json) {
+        std::printf("{\"scenario\":\"%s\",\"ops\":%zu,\"ops_per_sec\":%.0f,\"mean_ns\":%.1f,\"p50_ns\":%llu,\"p99_ns\":%llu,"
+                    "\"p999_ns\":%llu,\"max_ns\":%llu,\"allocs_per_op\":%.3f}\n",
+                    r.name.c_str(), ops, ops_per_sec, ops ? static_cast<double>(total) / static_cast<double>(ops) : 0.0,
+                    static_cast<unsigned long long>(percentile(r.ns, 0.50)), static_cast<unsigned long long>(percentile(r.ns, 0.99)),
+                    static_cast<unsigned long long>(percentile(r.ns, 0.999)), static_cast<unsigned long long>(r.ns.empty() ? 0 : r.ns.back()),
+                    allocs_per_op);
+        return;
+    }
+    std::printf("%-16s %10zu %12.0f %8llu %8llu %9llu %10llu %10.3f\n", r.name.c_str(), ops, ops_per_sec,
+                static_cast<unsigned long long>(percentile(r.ns, 0.50)), static_cast<unsigned long long>(percentile(r.ns, 0.99)),
+                static_cast<unsigned long long>(percentile(r.ns, 0.999)), static_cast<unsigned long long>(r.ns.empty() ? 0 : r.ns.back()),
+                allocs_per_op);
+}
+
+void usage() {
+    std::fprintf(stderr,
+        "usage: order_book_bench [--ops N] [--depth LEVELS] [--per-level N] [--sweep-levels N]\n"
+        "                        [--history IDS] [--seed N] [--locked] [--json] [--only SCENARIO]\n"
+        "scenarios: add cancel modify modify_qty_down sweep mixed\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    BenchConfig cfg;
+    for (int i = 1; i < argc; ++i) {
+        auto next = [&]() -> const char* { return i + 1 < argc ? argv[++i] : "0"; };
+        if (std::strcmp(argv[i], "--ops") == 0) cfg.ops = std::strtoull(next(), nullptr, 10);
+        else if (std::strcmp(argv[i], "--depth") == 0) cfg.depth = std::strtoull(next(), nullptr, 10);
+        else if (std::strcmp(argv[i], "--per-level") == 0) cfg.per_level = std::strtoull(next(), nullptr, 10);
+        else if (std::strcmp(argv[i], "--sweep-levels") == 0) cfg.sweep_levels = std::strtoull(next(), nullptr, 10);
+        else if (std::strcmp(argv[i], "--history") == 0) cfg.history = std::strtoull(next(), nullptr, 10);
+        else if (std::strcmp(argv[i], "--seed") == 0) cfg.seed = std::strtoull(next(), nullptr, 10);
+        else if (std::strcmp(argv[i], "--locked") == 0) cfg.locked = true;
+        else if (std::strcmp(argv[i], "--json") == 0) cfg.json = true;
+        else if (std::strcmp(argv[i], "--only") == 0) cfg.only = next();
+        else { usage(); return 2; }
+    }
+    if (cfg.ops == 0 || cfg.depth == 0 || cfg.per_level == 0) { usage(); return 2; }
+
+    struct Scenario { const char* name; Result (*run)(const BenchConfig&); };
+    const Scenario scenarios[] = {
+        {"add", benchAdd}, {"cancel", benchCancel}, {"modify", benchModify},
+        {"modify_qty_down", benchModifyDown}, {"sweep", benchSweep}, {"mixed", benchMixed},
+    };
+
+    if (cfg.json) {
+        std::printf("{\"config\":{\"ops\":%zu,\"depth\":%zu,\"per_level\":%zu,\"sweep_levels\":%zu,\"history\":%zu,\"seed\":%llu,\"locked\":%s}}\n",
+                    cfg.ops, cfg.depth, cfg.per_level, cfg.sweep_levels, cfg.history,
+                    static_cast<unsigned long long>(cfg.seed), cfg.locked ? "true" : "false");
+    } else {
+        std::printf("ops=%zu depth=%zu per_level=%zu sweep_levels=%zu history=%zu seed=%llu %s\n",
+                    cfg.ops, cfg.depth, cfg.per_level, cfg.sweep_levels, cfg.history,
+                    static_cast<unsigned long long>(cfg.seed), cfg.locked ? "locked" : "single-writer");
+        std::printf("%-16s %10s %12s %8s %8s %9s %10s %10s\n", "scenario", "ops", "ops/s", "p50ns", "p99ns", "p99.9ns", "max_ns", "allocs/op");
+    }
+    bool ran = false;
+    for (const auto& s : scenarios) {
+        if (!cfg.only.empty() && cfg.only != s.name) continue;
+        Result r = s.run(cfg);
+        report(cfg, r);
+        ran = true;
+    }
+    if (!ran) { usage(); return 2; }
+    return 0;
+}
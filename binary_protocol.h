@@ -0,0 +1,193 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+
+// Compact binary order-entry protocol, carried in WebSocket BINARY frames.
+//
+// Every frame is one fixed-layout, packed, little-endian struct starting with
+// bin::Header. Type codes are below 0x20 so a binary frame can never be mistaken
+// for JSON text (which starts with '{' or whitespace; tab/LF/CR are never used
+// as type codes). Flag bit 0 marks that corr is meaningful and should be
+// echoed, mirroring the JSON "corr" field.
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "binary_protocol.h encodes structs in host order and assumes a little-endian host"
+#endif
+
+namespace bin {
+
+constexpr uint8_t kVersion = 1;
+constexpr uint8_t kFlagCorr = 0x01;
+
+// SubmitMsg::order_flags
+constexpr uint8_t kOrderIOC = 0x01;     // cancel whatever does not fill immediately
+constexpr uint8_t kOrderFOK = 0x02;     // fill the whole quantity immediately or cancel it all
+constexpr uint8_t kOrderMarket = 0x04;  // any price (price ignored); never rests
+
+enum MsgType : uint8_t {
+    // Client -> server
+    Submit = 0x01,
+    Cancel = 0x02,
+    Modify = 0x03,
+    // Server -> client
+    SubmitAck = 0x11,
+    CancelAck = 0x12,
+    ModifyAck = 0x13,
+    Execution = 0x14,
+    TradePrint = 0x15,
+    Error = 0x1F,
+};
+
+// Why a request was rejected (0 = accepted)
+enum Reason : uint8_t {
+    Ok = 0,
+    NotOwned = 1,
+    NotFound = 2,
+    NotOpen = 3,
+    Rejected = 4,         // engine refused (bad price/qty, off tick grid, ...)
+    EngineBusy = 5,
+    NotAuthenticated = 6,
+    Malformed = 7,
+    UnknownInstrument = 8,
+};
+
+#pragma pack(push, 1)
+struct Header {
+    uint8_t type;
+    uint8_t flags;
+    uint16_t size;        // total frame size in bytes, header included
+};
+
+// Requests keep corr at byte offset 8 so errors can echo it before decoding
+struct SubmitMsg {
+    Header h;
+    uint32_t qty;
+    uint64_t corr;
+    double price;
+    uint8_t is_buy;
+    uint8_t order_flags;  // kOrderIOC / kOrderFOK / kOrderMarket; 0 = limit, good till cancel
+    uint16_t instrument;  // registry index from auth_response; 0 is the primary instrument
+};
+
+struct CancelMsg {
+    Header h;
+    uint32_t reserved;
+    uint64_t corr;
+    uint64_t order_id;
+};
+
+struct ModifyMsg {
+    Header h;
+    uint32_t qty;
+    uint64_t corr;
+    uint64_t order_id;
+    double price;
+};
+
+struct SubmitAckMsg {
+    Header h;
+    uint8_t success;
+    uint8_t status;       // OrderStatus
+    uint8_t reason;       // Reason
+    uint8_t reserved;
+    uint32_t filled_qty;
+    uint64_t corr;
+    uint64_t order_id;
+};
+
+// Used for both CancelAck and ModifyAck
+struct OrderAckMsg {
+    Header h;
+    uint8_t success;
+    uint8_t status;
+    uint8_t reason;
+    uint8_t reserved;
+    uint32_t elapsed_ms;  // cancel only
+    uint64_t corr;
+    uint64_t order_id;
+};
+
+struct ExecutionMsg {
+    Header h;
+    uint8_t is_buy;
+    uint8_t reserved[3];
+    uint32_t quantity;
+    uint64_t order_id;
+    double price;
+    int64_t position;
+    double avg_cost;
+    double realized_pnl;
+    double unrealized_pnl;
+};
+
+struct TradeMsg {
+    Header h;
+    uint32_t quantity;
+    uint64_t seq;
+    uint64_t buy_order_id;
+    uint64_t sell_order_id;
+    double price;
+    uint64_t timestamp;
+};
+
+struct ErrorMsg {
+    Header h;
+    uint8_t reason;
+    uint8_t reserved[3];
+    uint64_t corr;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(SubmitMsg) == 28, "wire layout");
+static_assert(sizeof(CancelMsg) == 24, "wire layout");
+static_assert(sizeof(ModifyMsg) == 32, "wire layout");
+static_assert(sizeof(SubmitAckMsg) == 28, "wire layout");
+static_assert(sizeof(OrderAckMsg) == 28, "wire layout");
+static_assert(sizeof(ExecutionMsg) == 60, "wire layout");
+static_assert(sizeof(TradeMsg) == 48, "wire layout");
+static_assert(sizeof(ErrorMsg) == 16, "wire layout");
+
+// True if the frame looks like a binary protocol message rather than JSON text
+inline bool isBinaryFrame(std::string_view frame) {
+    if (frame.size() < sizeof(Header)) return false;
+    uint8_t b = static_cast<uint8_t>(frame[0]);
+    return b != 0 && b < 0x20 && b != '\t' && b != '\n' && b != '\r';
+}
+
+inline uint8_t frameType(std::string_view frame) { return static_cast<uint8_t>(frame[0]); }
+
+// Correlation id of a request frame, if it carries one
+inline bool requestCorr(std::string_view frame, uint64_t& corr) {
+    if (frame.size() < 16 || !(static_cast<uint8_t>(frame[1]) & kFlagCorr)) return false;
+    std::memcpy(&corr, frame.data() + 8, sizeof(corr));
+    return true;
+}
+
+// Copy a frame into msg if it has exactly the expected size
+template <typename Msg>
+inline bool decode(std::string_view frame, Msg& msg) {
+    if (frame.size() != sizeof(Msg)) return false;
+    std::memcpy(&msg, frame.data(), sizeof(Msg));
+    return msg.h.size == sizeof(Msg);
+}
+
+// Zeroed message with its header filled in
+template <typename Msg>
+inline Msg make(MsgType type, bool has_corr = false) {
+    Msg msg;
+    std::memset(&msg, 0, sizeof(Msg));
+    msg.h.type = type;
+    msg.h.flags = has_corr ? kFlagCorr : 0;
+    msg.h.size = static_cast<uint16_t>(sizeof(Msg));
+    return msg;
+}
+
+template <typename Msg>
+inline std::string_view view(const Msg& msg) {
+    return std::string_view(reinterpret_cast<const char*>(&msg), sizeof(Msg));
+}
+
+} // namespace bin
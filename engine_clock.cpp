@@ -0,0 +1,59 @@
+#include "engine_clock.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+namespace engine_clock {
+
+namespace {
+
+uint64_t realtimeNs() {
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+// Invariant TSC: constant rate across P/C-states and synchronized between cores
+bool invariantTsc() {
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007) return false;
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) return false;
+    return (edx & (1u << 8)) != 0;
+#else
+    return false;
+#endif
+}
+
+} // namespace
+
+Calibration calibrate() {
+    Calibration c;
+    c.tsc = invariantTsc();
+    c.mult = uint64_t{1} << 32;
+    if (c.tsc) {
+        // Rate: TSC ticks against CLOCK_MONOTONIC_RAW over ~10ms of spinning
+        uint64_t ns0 = monotonicRawNs();
+        uint64_t t0 = ticks(c);
+        uint64_t ns1 = ns0;
+        while (ns1 - ns0 < 10000000) ns1 = monotonicRawNs();
+        uint64_t t1 = ticks(c);
+        if (t1 > t0) c.mult = static_cast<uint64_t>((static_cast<unsigned __int128>(ns1 - ns0) << 32) / (t1 - t0));
+        else c.tsc = false;
+    }
+    // Anchor: the counter read that sits closest to a CLOCK_REALTIME read
+    uint64_t best_gap = UINT64_MAX;
+    for (int i = 0; i < 5; ++i) {
+        uint64_t before = ticks(c);
+        uint64_t wall = realtimeNs();
+        uint64_t after = ticks(c);
+        if (after - before < best_gap) {
+            best_gap = after - before;
+            c.base_ticks = before + (after - before) / 2;
+            c.base_ns = wall;
+        }
+    }
+    return c;
+}
+
+} // namespace engine_clock
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Nanosecond wall-clock timestamps for the matching path.
+//
+// Reads a raw counter and scales it: the TSC when the CPU has an invariant
+// one (a few ns per read, no syscall, no vDSO), CLOCK_MONOTONIC_RAW
+// otherwise. The counter is calibrated against CLOCK_MONOTONIC_RAW once, on
+// first use, and anchored to CLOCK_REALTIME at that moment, so values are
+// nanoseconds since the Unix epoch that never step backwards when NTP
+// adjusts the system clock. Over days they can drift from the system clock
+// by the calibration error (well under a millisecond per hour).
+namespace engine_clock {
+
+struct Calibration {
+    uint64_t base_ticks = 0;    // counter value at the anchor
+    uint64_t base_ns = 0;       // CLOCK_REALTIME at the anchor
+    uint64_t mult = 0;          // ns per tick, 32.32 fixed point
+    bool tsc = false;
+};
+
+// Measures the counter rate (about 10ms with the TSC); runs once
+Calibration calibrate();
+
+inline const Calibration& calibration() {
+    static const Calibration c = calibrate();
+    return c;
+}
+
+inline uint64_t monotonicRawNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+inline uint64_t ticks(const Calibration& c) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (c.tsc) return __rdtsc();
+#endif
+    (void)c;
+    return monotonicRawNs();
+}
+
+// Nanoseconds since the Unix epoch
+inline uint64_t nowNs() {
+    const Calibration& c = calibration();
+    uint64_t elapsed = ticks(c) - c.base_ticks;
+    return c.base_ns + static_cast<uint64_t>((static_cast<unsigned __int128>(elapsed) * c.mult) >> 32);
+}
+
+// "tsc" or "monotonic_raw"
+inline const char* source() { return calibration().tsc ? "tsc" : "monotonic_raw"; }
+
+} // namespace engine_clock
@@ -47,6 +47,12 @@ export default function useWebSocket() {
         setTrades((prev) => [...prev, msg]);
         return;
       }
+      case 'trade_batch': {
+        const batch = msg.trades || [];
+        console.log('[WS] append trade batch size=', batch.length, 'qty=', msg.quantity);
+        setTrades((prev) => [...prev, ...batch]);
+        return;
+      }
       case 'execution': {
         console.log('[WS] execution for order', msg.order_id);
         return;
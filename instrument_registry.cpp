@@ -0,0 +1,27 @@
+#include "instrument_registry.h"
+
+static DirectoryConfig directoryFor(uint32_t index, DirectoryConfig config) {
+    config.id_base = static_cast<uint64_t>(index) << InstrumentRegistry::kIdShift;
+    return config;
+}
+
+static TradeLogConfig tradeLogFor(const InstrumentConfig& config) {
+    TradeLogConfig trade_log = config.trade_log;
+    if (config.trade_history) trade_log.ring_capacity = config.trade_history;
+    return trade_log;
+}
+
+Instrument::Instrument(uint32_t index, const InstrumentConfig& config)
+    : index(index), symbol(config.symbol),
+      book(config.tick_size, config.pool, directoryFor(index, config.directory), tradeLogFor(config)),
+      engine(book, config.queue_depth ? config.queue_depth : MatchingEngine::kDefaultQueueDepth) {}
+
+Instrument* InstrumentRegistry::add(const InstrumentConfig& config) {
+    if (config.symbol.empty() || m_instruments.size() >= kMaxInstruments) return nullptr;
+    if (m_by_symbol.count(config.symbol)) return nullptr;
+    auto index = static_cast<uint32_t>(m_instruments.size());
+    m_instruments.push_back(std::make_unique<Instrument>(index, config));
+    Instrument* inst = m_instruments.back().get();
+    m_by_symbol.emplace(inst->symbol, inst);
+    return inst;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "order-book.h"
+#include "matching_engine.h"
+
+struct InstrumentConfig {
+    std::string symbol;
+    double tick_size = 0.01;
+    SlabConfig pool;               // each instrument gets its own order pool
+    TradeLogConfig trade_log;
+    DirectoryConfig directory;     // id_base is assigned by the registry
+    size_t queue_depth = 0;        // engine command / event ring entries; 0 = MatchingEngine default
+    size_t trade_history = 0;      // trades kept in memory; 0 = trade_log.ring_capacity
+};
+
+// One tradable symbol: its own book, order pool, trade log and matching
+// engine. Nothing is shared between instruments, so a busy symbol never
+// waits on another one, and engines may be spread over any number of threads.
+struct Instrument {
+    Instrument(uint32_t index, const InstrumentConfig& config);
+
+    const uint32_t index;
+    const std::string symbol;
+    OrderBook book;
+    MatchingEngine engine;          // sole mutator of book once the server is running
+};
+
+// Symbol -> Instrument. Order ids are globally unique: the instrument index
+// sits in the high bits (id >> kIdShift), so cancels and modifies route by id alone.
+class InstrumentRegistry {
+public:
+    static constexpr unsigned kIdShift = 40;            // 2^40 orders per instrument
+    static constexpr size_t kMaxInstruments = 1u << 16;
+
+    // nullptr if the symbol is empty, already registered or the registry is full
+    Instrument* add(const InstrumentConfig& config);
+
+    Instrument* find(std::string_view symbol) const {
+        auto it = m_by_symbol.find(std::string(symbol));
+        return it != m_by_symbol.end() ? it->second : nullptr;
+    }
+    Instrument* at(size_t index) const {
+        return index < m_instruments.size() ? m_instruments[index].get() : nullptr;
+    }
+    Instrument* forOrder(uint64_t order_id) const { return at(order_id >> kIdShift); }
+
+    size_t size() const { return m_instruments.size(); }
+    bool empty() const { return m_instruments.empty(); }
+
+    // Visit instruments in registration (index) order: fn(Instrument&)
+    template <typename F>
+    void forEach(F&& fn) const {
+        for (const auto& inst : m_instruments) fn(*inst);
+    }
+
+private:
+    std::vector<std::unique_ptr<Instrument>> m_instruments; // stable addresses; engines hold book references
+    std::unordered_map<std::string, Instrument*> m_by_symbol;
+};
@@ -0,0 +1,415 @@
+#include "journal.h"
+#include "log.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace {
+constexpr char kSnapshotMagic[8] = {'B', 'O', 'O', 'K', 'S', 'N', 'P', '1'};
+
+#pragma pack(push, 1)
+struct SnapshotHeader {
+    char magic[8];
+    uint64_t lsn;
+    uint64_t next_order_id;
+    uint64_t trade_seq;
+    uint64_t depth_seq;
+    uint64_t order_count;
+    uint64_t directory_bytes;
+    uint64_t account_count;
+};
+#pragma pack(pop)
+
+uint64_t fnv1a64(const void* data, size_t size, uint64_t hash = 1469598103934665603ull) {
+    const auto* p = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i) hash = (hash ^ p[i]) * 1099511628211ull;
+    return hash;
+}
+
+uint32_t recordChecksum(const WalRecord& rec) {
+    const auto* p = reinterpret_cast<const uint8_t*>(&rec) + sizeof(rec.checksum);
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < sizeof(WalRecord) - sizeof(rec.checksum); ++i) hash = (hash ^ p[i]) * 16777619u;
+    return hash;
+}
+
+bool writeAll(int fd, const void* data, size_t size) {
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t n = ::write(fd, p, size);
+        if (n <= 0) return false;
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Make renames and new files in dir durable
+void syncDir(const std::string& dir) {
+    int fd = ::open(dir.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    ::fsync(fd);
+    ::close(fd);
+}
+}
+
+Journal::Journal(const JournalConfig& config, std::string name)
+    : m_config(config), m_name(std::move(name)), m_snapshot_path(m_config.dir + "/" + m_name + ".snap") {
+    m_pending.reserve(4096);
+}
+
+Journal::~Journal() {
+    close();
+}
+
+std::string Journal::segmentPath(uint64_t first_lsn) const {
+    char suffix[32];
+    std::snprintf(suffix, sizeof(suffix), ".wal.%020llu", static_cast<unsigned long long>(first_lsn));
+    return m_config.dir + "/" + m_name + suffix;
+}
+
+// (first lsn, path) of every WAL segment, oldest first
+std::vector<std::pair<uint64_t, std::string>> Journal::segments() const {
+    std::vector<std::pair<uint64_t, std::string>> out;
+    DIR* dir = ::opendir(m_config.dir.c_str());
+    if (!dir) return out;
+    std::string prefix = m_name + ".wal.";
+    while (dirent* entry = ::readdir(dir)) {
+        std::string file = entry->d_name;
+        if (file.compare(0, prefix.size(), prefix) != 0 || file.size() == prefix.size()) continue;
+        char* end = nullptr;
+        uint64_t first = std::strtoull(file.c_str() + prefix.size(), &end, 10);
+        if (*end != '\0' || first == 0) continue;
+        out.emplace_back(first, m_config.dir + "/" + file);
+    }
+    ::closedir(dir);
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+SnapshotStatus Journal::loadSnapshot(SnapshotImage& image) {
+    int fd = ::open(m_snapshot_path.c_str(), O_RDONLY);
+    if (fd < 0) return errno == ENOENT ? SnapshotStatus::Absent : SnapshotStatus::Corrupt;
+    struct stat st;
+    std::vector<char> data;
+    if (fstat(fd, &st) == 0) {
+        data.resize(static_cast<size_t>(st.st_size));
+        size_t off = 0;
+        while (off < data.size()) {
+            ssize_t n = ::read(fd, data.data() + off, data.size() - off);
+            if (n <= 0) break;
+            off += static_cast<size_t>(n);
+        }
+        data.resize(off);
+    }
+    ::close(fd);
+
+    // Snapshots are renamed into place complete, so a short or damaged file is not a torn write
+    SnapshotHeader h;
+    if (data.size() < sizeof(h) + sizeof(uint64_t)) return SnapshotStatus::Corrupt;
+    std::memcpy(&h, data.data(), sizeof(h));
+    if (std::memcmp(h.magic, kSnapshotMagic, sizeof(kSnapshotMagic)) != 0) return SnapshotStatus::Corrupt;
+    size_t body = sizeof(h) + h.order_count * sizeof(SnapshotOrder) + h.directory_bytes + h.account_count * sizeof(SnapshotAccount);
+    if (h.order_count > data.size() || h.directory_bytes > data.size() || h.account_count > data.size() ||
+        body + sizeof(uint64_t) != data.size()) {
+        return SnapshotStatus::Corrupt;
+    }
+    uint64_t checksum = 0;
+    std::memcpy(&checksum, data.data() + body, sizeof(checksum));
+    if (fnv1a64(data.data(), body) != checksum) return SnapshotStatus::Corrupt;
+
+    const char* p = data.data() + sizeof(h);
+    image.lsn = h.lsn;
+    image.next_order_id = h.next_order_id;
+    image.trade_seq = h.trade_seq;
+    image.depth_seq = h.depth_seq;
+    image.orders.resize(h.order_count);
+    std::memcpy(image.orders.data(), p, h.order_count * sizeof(SnapshotOrder));
+    p += h.order_count * sizeof(SnapshotOrder);
+    image.directory.assign(p, p + h.directory_bytes);
+    p += h.directory_bytes;
+    image.accounts.resize(h.account_count);
+    std::memcpy(image.accounts.data(), p, h.account_count * sizeof(SnapshotAccount));
+    m_snapshot_lsn.store(h.lsn, std::memory_order_release);
+    return SnapshotStatus::Loaded;
+}
+
+bool Journal::replay(uint64_t after, uint64_t& last, const std::function<void(const WalRecord&)>& fn) const {
+    last = after;
+    std::vector<WalRecord> chunk(16384);
+    for (const auto& [first, path] : segments()) {
+        if (first > last + 1) return false; // gap
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        bool intact = true;
+        size_t carry = 0; // bytes of a partial record left over from the previous read
+        while (intact) {
+            char* buf = reinterpret_cast<char*>(chunk.data());
+            ssize_t n = ::read(fd, buf + carry, chunk.size() * sizeof(WalRecord) - carry);
+            if (n <= 0) break;
+            size_t bytes = carry + static_cast<size_t>(n);
+            size_t count = bytes / sizeof(WalRecord);
+            for (size_t i = 0; i < count; ++i) {
+                const WalRecord& rec = chunk[i];
+                if (rec.checksum != recordChecksum(rec) || rec.type < 1 || rec.type > 3) { intact = false; break; }
+                if (rec.lsn <= last) continue;
+                if (rec.lsn != last + 1) { intact = false; break; }
+                fn(rec);
+                last = rec.lsn;
+            }
+            carry = bytes - count * sizeof(WalRecord);
+            if (carry) std::memmove(buf, buf + count * sizeof(WalRecord), carry);
+        }
+        ::close(fd);
+    }
+    return true;
+}
+
+bool Journal::open(uint64_t last_lsn) {
+    if (m_open) return false;
+    struct stat st;
+    if (::stat(m_config.dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) return false;
+    m_last_lsn = last_lsn;
+    m_rotate_at = last_lsn + 1; // never append behind a possibly torn tail
+    m_durable_lsn.store(last_lsn, std::memory_order_release);
+    m_failing.store(false, std::memory_order_relaxed);
+    m_failed.store(false, std::memory_order_relaxed);
+    m_stop = false;
+    m_snap_stop = false;
+    m_last_snapshot = std::chrono::steady_clock::now();
+    m_open = true;
+    m_flusher = std::thread([this]() { flushLoop(); });
+    m_snapshotter = std::thread([this]() { snapshotLoop(); });
+    return true;
+}
+
+void Journal::close() {
+    if (!m_open) return;
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_flusher.join();
+    {
+        std::lock_guard<std::mutex> lk(m_snap_mutex);
+        m_snap_stop = true;
+    }
+    m_snap_cv.notify_all();
+    m_snapshotter.join();
+    if (m_fd >= 0) {
+        ::fdatasync(m_fd);
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    m_open = false;
+}
+
+uint64_t Journal::append(WalType type, uint64_t order_id, int64_t price_ticks, uint32_t quantity, bool is_buy, uint32_t owner,
+                         uint8_t tif, bool market) {
+    WalRecord rec{};
+    rec.type = static_cast<uint8_t>(type);
+    rec.is_buy = is_buy;
+    rec.tif = tif;
+    rec.market = market;
+    rec.quantity = quantity;
+    rec.owner = owner;
+    rec.lsn = ++m_last_lsn;
+    rec.order_id = order_id;
+    rec.price_ticks = price_ticks;
+    rec.checksum = recordChecksum(rec);
+    bool first = false;
+    {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        first = m_pending.empty();
+        m_pending.push_back(rec);
+    }
+    if (first) m_cv.notify_one(); // later records of the batch ride along
+    return rec.lsn;
+}
+
+int Journal::writeRecords(const std::vector<WalRecord>& recs, uint64_t rotate_at, size_t& done) {
+    done = 0;
+    while (done < recs.size()) {
+        if (m_fd < 0 || (recs[done].lsn >= rotate_at && m_segment_first < rotate_at)) {
+            // The current segment, if any, was synced when its last records were written
+            if (m_fd >= 0) ::close(m_fd);
+            m_segment_first = recs[done].lsn;
+            m_segment_bytes = 0;
+            m_fd = ::open(segmentPath(m_segment_first).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+            if (m_fd < 0) return errno;
+            syncDir(m_config.dir);
+        }
+        size_t end = done;
+        while (end < recs.size() && !(recs[end].lsn >= rotate_at && m_segment_first < rotate_at)) ++end;
+        size_t bytes = (end - done) * sizeof(WalRecord);
+        if (!writeAll(m_fd, recs.data() + done, bytes) || ::fdatasync(m_fd) != 0) {
+            int err = errno;
+            // Cut a partial write so the segment ends on its last durable record. If even
+            // that fails, leave the torn tail (replay stops there) and retry in a new segment.
+            if (::ftruncate(m_fd, m_segment_bytes) != 0) {
+                ::close(m_fd);
+                m_fd = -1;
+            }
+            return err ? err : EIO;
+        }
+        m_segment_bytes += static_cast<off_t>(bytes);
+        done = end;
+    }
+    return 0;
+}
+
+void Journal::flushLoop() {
+    constexpr int kWriteAttempts = 5;
+    std::vector<WalRecord> batch; // taken from m_pending and not yet durable; kept across a failed write
+    batch.reserve(4096);
+    int failures = 0;
+    std::unique_lock<std::mutex> lk(m_mutex);
+    while (true) {
+        m_cv.wait(lk, [&]() { return !m_pending.empty() || !batch.empty() || m_stop; });
+        if (m_pending.empty() && batch.empty()) break;
+        if (!m_stop && batch.empty()) {
+            // Group commit: one fdatasync covers everything appended during the window
+            lk.unlock();
+            std::this_thread::sleep_for(m_config.group_commit);
+            lk.lock();
+        }
+        batch.insert(batch.end(), m_pending.begin(), m_pending.end());
+        m_pending.clear();
+        uint64_t rotate_at = m_rotate_at;
+        m_flushing = true;
+        lk.unlock();
+
+        size_t done = 0;
+        int err = writeRecords(batch, rotate_at, done);
+        uint64_t durable = done ? batch[done - 1].lsn : 0;
+        batch.erase(batch.begin(), batch.begin() + static_cast<ptrdiff_t>(done));
+        bool give_up = false;
+        m_failing.store(err != 0, std::memory_order_release);
+        if (!err) {
+            failures = 0;
+        } else if (++failures < kWriteAttempts) {
+            LOG_ERROR("WAL {}: write failed at lsn {}: {}; retrying", m_name, batch.front().lsn, std::strerror(err));
+            std::this_thread::sleep_for(std::chrono::milliseconds(10 << failures));
+        } else {
+            LOG_ERROR("WAL {}: write failed at lsn {}: {}; giving up, commands from here on are refused",
+                      m_name, batch.front().lsn, std::strerror(err));
+            give_up = true;
+        }
+
+        lk.lock();
+        if (done) m_durable_lsn.store(durable, std::memory_order_release);
+        m_flushing = !batch.empty();
+        if (give_up) {
+            // Nothing after the hole may reach the log, or replay would skip the lost records
+            m_failed.store(true, std::memory_order_release);
+            m_flushing = false;
+            m_synced_cv.notify_all();
+            break;
+        }
+        m_synced_cv.notify_all();
+    }
+    m_synced_cv.notify_all();
+}
+
+bool Journal::snapshotDue() const {
+    return m_open && !m_snap_busy.load(std::memory_order_acquire) && m_last_lsn > snapshotLsn() &&
+           std::chrono::steady_clock::now() - m_last_snapshot >= m_config.snapshot_interval;
+}
+
+void Journal::submitSnapshot(std::unique_ptr<SnapshotImage> image) {
+    if (!m_open || !image) return;
+    m_last_snapshot = std::chrono::steady_clock::now();
+    m_snap_busy.store(true, std::memory_order_release);
+    {
+        // Records after the image go to a fresh segment, so older ones can be dropped whole
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_rotate_at = image->lsn + 1;
+    }
+    {
+        std::lock_guard<std::mutex> lk(m_snap_mutex);
+        m_snap_job = std::move(image);
+    }
+    m_snap_cv.notify_all();
+}
+
+bool Journal::sync() {
+    if (!m_open) return true;
+    {
+        std::unique_lock<std::mutex> lk(m_mutex);
+        m_synced_cv.wait(lk, [this]() { return (m_pending.empty() && !m_flushing) || failed(); });
+    }
+    std::unique_lock<std::mutex> lk(m_snap_mutex);
+    m_snap_cv.wait(lk, [this]() { return !m_snap_busy.load(std::memory_order_acquire); });
+    return !failed();
+}
+
+void Journal::snapshotLoop() {
+    std::unique_lock<std::mutex> lk(m_snap_mutex);
+    while (true) {
+        m_snap_cv.wait(lk, [this]() { return m_snap_job || m_snap_stop; });
+        if (!m_snap_job) break;
+        std::unique_ptr<SnapshotImage> job = std::move(m_snap_job);
+        lk.unlock();
+        if (writeSnapshot(*job)) {
+            m_snapshot_lsn.store(job->lsn, std::memory_order_release);
+            removeSegmentsThrough(job->lsn);
+        }
+        job.reset();
+        lk.lock();
+        m_snap_busy.store(false, std::memory_order_release);
+        m_snap_cv.notify_all();
+    }
+}
+
+bool Journal::writeSnapshot(const SnapshotImage& image) {
+    SnapshotHeader h;
+    std::memcpy(h.magic, kSnapshotMagic, sizeof(kSnapshotMagic));
+    h.lsn = image.lsn;
+    h.next_order_id = image.next_order_id;
+    h.trade_seq = image.trade_seq;
+    h.depth_seq = image.depth_seq;
+    h.order_count = image.orders.size();
+    h.directory_bytes = image.directory.size();
+    h.account_count = image.accounts.size();
+
+    std::string tmp = m_snapshot_path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    const std::pair<const void*, size_t> parts[] = {
+        {&h, sizeof(h)},
+        {image.orders.data(), image.orders.size() * sizeof(SnapshotOrder)},
+        {image.directory.data(), image.directory.size()},
+        {image.accounts.data(), image.accounts.size() * sizeof(SnapshotAccount)},
+    };
+    uint64_t checksum = fnv1a64(nullptr, 0);
+    bool ok = true;
+    for (const auto& [data, size] : parts) {
+        if (!size) continue;
+        checksum = fnv1a64(data, size, checksum);
+        ok = ok && writeAll(fd, data, size);
+    }
+    ok = ok && writeAll(fd, &checksum, sizeof(checksum)) && ::fdatasync(fd) == 0;
+    ::close(fd);
+    // The previous snapshot stays in place until the new one is complete on disk
+    if (!ok || ::rename(tmp.c_str(), m_snapshot_path.c_str()) != 0) {
+        ::unlink(tmp.c_str());
+        return false;
+    }
+    syncDir(m_config.dir);
+    return true;
+}
+
+void Journal::removeSegmentsThrough(uint64_t lsn) {
+    // Segments are cut at every snapshot, so one starting at or before lsn holds nothing newer
+    for (const auto& [first, path] : segments()) {
+        if (first > lsn) break;
+        ::unlink(path.c_str());
+    }
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <sys/types.h>
+
+struct JournalConfig {
+    std::string dir;                                        // WAL segments and snapshots of every book
+    std::chrono::microseconds group_commit{200};            // batch window before each write + fdatasync
+    std::chrono::seconds snapshot_interval{60};             // minimum time between snapshots
+};
+
+enum class WalType : uint8_t { Submit = 1, Cancel = 2, Modify = 3 };
+
+// Outcome of Journal::loadSnapshot
+enum class SnapshotStatus { Absent, Loaded, Corrupt };
+
+#pragma pack(push, 1)
+// One accepted command (little-endian, fixed size). Only commands that
+// changed the book are logged, so replay never has to re-reject anything.
+struct WalRecord {
+    uint32_t checksum;      // FNV-1a over the rest of the record
+    uint8_t type;           // WalType
+    uint8_t is_buy;
+    uint8_t tif;            // TimeInForce of a submit (0 = GTC)
+    uint8_t market;         // submit was a market order (price_ticks 0)
+    uint32_t quantity;
+    uint32_t owner;         // account that entered the order (submit)
+    uint64_t lsn;           // 1-based, contiguous across segments
+    uint64_t order_id;      // id assigned by the submit, or the order cancelled / modified
+    int64_t price_ticks;
+};
+
+// Snapshot image of one resting order
+struct SnapshotOrder {
+    uint64_t id;
+    int64_t price_ticks;
+    uint32_t quantity;
+    uint32_t owner;
+    uint8_t is_buy;
+    uint8_t reserved[7];
+};
+
+// Snapshot image of one account's position in the book
+struct SnapshotAccount {
+    uint32_t owner;
+    uint32_t reserved;
+    int64_t position;
+    double avg_cost;
+    double realized_pnl;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(WalRecord) == 40, "WalRecord layout is part of the WAL format");
+static_assert(sizeof(SnapshotOrder) == 32, "SnapshotOrder layout is part of the snapshot format");
+static_assert(sizeof(SnapshotAccount) == 32, "SnapshotAccount layout is part of the snapshot format");
+
+// Everything needed to rebuild a book as of WAL position lsn
+struct SnapshotImage {
+    uint64_t lsn = 0;
+    uint64_t next_order_id = 0;
+    uint64_t trade_seq = 0;
+    uint64_t depth_seq = 0;
+    std::vector<SnapshotOrder> orders;      // per side best level first, FIFO within a level
+    std::vector<uint8_t> directory;         // OrderDirectory::exportStatus
+    std::vector<SnapshotAccount> accounts;
+};
+
+// Durable command log plus periodic snapshots for one book.
+//
+// The engine thread appends records into an in-memory batch; a flusher
+// thread wakes on the first record of a batch, lets it fill for the group
+// commit window, then writes it with one write + fdatasync. Segments are
+// files NAME.wal.<first lsn>; a new one starts after every snapshot so
+// segments fully covered by the latest snapshot can simply be deleted.
+// A batch that fails to write is cut back to the last durable record and
+// retried; the engine refuses commands while failing() and for good once
+// retries run out and the journal reports failed().
+// Snapshots (NAME.snap) are captured in memory by the engine and written,
+// synced and atomically renamed into place by a separate writer thread.
+class Journal {
+public:
+    Journal(const JournalConfig& config, std::string name);
+    ~Journal();
+
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    // Latest snapshot. Corrupt if the file exists but cannot be read or fails its
+    // magic, size or checksum check; recovery must not go on without it.
+    SnapshotStatus loadSnapshot(SnapshotImage& image);
+    // Visit intact records with lsn > after in order; a torn or corrupt record
+    // ends its segment. last is set to the last lsn visited (after if none).
+    // False if a segment cannot be read or starts past last + 1: the records
+    // in between are lost and appending from last would fork the log.
+    bool replay(uint64_t after, uint64_t& last, const std::function<void(const WalRecord&)>& fn) const;
+
+    // Start logging after last_lsn; spawns the flusher and snapshot threads
+    bool open(uint64_t last_lsn);
+    // Write everything pending, wait for the snapshot writer and join both threads
+    void close();
+
+    // Queue one record (engine thread). Assigns and returns its lsn.
+    uint64_t append(WalType type, uint64_t order_id, int64_t price_ticks, uint32_t quantity, bool is_buy, uint32_t owner,
+                    uint8_t tif = 0, bool market = false);
+    const std::string& name() const { return m_name; }
+    uint64_t lastLsn() const { return m_last_lsn; }
+    uint64_t durableLsn() const { return m_durable_lsn.load(std::memory_order_acquire); }
+    // The last write failed and is being retried
+    bool failing() const { return m_failing.load(std::memory_order_acquire); }
+    // Retries ran out and logging stopped; records from durableLsn() + 1 on are lost
+    bool failed() const { return m_failed.load(std::memory_order_acquire); }
+
+    // True when the interval has passed, the writer is idle and there is something new to cover
+    bool snapshotDue() const;
+    uint64_t snapshotLsn() const { return m_snapshot_lsn.load(std::memory_order_acquire); }
+    // Hand a captured image to the writer thread; WAL segments before it are dropped once it is durable
+    void submitSnapshot(std::unique_ptr<SnapshotImage> image);
+    // Block until every queued record is durable and no snapshot is being written.
+    // False if the log has failed.
+    bool sync();
+
+private:
+    void flushLoop();
+    // Append recs to the current segment (rotating at rotate_at) and sync; done counts the
+    // records now durable. Returns 0 or the errno of the failed step.
+    int writeRecords(const std::vector<WalRecord>& recs, uint64_t rotate_at, size_t& done);
+    void snapshotLoop();
+    bool writeSnapshot(const SnapshotImage& image);
+    void removeSegmentsThrough(uint64_t lsn);
+    std::vector<std::pair<uint64_t, std::string>> segments() const;
+    std::string segmentPath(uint64_t first_lsn) const;
+
+    JournalConfig m_config;
+    std::string m_name;
+    std::string m_snapshot_path;
+
+    // Engine side
+    uint64_t m_last_lsn = 0;
+
+    // Flusher
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::condition_variable m_synced_cv;
+    std::vector<WalRecord> m_pending;       // guarded by m_mutex
+    uint64_t m_rotate_at = 0;               // next record at or past this lsn opens a new segment
+    bool m_stop = false;
+    bool m_flushing = false;
+    int m_fd = -1;
+    uint64_t m_segment_first = 0;
+    off_t m_segment_bytes = 0;              // durable length of the current segment
+    std::atomic<uint64_t> m_durable_lsn{0};
+    std::atomic<bool> m_failing{false};
+    std::atomic<bool> m_failed{false};
+    std::thread m_flusher;
+
+    // Snapshot writer
+    std::mutex m_snap_mutex;
+    std::condition_variable m_snap_cv;
+    std::unique_ptr<SnapshotImage> m_snap_job; // guarded by m_snap_mutex
+    bool m_snap_stop = false;
+    std::atomic<bool> m_snap_busy{false};
+    std::atomic<uint64_t> m_snapshot_lsn{0};
+    std::chrono::steady_clock::time_point m_last_snapshot = std::chrono::steady_clock::now();
+    std::thread m_snapshotter;
+    bool m_open = false;
+};
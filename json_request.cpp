@@ -0,0 +1,275 @@
+#include "json_request.h"
+#include <array>
+#include <charconv>
+
+namespace jreq {
+
+namespace {
+
+struct TypeName {
+    std::string_view name;
+    Type type = Type::Unknown;
+};
+
+constexpr TypeName kTypes[] = {
+    {"auth", Type::Auth},
+    {"submit", Type::Submit},
+    {"submit_batch", Type::SubmitBatch},
+    {"cancel_batch", Type::CancelBatch},
+    {"cancel_all", Type::CancelAll},
+    {"cancel", Type::Cancel},
+    {"modify", Type::Modify},
+    {"getOrderStatus", Type::GetOrderStatus},
+    {"getTradeHistory", Type::GetTradeHistory},
+    {"getOrderBookSnapshot", Type::GetOrderBookSnapshot},
+    {"subscribeDepth", Type::SubscribeDepth},
+    {"unsubscribeDepth", Type::UnsubscribeDepth},
+    {"subscribe", Type::Subscribe},
+    {"unsubscribe", Type::Unsubscribe},
+    {"getRealizedPnL", Type::GetRealizedPnL},
+    {"getUnrealizedPnL", Type::GetUnrealizedPnL},
+    {"getAllPnL", Type::GetAllPnL},
+    {"getMetrics", Type::GetMetrics},
+    {"getOpenOrdersCount", Type::GetOpenOrdersCount},
+};
+
+// Perfect hash over kTypes (length, first and last character); a new type that
+// collides trips the static_assert below and needs new multipliers
+constexpr size_t kTypeSlots = 64;
+constexpr size_t typeHash(std::string_view s) {
+    return (s.size() * 3 + static_cast<uint8_t>(s.front()) + static_cast<uint8_t>(s.back()) * 4) & (kTypeSlots - 1);
+}
+
+constexpr bool typeHashIsPerfect() {
+    for (size_t i = 0; i < std::size(kTypes); ++i) {
+        for (size_t k = i + 1; k < std::size(kTypes); ++k) {
+            if (typeHash(kTypes[i].name) == typeHash(kTypes[k].name)) return false;
+        }
+    }
+    return true;
+}
+static_assert(typeHashIsPerfect(), "request type names collide in typeHash");
+
+constexpr std::array<TypeName, kTypeSlots> kTypeTable = [] {
+    std::array<TypeName, kTypeSlots> table{};
+    for (const TypeName& t : kTypes) table[typeHash(t.name)] = t;
+    return table;
+}();
+
+int fieldOf(std::string_view key) {
+    switch (key.size()) {
+    case 2: if (key == "id") return FId; break;
+    case 3:
+        if (key == "qty") return FQty;
+        if (key == "tif") return FTif;
+        if (key == "ids") return FIds;
+        break;
+    case 4:
+        if (key == "type") return FType;
+        if (key == "corr") return FCorr;
+        if (key == "side") return FSide;
+        if (key == "name") return FName;
+        break;
+    case 5:
+        if (key == "price") return FPrice;
+        if (key == "limit") return FLimit;
+        if (key == "token") return FToken;
+        break;
+    case 6:
+        if (key == "symbol") return FSymbol;
+        if (key == "is_buy") return FIsBuy;
+        if (key == "orders") return FOrders;
+        break;
+    case 8: if (key == "protocol") return FProtocol; break;
+    case 9:
+        if (key == "since_seq") return FSinceSeq;
+        if (key == "min_price") return FMinPrice;
+        if (key == "max_price") return FMaxPrice;
+        break;
+    case 10: if (key == "order_type") return FOrderType; break;
+    }
+    return -1;
+}
+
+inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+// In-place scanner over one message; every parse* returns false where the fast
+// path gives up (including input nlohmann would reject)
+struct Scanner {
+    const char* p;
+    const char* end;
+
+    void skipWs() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) ++p;
+    }
+
+    bool take(char c) {
+        if (p == end || *p != c) return false;
+        ++p;
+        return true;
+    }
+
+    bool literal(std::string_view word) {
+        if (static_cast<size_t>(end - p) < word.size() || std::string_view(p, word.size()) != word) return false;
+        p += word.size();
+        return true;
+    }
+
+    // Plain ASCII only: escapes and UTF-8 (which nlohmann validates) go to the slow path
+    bool parseString(std::string_view& out) {
+        if (!take('"')) return false;
+        const char* start = p;
+        while (p < end) {
+            auto c = static_cast<unsigned char>(*p);
+            if (c == '"') {
+                out = std::string_view(start, static_cast<size_t>(p - start));
+                ++p;
+                return true;
+            }
+            if (c < 0x20 || c == '\\' || c >= 0x80) return false;
+            ++p;
+        }
+        return false;
+    }
+
+    bool parseNumber(Value& v) {
+        const char* start = p;
+        bool negative = take('-');
+        if (p == end) return false;
+        if (*p == '0') {
+            ++p;
+        } else if (isDigit(*p)) {
+            while (p < end && isDigit(*p)) ++p;
+        } else {
+            return false;
+        }
+        bool integral = true;
+        if (take('.')) {
+            integral = false;
+            if (p == end || !isDigit(*p)) return false;
+            while (p < end && isDigit(*p)) ++p;
+        }
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            integral = false;
+            ++p;
+            if (p < end && (*p == '+' || *p == '-')) ++p;
+            if (p == end || !isDigit(*p)) return false;
+            while (p < end && isDigit(*p)) ++p;
+        }
+        // nlohmann: unsigned, then signed, then double for integers that overflow
+        if (integral && !negative) {
+            uint64_t u = 0;
+            if (std::from_chars(start, p, u).ec == std::errc()) {
+                v.kind = Kind::Unsigned;
+                v.u = u;
+                v.d = static_cast<double>(u);
+                return true;
+            }
+        } else if (integral) {
+            int64_t i = 0;
+            if (std::from_chars(start, p, i).ec == std::errc()) {
+                v.kind = Kind::Number;
+                v.d = static_cast<double>(i);
+                return true;
+            }
+        }
+        double d = 0.0;
+        if (std::from_chars(start, p, d).ec != std::errc()) return false; // out of range: let nlohmann report it
+        v.kind = Kind::Number;
+        v.d = d;
+        return true;
+    }
+
+    // Scalars only; objects and arrays go to the slow path
+    bool parseValue(Value& v) {
+        if (p == end) return false;
+        switch (*p) {
+        case '"':
+            v.kind = Kind::String;
+            return parseString(v.s);
+        case 't':
+            v.kind = Kind::Bool;
+            v.b = true;
+            return literal("true");
+        case 'f':
+            v.kind = Kind::Bool;
+            v.b = false;
+            return literal("false");
+        case 'n':
+            v.kind = Kind::Null;
+            return literal("null");
+        default:
+            return (*p == '-' || isDigit(*p)) && parseNumber(v);
+        }
+    }
+};
+
+Value toValue(const nlohmann::json& j) {
+    using vt = nlohmann::json::value_t;
+    Value v;
+    switch (j.type()) {
+    case vt::null: v.kind = Kind::Null; break;
+    case vt::boolean: v.kind = Kind::Bool; v.b = j.get<bool>(); break;
+    case vt::number_unsigned:
+        v.kind = Kind::Unsigned;
+        v.u = j.get<uint64_t>();
+        v.d = static_cast<double>(v.u);
+        break;
+    case vt::number_integer:
+    case vt::number_float: v.kind = Kind::Number; v.d = j.get<double>(); break;
+    case vt::string: v.kind = Kind::String; v.s = j.get_ref<const std::string&>(); break;
+    case vt::array: v.kind = Kind::Array; break;
+    default: v.kind = Kind::Object; break;
+    }
+    return v;
+}
+
+} // namespace
+
+Type typeOf(std::string_view name) {
+    if (name.empty()) return Type::Unknown;
+    const TypeName& t = kTypeTable[typeHash(name)];
+    return t.name == name ? t.type : Type::Unknown;
+}
+
+bool decode(std::string_view text, Request& out) {
+    for (Value& f : out.fields) f.kind = Kind::Missing;
+    Scanner in{text.data(), text.data() + text.size()};
+    in.skipWs();
+    if (!in.take('{')) return false;
+    in.skipWs();
+    if (!in.take('}')) {
+        while (true) {
+            std::string_view key;
+            Value v;
+            if (!in.parseString(key)) return false;
+            in.skipWs();
+            if (!in.take(':')) return false;
+            in.skipWs();
+            if (!in.parseValue(v)) return false;
+            int f = fieldOf(key);
+            if (f >= 0) {
+                if (out.fields[f].present()) return false; // duplicate key: nlohmann keeps the last one
+                out.fields[f] = v;
+            }
+            in.skipWs();
+            if (in.take('}')) break;
+            if (!in.take(',')) return false;
+            in.skipWs();
+        }
+    }
+    in.skipWs();
+    return in.p == in.end;
+}
+
+bool fromJson(const nlohmann::json& j, Request& out) {
+    if (!j.is_object()) return false;
+    out = Request{};
+    for (auto it = j.begin(); it != j.end(); ++it) {
+        int f = fieldOf(it.key());
+        if (f >= 0) out.fields[f] = toValue(it.value());
+    }
+    return true;
+}
+
+} // namespace jreq
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+#include <nlohmann/json.hpp>
+
+// Decoder for JSON client requests.
+//
+// Requests are flat objects of scalars ({"type":"submit","price":100.5,...}).
+// decode() scans such a message in place: no DOM, no heap, each known key
+// lands in a fixed slot of Request and string values are views into the
+// message. Anything it does not handle exactly like nlohmann (escapes,
+// non-ASCII, nested values, duplicate keys, malformed input) makes it return
+// false; the caller then parses with nlohmann and fills the same Request with
+// fromJson(), so both paths produce the same replies. Values come out with
+// nlohmann's number classes: a non-negative integer that fits 64 bits is
+// Unsigned, any other number is Number.
+namespace jreq {
+
+enum class Type : uint8_t {
+    Unknown,
+    Auth,
+    Submit,
+    SubmitBatch,
+    CancelBatch,
+    CancelAll,
+    Cancel,
+    Modify,
+    GetOrderStatus,
+    GetTradeHistory,
+    GetOrderBookSnapshot,
+    SubscribeDepth,
+    UnsubscribeDepth,
+    Subscribe,
+    Unsubscribe,
+    GetRealizedPnL,
+    GetUnrealizedPnL,
+    GetAllPnL,
+    GetMetrics,
+    GetOpenOrdersCount,
+};
+
+// Keys the gateway reads; others are skipped
+enum Field : uint8_t {
+    FType,
+    FCorr,
+    FSymbol,
+    FId,
+    FPrice,
+    FQty,
+    FIsBuy,
+    FOrderType,
+    FTif,
+    FSide,
+    FMinPrice,
+    FMaxPrice,
+    FLimit,
+    FSinceSeq,
+    FToken,
+    FName,
+    FProtocol,
+    FOrders,
+    FIds,
+    kFieldCount
+};
+
+// Array and Object only come from fromJson(); read their contents from the json
+enum class Kind : uint8_t { Missing, Null, Bool, Unsigned, Number, String, Array, Object };
+
+// Only the members that belong to `kind` are meaningful
+struct Value {
+    Kind kind = Kind::Missing;
+    bool b = false;         // Bool
+    uint64_t u = 0;         // Unsigned
+    double d = 0.0;         // Unsigned and Number
+    std::string_view s;     // String
+
+    bool present() const { return kind != Kind::Missing; }
+    bool isUnsigned() const { return kind == Kind::Unsigned; }
+    bool isNumber() const { return kind == Kind::Unsigned || kind == Kind::Number; }
+    bool isBool() const { return kind == Kind::Bool; }
+    bool isString() const { return kind == Kind::String; }
+
+    // json::value(key, default): the default when missing, throws when the type does not convert
+    std::string_view str(std::string_view def) const {
+        if (kind == Kind::Missing) return def;
+        if (kind != Kind::String) throw std::invalid_argument("type must be string");
+        return s;
+    }
+    double num(double def) const {
+        if (kind == Kind::Missing) return def;
+        if (isNumber()) return d;
+        if (kind == Kind::Bool) return b ? 1.0 : 0.0;
+        throw std::invalid_argument("type must be number");
+    }
+};
+
+struct Request {
+    Value fields[kFieldCount];
+    const Value& operator[](Field f) const { return fields[f]; }
+};
+
+// "submit" -> Type::Submit; Unknown for anything else
+Type typeOf(std::string_view name);
+
+// Fast path; false means "use fromJson" (out is then unspecified)
+bool decode(std::string_view text, Request& out);
+
+// Slow path for any parsed message (strings view into j, which must outlive out);
+// false if j is not an object
+bool fromJson(const nlohmann::json& j, Request& out);
+
+} // namespace jreq
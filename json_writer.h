@@ -0,0 +1,155 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <nlohmann/json.hpp>
+
+// Shortest round-trip double text exactly as json::dump() writes it. Uses
+// nlohmann's internal formatter on the 3.x releases it was checked against
+// (3.9 to 3.11); any other version goes through the public dump() instead,
+// slower but still byte-identical. Returns the end of the text.
+inline char* formatJsonDouble(char* first, char* last, double v) {
+#if defined(NLOHMANN_JSON_VERSION_MAJOR) && NLOHMANN_JSON_VERSION_MAJOR == 3 && \
+    NLOHMANN_JSON_VERSION_MINOR >= 9 && NLOHMANN_JSON_VERSION_MINOR <= 11
+    return nlohmann::detail::to_chars(first, last, v);
+#else
+    std::string text = nlohmann::json(v).dump();
+    size_t n = std::min(text.size(), static_cast<size_t>(last - first));
+    std::memcpy(first, text.data(), n);
+    return first + n;
+#endif
+}
+
+// Streams JSON text straight into a reusable buffer, for the fixed shapes the
+// gateway sends on every order, trade and book update.
+//
+// The output is byte for byte what json::dump() gives for the same object:
+// compact, doubles through nlohmann's own formatter (Grisu2, "null" for
+// NaN/inf), the same string escapes. nlohmann objects keep their keys sorted,
+// so callers must write keys in lexicographic (byte) order, e.g. "corr"
+// before "id", "seq" before "status", "trades" before "type". Non-ASCII
+// bytes are copied as they are; nlohmann would reject invalid UTF-8 instead.
+//
+//   JsonWriter w(buffer);
+//   w.beginObject().field("id", id).field("type", "cancel_response").endObject();
+//
+// matchesDump() checks that promise for one written message; the gateway runs
+// it on everything it writes when built with JSON_WRITER_CHECK=1.
+class JsonWriter {
+public:
+    // Appends to out
+    explicit JsonWriter(std::string& out) : m_out(out) {}
+
+    // True if text is exactly what json::dump() gives for the value it encodes
+    // (so keys were written in order and numbers and escapes match)
+    static bool matchesDump(std::string_view text) {
+        nlohmann::json parsed = nlohmann::json::parse(text.begin(), text.end(), nullptr, false);
+        return !parsed.is_discarded() && parsed.dump() == text;
+    }
+
+    JsonWriter& beginObject() { element(); m_out += '{'; m_need_comma = false; return *this; }
+    JsonWriter& endObject() { m_out += '}'; m_need_comma = true; return *this; }
+    JsonWriter& beginArray() { element(); m_out += '['; m_need_comma = false; return *this; }
+    JsonWriter& endArray() { m_out += ']'; m_need_comma = true; return *this; }
+
+    // Object key (plain ASCII, no escaping); the next value or begin* is its value
+    JsonWriter& key(std::string_view name) {
+        if (m_need_comma) m_out += ',';
+        m_out += '"';
+        m_out.append(name.data(), name.size());
+        m_out += "\":";
+        m_after_key = true;
+        return *this;
+    }
+
+    JsonWriter& value(bool v) {
+        element();
+        m_out += v ? "true" : "false";
+        m_need_comma = true;
+        return *this;
+    }
+    template <typename T, typename = std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>>>
+    JsonWriter& value(T v) {
+        element();
+        char text[24];
+        m_out.append(text, static_cast<size_t>(std::to_chars(text, text + sizeof(text), v).ptr - text));
+        m_need_comma = true;
+        return *this;
+    }
+    JsonWriter& value(double v) {
+        element();
+        if (!std::isfinite(v)) {
+            m_out += "null";
+        } else {
+            char text[64];
+            m_out.append(text, static_cast<size_t>(formatJsonDouble(text, text + sizeof(text), v) - text));
+        }
+        m_need_comma = true;
+        return *this;
+    }
+    JsonWriter& value(std::string_view v) {
+        element();
+        m_out += '"';
+        appendEscaped(v);
+        m_out += '"';
+        m_need_comma = true;
+        return *this;
+    }
+    JsonWriter& value(const char* v) { return value(std::string_view(v)); }
+    JsonWriter& value(const std::string& v) { return value(std::string_view(v)); }
+
+    // Text that is already JSON, written as one element. A run of comma-separated
+    // array elements works too (splicing rows into an array).
+    JsonWriter& raw(std::string_view json) {
+        element();
+        m_out.append(json.data(), json.size());
+        m_need_comma = true;
+        return *this;
+    }
+
+    template <typename T>
+    JsonWriter& field(std::string_view name, const T& v) { return key(name).value(v); }
+
+private:
+    // Comma between array elements and object members; none right after a key
+    void element() {
+        if (m_after_key) m_after_key = false;
+        else if (m_need_comma) m_out += ',';
+    }
+
+    void appendEscaped(std::string_view s) {
+        size_t run = 0; // start of the pending run of bytes that need no escape
+        for (size_t i = 0; i < s.size(); ++i) {
+            auto c = static_cast<unsigned char>(s[i]);
+            if (c >= 0x20 && c != '"' && c != '\\') continue;
+            m_out.append(s.data() + run, i - run);
+            run = i + 1;
+            switch (c) {
+            case '"': m_out += "\\\""; break;
+            case '\\': m_out += "\\\\"; break;
+            case '\b': m_out += "\\b"; break;
+            case '\f': m_out += "\\f"; break;
+            case '\n': m_out += "\\n"; break;
+            case '\r': m_out += "\\r"; break;
+            case '\t': m_out += "\\t"; break;
+            default: {
+                static constexpr char kHex[] = "0123456789abcdef";
+                char u[6] = {'\\', 'u', '0', '0', kHex[c >> 4], kHex[c & 0xF]};
+                m_out.append(u, sizeof(u));
+                break;
+            }
+            }
+        }
+        m_out.append(s.data() + run, s.size() - run);
+    }
+
+    std::string& m_out;
+    bool m_need_comma = false;
+    bool m_after_key = false;
+};
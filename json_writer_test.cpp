@@ -0,0 +1,101 @@
+// Checks JsonWriter against json::dump() with the installed nlohmann/json:
+// doubles (the formatter JsonWriter borrows), integers, string escapes,
+// nesting and the sorted-key rule. The gateway's own messages are checked at
+// their call sites by a JSON_WRITER_CHECK=1 build.
+//
+//   make test
+
+#include "json_writer.h"
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <string>
+
+using json = nlohmann::json;
+
+static int g_failures = 0;
+
+static void expect(bool ok, const std::string& what) {
+    if (ok) return;
+    if (++g_failures <= 20) std::fprintf(stderr, "FAIL: %s\n", what.c_str());
+}
+
+template <typename T>
+static void expectScalar(T v) {
+    std::string out;
+    JsonWriter(out).value(v);
+    std::string want = json(v).dump();
+    expect(out == want, "value " + want + " written as " + out);
+}
+
+int main() {
+    std::printf("nlohmann/json %d.%d.%d\n", NLOHMANN_JSON_VERSION_MAJOR, NLOHMANN_JSON_VERSION_MINOR, NLOHMANN_JSON_VERSION_PATCH);
+
+    // Doubles: prices on a tick grid, quantities times prices, raw bit patterns
+    std::mt19937_64 rng(7);
+    for (int i = 0; i < 200000; ++i) {
+        expectScalar((static_cast<int64_t>(rng() % 2000000) - 1000000) * 0.01);
+        expectScalar(static_cast<double>(rng() % 100000) * ((rng() % 100000) * 0.25));
+        uint64_t bits = rng();
+        double d;
+        std::memcpy(&d, &bits, sizeof(d));
+        if (std::isfinite(d)) expectScalar(d);
+    }
+    for (double d : {0.0, -0.0, 1.0, 0.1, 1e-300, 5e-324, 1e21, 1e22, 123456789012345680.0,
+                     std::numeric_limits<double>::max(), std::numeric_limits<double>::min()}) {
+        expectScalar(d);
+    }
+    {
+        std::string out;
+        JsonWriter(out).value(std::numeric_limits<double>::quiet_NaN());
+        expect(out == json(std::numeric_limits<double>::quiet_NaN()).dump(), "NaN written as " + out);
+    }
+
+    // Integers at their limits
+    expectScalar(std::numeric_limits<int64_t>::min());
+    expectScalar(std::numeric_limits<int64_t>::max());
+    expectScalar(std::numeric_limits<uint64_t>::max());
+    expectScalar(uint32_t{0});
+    expectScalar(-1);
+    expectScalar(true);
+    expectScalar(false);
+
+    // Every ASCII byte, escaped or not
+    std::string ascii;
+    for (int c = 1; c < 0x80; ++c) ascii += static_cast<char>(c);
+    expectScalar(ascii);
+    expectScalar(std::string("caf\xc3\xa9 \xe2\x82\xac"));
+    expectScalar(std::string());
+
+    // Nesting, commas and raw splices, keys in order
+    {
+        std::string out;
+        JsonWriter w(out);
+        w.beginObject()
+            .key("asks").beginArray().endArray()
+            .key("bids").beginArray()
+                .beginObject().field("id", 1).field("price", 100.25).field("qty", 5).endObject()
+                .beginObject().field("id", 2).field("price", 100.0).field("qty", 7).endObject()
+            .endArray()
+            .field("corr", 42)
+            .key("rows").beginArray().raw("{\"a\":1},{\"b\":2}").raw("3").endArray()
+            .field("status", "ok")
+            .field("type", "book_snapshot")
+            .endObject();
+        expect(JsonWriter::matchesDump(out), "nested object " + out);
+    }
+
+    // The checker itself: out-of-order keys and padding are caught
+    expect(!JsonWriter::matchesDump("{\"type\":\"x\",\"id\":1}"), "out-of-order keys accepted");
+    expect(!JsonWriter::matchesDump("{\"id\": 1}"), "non-compact text accepted");
+    expect(!JsonWriter::matchesDump("{\"id\":1"), "truncated text accepted");
+    expect(JsonWriter::matchesDump("{\"id\":1,\"type\":\"x\"}"), "sorted keys rejected");
+
+    if (g_failures) {
+        std::fprintf(stderr, "%d mismatches\n", g_failures);
+        return 1;
+    }
+    std::printf("JsonWriter matches json::dump()\n");
+    return 0;
+}
@@ -0,0 +1,604 @@
+// WebSocket load generator for trading_server.
+//
+// Opens many authenticated connections from a few epoll threads and drives
+// order flow through them. Every request carries a unique "corr" (binary: the
+// corr field), so round trips are timed from send to the matching response.
+// Prints a line per second with sustained rates and outstanding requests,
+// then latency percentiles; --json prints the summary as one object.
+//
+//   ./loadgen --connections 2000 --threads 4 --duration 30 --profile mixed
+//   ./loadgen --connections 500 --rate 200 --window 4 --binary --json
+//
+// Profiles: mm (quotes both sides, cancels its oldest quote once it has
+// --quotes resting), taker (crosses the mid), cancel (submit then cancel
+// each order as soon as it is acked), mixed (connections split 50/20/30).
+// Linux only (epoll).
+
+#include "binary_protocol.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+enum class Profile : uint8_t { MarketMaker, Taker, CancelHeavy, Mixed };
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 9001;
+    std::string token = "your_secret_token";
+    std::string symbol;            // empty: primary instrument
+    size_t connections = 100;
+    size_t threads = 2;
+    double duration = 10.0;        // seconds of load after connecting
+    double warmup = 1.0;           // seconds excluded from the latency histogram
+    double rate = 0.0;             // requests per second per connection; 0 = as fast as the window allows
+    uint32_t window = 1;           // max outstanding requests per connection
+    uint32_t quotes = 10;          // mm: resting quotes per connection
+    Profile profile = Profile::Mixed;
+    int64_t mid_ticks = 10000;     // with tick 0.01: 100.00
+    double tick = 0.01;
+    bool binary = false;
+    bool market_data = true;       // false: unsubscribe from the symbol's book and trade feeds
+    bool json = false;
+};
+
+uint64_t nowNs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Log-linear histogram: 16 sub-buckets per power of two (about 6% resolution)
+class Histogram {
+public:
+    static constexpr unsigned kSubBits = 4;
+
+    void record(uint64_t v) {
+        ++m_counts[bucket(v)];
+        ++m_count;
+        m_max = std::max(m_max, v);
+    }
+    void merge(const Histogram& o) {
+        for (size_t i = 0; i < m_counts.size(); ++i) m_counts[i] += o.m_counts[i];
+        m_count += o.m_count;
+        m_max = std::max(m_max, o.m_max);
+    }
+    uint64_t count() const { return m_count; }
+    uint64_t max() const { return m_max; }
+    // Upper bound of the bucket holding the p-th fraction of samples
+    uint64_t percentile(double p) const {
+        if (!m_count) return 0;
+        uint64_t rank = static_cast<uint64_t>(p * static_cast<double>(m_count - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < m_counts.size(); ++i) {
+            seen += m_counts[i];
+            if (seen >= rank) return std::min(upper(i), m_max);
+        }
+        return m_max;
+    }
+
+private:
+    static size_t bucket(uint64_t v) {
+        if (v < (1u << kSubBits)) return static_cast<size_t>(v);
+        unsigned msb = 63 - static_cast<unsigned>(__builtin_clzll(v));
+        unsigned shift = msb - kSubBits;
+        return (static_cast<size_t>(shift + 1) << kSubBits) + ((v >> shift) & ((1u << kSubBits) - 1));
+    }
+    static uint64_t upper(size_t i) {
+        if (i < (1u << kSubBits)) return i;
+        unsigned shift = static_cast<unsigned>(i >> kSubBits) - 1;
+        uint64_t sub = (i & ((1u << kSubBits) - 1)) | (1u << kSubBits);
+        return ((sub + 1) << shift) - 1;
+    }
+
+    std::array<uint64_t, (64 - kSubBits + 1) << kSubBits> m_counts{};
+    uint64_t m_count = 0;
+    uint64_t m_max = 0;
+};
+
+struct Totals {
+    std::atomic<uint64_t> connected{0};
+    std::atomic<uint64_t> failed{0};
+    std::atomic<uint64_t> closed{0};
+    std::atomic<uint64_t> sent{0};
+    std::atomic<uint64_t> acked{0};
+    std::atomic<uint64_t> rejected{0};     // responses with success=false or an error
+    std::atomic<uint64_t> pushes{0};       // market data, executions, PnL and other unsolicited frames
+    std::atomic<uint64_t> outstanding{0};
+};
+
+struct Conn {
+    enum State : uint8_t { Connecting, Upgrading, Authenticating, Running, Closed };
+
+    int fd = -1;
+    State state = Connecting;
+    Profile profile = Profile::MarketMaker;
+    uint32_t index = 0;
+    std::string rx;
+    std::string tx;
+    size_t tx_off = 0;
+    bool want_write = false;
+    uint64_t next_corr = 1;
+    std::vector<uint64_t> sent_at;    // per window slot (corr % window); 0 = free
+    uint32_t outstanding = 0;
+    uint64_t next_send = 0;           // rate-limited mode
+    uint32_t seq = 0;
+    std::deque<uint64_t> resting;     // mm: live quotes, oldest first
+    std::deque<uint64_t> to_cancel;   // cancel: acked orders waiting for their cancel
+};
+
+class Worker {
+public:
+    Worker(const Options& opt, Totals& totals, uint64_t measure_from, uint64_t stop_at)
+        : m_opt(opt), m_totals(totals), m_measure_from(measure_from), m_stop_at(stop_at) {}
+
+    void add(uint32_t index, Profile profile) {
+        auto c = std::make_unique<Conn>();
+        c->index = index;
+        c->profile = profile;
+        c->sent_at.assign(m_opt.window, 0);
+        m_conns.push_back(std::move(c));
+    }
+
+    void run() {
+        m_epoll = epoll_create1(0);
+        for (auto& c : m_conns) open(*c);
+        std::vector<epoll_event> events(1024);
+        while (nowNs() < m_stop_at) {
+            int n = epoll_wait(m_epoll, events.data(), static_cast<int>(events.size()), 1);
+            for (int i = 0; i < n; ++i) {
+                Conn& c = *static_cast<Conn*>(events[i].data.ptr);
+                if (events[i].events & (EPOLLERR | EPOLLHUP)) { close(c, c.state == Conn::Connecting); continue; }
+                if (events[i].events & EPOLLOUT) writable(c);
+                if (events[i].events & EPOLLIN) readable(c);
+            }
+            uint64_t now = nowNs();
+            for (auto& c : m_conns) {
+                if (c->state == Conn::Running) pump(*c, now);
+            }
+        }
+        for (auto& c : m_conns) if (c->fd >= 0) ::close(c->fd);
+        ::close(m_epoll);
+    }
+
+    const Histogram& histogram() const { return m_hist; }
+
+private:
+    void open(Conn& c) {
+        c.fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (c.fd < 0) { m_totals.failed.fetch_add(1); c.state = Conn::Closed; return; }
+        int one = 1;
+        setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(m_opt.port));
+        inet_pton(AF_INET, m_opt.host.c_str(), &addr.sin_addr);
+        if (::connect(c.fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 && errno != EINPROGRESS) {
+            close(c, true);
+            return;
+        }
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT;
+        ev.data.ptr = &c;
+        epoll_ctl(m_epoll, EPOLL_CTL_ADD, c.fd, &ev);
+        c.want_write = true;
+    }
+
+    void close(Conn& c, bool failed) {
+        if (c.state == Conn::Closed) return;
+        if (failed) m_totals.failed.fetch_add(1);
+        else m_totals.closed.fetch_add(1);
+        if (c.state == Conn::Running) m_totals.connected.fetch_sub(1);
+        m_totals.outstanding.fetch_sub(c.outstanding);
+        c.outstanding = 0;
+        c.state = Conn::Closed;
+        if (c.fd >= 0) {
+            epoll_ctl(m_epoll, EPOLL_CTL_DEL, c.fd, nullptr);
+            ::close(c.fd);
+            c.fd = -1;
+        }
+    }
+
+    void setWriteInterest(Conn& c, bool on) {
+        if (c.want_write == on || c.fd < 0) return;
+        c.want_write = on;
+        epoll_event ev{};
+        ev.events = on ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+        ev.data.ptr = &c;
+        epoll_ctl(m_epoll, EPOLL_CTL_MOD, c.fd, &ev);
+    }
+
+    void writable(Conn& c) {
+        if (c.state == Conn::Connecting) {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err) { close(c, true); return; }
+            c.state = Conn::Upgrading;
+            c.tx += "GET / HTTP/1.1\r\nHost: " + m_opt.host + ":" + std::to_string(m_opt.port) +
+                    "\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                    "Sec-WebSocket-Version: 13\r\n\r\n";
+        }
+        flush(c);
+    }
+
+    void flush(Conn& c) {
+        while (c.tx_off < c.tx.size()) {
+            ssize_t n = ::send(c.fd, c.tx.data() + c.tx_off, c.tx.size() - c.tx_off, MSG_NOSIGNAL);
+            if (n > 0) { c.tx_off += static_cast<size_t>(n); continue; }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) { setWriteInterest(c, true); return; }
+            close(c, false);
+            return;
+        }
+        c.tx.clear();
+        c.tx_off = 0;
+        setWriteInterest(c, false);
+    }
+
+    // Client frames are always masked (RFC 6455); the key need not be secret here
+    void sendFrame(Conn& c, std::string_view payload, bool binary) { writeFrame(c, binary ? 0x2 : 0x1, payload); }
+
+    void writeFrame(Conn& c, uint8_t opcode, std::string_view payload) {
+        char header[14];
+        size_t h = 0;
+        header[h++] = static_cast<char>(0x80 | opcode);
+        if (payload.size() < 126) {
+            header[h++] = static_cast<char>(0x80 | payload.size());
+        } else if (payload.size() <= 0xFFFF) {
+            header[h++] = static_cast<char>(0x80 | 126);
+            header[h++] = static_cast<char>(payload.size() >> 8);
+            header[h++] = static_cast<char>(payload.size() & 0xFF);
+        } else {
+            header[h++] = static_cast<char>(0x80 | 127);
+            for (int i = 7; i >= 0; --i) header[h++] = static_cast<char>((static_cast<uint64_t>(payload.size()) >> (8 * i)) & 0xFF);
+        }
+        const uint8_t mask[4] = {0x12, 0x34, 0x56, 0x78};
+        std::memcpy(header + h, mask, 4);
+        h += 4;
+        size_t start = c.tx.size();
+        c.tx.append(header, h);
+        c.tx.append(payload.data(), payload.size());
+        for (size_t i = 0; i < payload.size(); ++i) c.tx[start + h + i] ^= static_cast<char>(mask[i & 3]);
+        if (!c.want_write) flush(c);
+    }
+
+    void readable(Conn& c) {
+        char buf[65536];
+        while (c.fd >= 0) {
+            ssize_t n = ::recv(c.fd, buf, sizeof(buf), 0);
+            if (n > 0) { c.rx.append(buf, static_cast<size_t>(n)); continue; }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            close(c, false);
+            return;
+        }
+        if (c.state == Conn::Upgrading) {
+            size_t end = c.rx.find("\r\n\r\n");
+            if (end == std::string::npos) return;
+            if (c.rx.compare(0, 12, "HTTP/1.1 101") != 0) { close(c, true); return; }
+            c.rx.erase(0, end + 4);
+            c.state = Conn::Authenticating;
+            std::string auth = "{\"type\":\"auth\",\"token\":\"" + m_opt.token + "\"" + (m_opt.binary ? ",\"protocol\":\"binary\"" : "") + "}";
+            sendFrame(c, auth, false);
+        }
+        size_t off = 0;
+        while (c.state != Conn::Closed) {
+            // Server frames are unmasked; uWS does not fragment messages
+            if (c.rx.size() - off < 2) break;
+            const auto* p = reinterpret_cast<const uint8_t*>(c.rx.data() + off);
+            uint8_t opcode = p[0] & 0x0F;
+            uint64_t len = p[1] & 0x7F;
+            size_t h = 2;
+            if (len == 126) {
+                if (c.rx.size() - off < 4) break;
+                len = (static_cast<uint64_t>(p[2]) << 8) | p[3];
+                h = 4;
+            } else if (len == 127) {
+                if (c.rx.size() - off < 10) break;
+                len = 0;
+                for (int i = 0; i < 8; ++i) len = (len << 8) | p[2 + i];
+                h = 10;
+            }
+            if (c.rx.size() - off < h + len) break;
+            std::string_view payload(c.rx.data() + off + h, static_cast<size_t>(len));
+            off += h + static_cast<size_t>(len);
+            if (opcode == 0x8) { close(c, false); return; }
+            if (opcode == 0x9) { writeFrame(c, 0xA, payload); continue; }
+            if (opcode == 0x1 || opcode == 0x2) message(c, payload);
+        }
+        c.rx.erase(0, off);
+    }
+
+    static bool findUnsigned(std::string_view s, std::string_view key, uint64_t& out) {
+        size_t pos = s.find(key);
+        if (pos == std::string_view::npos) return false;
+        pos += key.size();
+        if (pos >= s.size() || s[pos] < '0' || s[pos] > '9') return false;
+        out = 0;
+        while (pos < s.size() && s[pos] >= '0' && s[pos] <= '9') out = out * 10 + static_cast<uint64_t>(s[pos++] - '0');
+        return true;
+    }
+
+    void message(Conn& c, std::string_view msg) {
+        if (c.state == Conn::Authenticating) {
+            if (msg.find("\"auth_response\"") == std::string_view::npos) return; // welcome
+            if (msg.find("\"success\":true") == std::string_view::npos) { close(c, true); return; }
+            c.state = Conn::Running;
+            m_totals.connected.fetch_add(1);
+            if (!m_opt.market_data) {
+                std::string unsub = m_opt.symbol.empty() ? std::string("{\"type\":\"unsubscribe\"}")
+                                                          : "{\"type\":\"unsubscribe\",\"symbol\":\"" + m_opt.symbol + "\"}";
+                sendFrame(c, unsub, false);
+            }
+            return;
+        }
+        uint64_t corr = 0, id = 0;
+        bool success = true, filled = false, is_submit = false;
+        if (bin::isBinaryFrame(msg)) {
+            uint8_t type = bin::frameType(msg);
+            if (type == bin::SubmitAck) {
+                bin::SubmitAckMsg ack;
+                if (!bin::decode(msg, ack) || !(ack.h.flags & bin::kFlagCorr)) { m_totals.pushes.fetch_add(1); return; }
+                corr = ack.corr; id = ack.order_id; success = ack.success; is_submit = true;
+                filled = ack.status == 1;
+            } else if (type == bin::CancelAck || type == bin::ModifyAck) {
+                bin::OrderAckMsg ack;
+                if (!bin::decode(msg, ack) || !(ack.h.flags & bin::kFlagCorr)) { m_totals.pushes.fetch_add(1); return; }
+                corr = ack.corr; success = ack.success;
+            } else if (type == bin::Error) {
+                bin::ErrorMsg err;
+                if (!bin::decode(msg, err) || !(err.h.flags & bin::kFlagCorr)) { m_totals.pushes.fetch_add(1); return; }
+                corr = err.corr; success = false;
+            } else {
+                m_totals.pushes.fetch_add(1);
+                return;
+            }
+        } else {
+            if (!findUnsigned(msg, "\"corr\":", corr)) { m_totals.pushes.fetch_add(1); return; }
+            success = msg.find("\"success\":false") == std::string_view::npos && msg.find("\"type\":\"error\"") == std::string_view::npos;
+            is_submit = msg.find("\"submit_response\"") != std::string_view::npos;
+            if (is_submit) {
+                findUnsigned(msg, "\"id\":", id);
+                uint64_t status = 0;
+                filled = findUnsigned(msg, "\"status\":", status) && status == 1;
+            }
+        }
+        complete(c, corr, success);
+        if (is_submit && success && id && !filled) {
+            if (c.profile == Profile::MarketMaker) c.resting.push_back(id);
+            else if (c.profile == Profile::CancelHeavy) c.to_cancel.push_back(id);
+        }
+        pump(c, nowNs());
+    }
+
+    void complete(Conn& c, uint64_t corr, bool success) {
+        if (corr == 0 || corr >= c.next_corr) return;
+        uint64_t& sent = c.sent_at[corr % m_opt.window];
+        if (!sent) return;
+        uint64_t now = nowNs();
+        if (sent >= m_measure_from) m_hist.record(now - sent);
+        sent = 0;
+        --c.outstanding;
+        m_totals.outstanding.fetch_sub(1, std::memory_order_relaxed);
+        m_totals.acked.fetch_add(1, std::memory_order_relaxed);
+        if (!success) m_totals.rejected.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void pump(Conn& c, uint64_t now) {
+        while (c.state == Conn::Running && c.outstanding < m_opt.window && !c.want_write) {
+            if (m_opt.rate > 0) {
+                if (now < c.next_send) return;
+                uint64_t interval = static_cast<uint64_t>(1e9 / m_opt.rate);
+                c.next_send = std::max(c.next_send + interval, now - 10 * interval); // bounded catch-up
+            }
+            uint64_t corr = c.next_corr++;
+            if (c.sent_at[corr % m_opt.window]) return; // slot still held by a lost reply; wait
+            request(c, corr);
+            c.sent_at[corr % m_opt.window] = nowNs();
+            ++c.outstanding;
+            m_totals.outstanding.fetch_add(1, std::memory_order_relaxed);
+            m_totals.sent.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    void request(Conn& c, uint64_t corr) {
+        ++c.seq;
+        switch (c.profile) {
+        case Profile::MarketMaker:
+            if (c.resting.size() >= m_opt.quotes) {
+                uint64_t id = c.resting.front();
+                c.resting.pop_front();
+                sendCancel(c, id, corr);
+                return;
+            }
+            {
+                bool is_buy = c.seq & 1;
+                int64_t off = 1 + static_cast<int64_t>((c.seq / 2) % 5);
+                sendSubmit(c, is_buy ? m_opt.mid_ticks - off : m_opt.mid_ticks + off, 1 + c.seq % 10, is_buy, corr);
+            }
+            return;
+        case Profile::Taker: {
+            bool is_buy = c.seq & 1;
+            sendSubmit(c, is_buy ? m_opt.mid_ticks + 2 : m_opt.mid_ticks - 2, 1, is_buy, corr);
+            return;
+        }
+        case Profile::CancelHeavy:
+        case Profile::Mixed:
+            if (!c.to_cancel.empty()) {
+                uint64_t id = c.to_cancel.front();
+                c.to_cancel.pop_front();
+                sendCancel(c, id, corr);
+                return;
+            }
+            {
+                bool is_buy = c.seq & 1;
+                sendSubmit(c, is_buy ? m_opt.mid_ticks - 20 : m_opt.mid_ticks + 20, 5, is_buy, corr);
+            }
+            return;
+        }
+    }
+
+    void sendSubmit(Conn& c, int64_t ticks, uint32_t qty, bool is_buy, uint64_t corr) {
+        double price = static_cast<double>(ticks) * m_opt.tick;
+        if (m_opt.binary) {
+            auto msg = bin::make<bin::SubmitMsg>(bin::Submit, true);
+            msg.qty = qty;
+            msg.corr = corr;
+            msg.price = price;
+            msg.is_buy = is_buy;
+            msg.instrument = m_instrument;
+            sendFrame(c, bin::view(msg), true);
+            return;
+        }
+        char buf[256];
+        int n = std::snprintf(buf, sizeof(buf), "{\"type\":\"submit\",\"price\":%.8g,\"qty\":%u,\"is_buy\":%s,\"corr\":%llu%s%s%s}",
+                              price, qty, is_buy ? "true" : "false", static_cast<unsigned long long>(corr),
+                              m_opt.symbol.empty() ? "" : ",\"symbol\":\"", m_opt.symbol.c_str(), m_opt.symbol.empty() ? "" : "\"");
+        sendFrame(c, std::string_view(buf, static_cast<size_t>(n)), false);
+    }
+
+    void sendCancel(Conn& c, uint64_t id, uint64_t corr) {
+        if (m_opt.binary) {
+            auto msg = bin::make<bin::CancelMsg>(bin::Cancel, true);
+            msg.corr = corr;
+            msg.order_id = id;
+            sendFrame(c, bin::view(msg), true);
+            return;
+        }
+        char buf[128];
+        int n = std::snprintf(buf, sizeof(buf), "{\"type\":\"cancel\",\"id\":%llu,\"corr\":%llu}",
+                              static_cast<unsigned long long>(id), static_cast<unsigned long long>(corr));
+        sendFrame(c, std::string_view(buf, static_cast<size_t>(n)), false);
+    }
+
+    const Options& m_opt;
+    Totals& m_totals;
+    uint64_t m_measure_from;
+    uint64_t m_stop_at;
+    uint16_t m_instrument = 0;   // binary submits go to the primary instrument
+    int m_epoll = -1;
+    std::vector<std::unique_ptr<Conn>> m_conns;
+    Histogram m_hist;
+};
+
+Profile profileOf(const Options& opt, uint32_t index) {
+    if (opt.profile != Profile::Mixed) return opt.profile;
+    uint32_t slot = index % 10;
+    return slot < 5 ? Profile::MarketMaker : slot < 7 ? Profile::Taker : Profile::CancelHeavy;
+}
+
+void usage() {
+    std::fprintf(stderr,
+        "usage: loadgen [--host IP] [--port N] [--token T] [--symbol SYM] [--connections N] [--threads N]\n"
+        "               [--duration SEC] [--warmup SEC] [--rate REQ_PER_SEC_PER_CONN] [--window N]\n"
+        "               [--profile mm|taker|cancel|mixed] [--quotes N] [--mid PRICE] [--tick SIZE]\n"
+        "               [--binary] [--no-market-data] [--json]\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opt;
+    double mid = 100.0;
+    for (int i = 1; i < argc; ++i) {
+        auto arg = [&](const char* name) { return std::strcmp(argv[i], name) == 0 && i + 1 < argc; };
+        if (arg("--host")) opt.host = argv[++i];
+        else if (arg("--port")) opt.port = std::atoi(argv[++i]);
+        else if (arg("--token")) opt.token = argv[++i];
+        else if (arg("--symbol")) opt.symbol = argv[++i];
+        else if (arg("--connections")) opt.connections = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg("--threads")) opt.threads = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg("--duration")) opt.duration = std::atof(argv[++i]);
+        else if (arg("--warmup")) opt.warmup = std::atof(argv[++i]);
+        else if (arg("--rate")) opt.rate = std::atof(argv[++i]);
+        else if (arg("--window")) opt.window = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg("--quotes")) opt.quotes = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg("--mid")) mid = std::atof(argv[++i]);
+        else if (arg("--tick")) opt.tick = std::atof(argv[++i]);
+        else if (arg("--profile")) {
+            std::string p = argv[++i];
+            if (p == "mm") opt.profile = Profile::MarketMaker;
+            else if (p == "taker") opt.profile = Profile::Taker;
+            else if (p == "cancel") opt.profile = Profile::CancelHeavy;
+            else if (p == "mixed") opt.profile = Profile::Mixed;
+            else { usage(); return 2; }
+        }
+        else if (std::strcmp(argv[i], "--binary") == 0) opt.binary = true;
+        else if (std::strcmp(argv[i], "--no-market-data") == 0) opt.market_data = false;
+        else if (std::strcmp(argv[i], "--json") == 0) opt.json = true;
+        else { usage(); return 2; }
+    }
+    if (opt.connections == 0 || opt.threads == 0 || opt.window == 0 || opt.tick <= 0 || opt.duration <= 0) { usage(); return 2; }
+    if (opt.binary && !opt.symbol.empty()) std::fprintf(stderr, "note: binary submits go to instrument index 0; --symbol only affects market data\n");
+    opt.mid_ticks = static_cast<int64_t>(mid / opt.tick + 0.5);
+    opt.threads = std::min(opt.threads, opt.connections);
+
+    Totals totals;
+    uint64_t start = nowNs();
+    uint64_t measure_from = start + static_cast<uint64_t>(opt.warmup * 1e9);
+    uint64_t stop_at = measure_from + static_cast<uint64_t>(opt.duration * 1e9);
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (size_t t = 0; t < opt.threads; ++t) workers.push_back(std::make_unique<Worker>(opt, totals, measure_from, stop_at));
+    for (uint32_t i = 0; i < opt.connections; ++i) workers[i % opt.threads]->add(i, profileOf(opt, i));
+    std::vector<std::thread> threads;
+    for (auto& w : workers) threads.emplace_back([&w]() { w->run(); });
+
+    // Per-second progress on stderr
+    uint64_t last_sent = 0, last_acked = 0, last_pushes = 0, acked_at_measure = 0;
+    for (int sec = 1; nowNs() < stop_at; ++sec) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        uint64_t sent = totals.sent.load(), acked = totals.acked.load(), pushes = totals.pushes.load();
+        if (nowNs() < measure_from) acked_at_measure = acked;
+        std::fprintf(stderr, "t=%ds conns=%llu sent/s=%llu acked/s=%llu pushes/s=%llu outstanding=%llu failed=%llu closed=%llu\n", sec,
+                     static_cast<unsigned long long>(totals.connected.load()), static_cast<unsigned long long>(sent - last_sent),
+                     static_cast<unsigned long long>(acked - last_acked), static_cast<unsigned long long>(pushes - last_pushes),
+                     static_cast<unsigned long long>(totals.outstanding.load()), static_cast<unsigned long long>(totals.failed.load()),
+                     static_cast<unsigned long long>(totals.closed.load()));
+        last_sent = sent;
+        last_acked = acked;
+        last_pushes = pushes;
+    }
+    for (auto& t : threads) t.join();
+
+    Histogram hist;
+    for (auto& w : workers) hist.merge(w->histogram());
+    double secs = opt.duration;
+    double ack_rate = static_cast<double>(totals.acked.load() - acked_at_measure) / secs;
+    auto us = [](uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+    if (opt.json) {
+        std::printf("{\"connections\":%zu,\"connected\":%llu,\"failed\":%llu,\"duration_s\":%.1f,\"sent\":%llu,\"acked\":%llu,"
+                    "\"rejected\":%llu,\"pushes\":%llu,\"acks_per_sec\":%.0f,\"rtt_us\":{\"samples\":%llu,\"p50\":%.1f,\"p90\":%.1f,"
+                    "\"p99\":%.1f,\"p999\":%.1f,\"max\":%.1f}}\n",
+                    opt.connections, static_cast<unsigned long long>(totals.connected.load()), static_cast<unsigned long long>(totals.failed.load()),
+                    secs, static_cast<unsigned long long>(totals.sent.load()), static_cast<unsigned long long>(totals.acked.load()),
+                    static_cast<unsigned long long>(totals.rejected.load()), static_cast<unsigned long long>(totals.pushes.load()), ack_rate,
+                    static_cast<unsigned long long>(hist.count()), us(hist.percentile(0.50)), us(hist.percentile(0.90)),
+                    us(hist.percentile(0.99)), us(hist.percentile(0.999)), us(hist.max()));
+        return 0;
+    }
+    std::printf("connections=%zu connected=%llu failed=%llu duration=%.1fs\n", opt.connections,
+                static_cast<unsigned long long>(totals.connected.load()), static_cast<unsigned long long>(totals.failed.load()), secs);
+    std::printf("sent=%llu acked=%llu rejected=%llu pushes=%llu acks/s=%.0f\n", static_cast<unsigned long long>(totals.sent.load()),
+                static_cast<unsigned long long>(totals.acked.load()), static_cast<unsigned long long>(totals.rejected.load()),
+                static_cast<unsigned long long>(totals.pushes.load()), ack_rate);
+    std::printf("rtt_us samples=%llu p50=%.1f p90=%.1f p99=%.1f p99.9=%.1f max=%.1f\n", static_cast<unsigned long long>(hist.count()),
+                us(hist.percentile(0.50)), us(hist.percentile(0.90)), us(hist.percentile(0.99)), us(hist.percentile(0.999)), us(hist.max()));
+    return 0;
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// Bounded lock-free rings used to hand work between threads without mutexes.
+// Capacity is fixed at construction and rounded up to a power of two. T must
+// be movable (and default constructible for MpscRing); slots are reused, so
+// popped values are moved out.
+
+inline size_t ringCapacity(size_t requested) {
+    size_t cap = 2;
+    while (cap < requested) cap <<= 1;
+    return cap;
+}
+
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// Single producer, single consumer. Slots are constructed on first use, so a
+// large ring that is never filled costs address space rather than memory.
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity)
+        : m_capacity(ringCapacity(capacity)),
+          m_slots(static_cast<T*>(::operator new(m_capacity * sizeof(T), std::align_val_t(alignof(T))))) {}
+    ~SpscRing() {
+        size_t constructed = std::min(m_tail.load(std::memory_order_relaxed), m_capacity);
+        for (size_t i = 0; i < constructed; ++i) m_slots[i].~T();
+        ::operator delete(m_slots, std::align_val_t(alignof(T)));
+    }
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    bool tryPush(T&& value) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head_cache == m_capacity) {
+            m_head_cache = m_head.load(std::memory_order_acquire);
+            if (tail - m_head_cache == m_capacity) return false;
+        }
+        if (tail < m_capacity) new (&m_slots[tail]) T(std::move(value)); // first lap
+        else m_slots[tail & (m_capacity - 1)] = std::move(value);
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(T& out) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail_cache) {
+            m_tail_cache = m_tail.load(std::memory_order_acquire);
+            if (head == m_tail_cache) return false;
+        }
+        out = std::move(m_slots[head & (m_capacity - 1)]);
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+    size_t capacity() const { return m_capacity; }
+
+private:
+    const size_t m_capacity;
+    T* const m_slots;
+    alignas(64) std::atomic<size_t> m_tail{0};
+    size_t m_head_cache = 0;    // producer's view of m_head
+    alignas(64) std::atomic<size_t> m_head{0};
+    size_t m_tail_cache = 0;    // consumer's view of m_tail
+};
+
+// Multiple producers, single consumer (bounded, per-slot sequence numbers).
+template <typename T>
+class MpscRing {
+    struct Slot {
+        std::atomic<size_t> seq;
+        T value;
+    };
+
+public:
+    explicit MpscRing(size_t capacity) : m_capacity(ringCapacity(capacity)), m_slots(new Slot[m_capacity]) {
+        for (size_t i = 0; i < m_capacity; ++i) m_slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+    MpscRing(const MpscRing&) = delete;
+    MpscRing& operator=(const MpscRing&) = delete;
+
+    bool tryPush(T&& value) {
+        size_t pos = m_tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = m_slots[pos & (m_capacity - 1)];
+            size_t seq = slot.seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.value = std::move(value);
+                    slot.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(T& out) {
+        Slot& slot = m_slots[m_head & (m_capacity - 1)];
+        if (slot.seq.load(std::memory_order_acquire) != m_head + 1) return false;
+        out = std::move(slot.value);
+        slot.seq.store(m_head + m_capacity, std::memory_order_release);
+        ++m_head;
+        return true;
+    }
+
+    bool empty() const {
+        return m_slots[m_head & (m_capacity - 1)].seq.load(std::memory_order_acquire) != m_head + 1;
+    }
+    size_t capacity() const { return m_capacity; }
+
+private:
+    const size_t m_capacity;
+    std::unique_ptr<Slot[]> m_slots;
+    alignas(64) std::atomic<size_t> m_tail{0};
+    alignas(64) size_t m_head = 0;
+};
@@ -0,0 +1,316 @@
+#include "log.h"
+#include "engine_clock.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace logging {
+
+namespace {
+
+// Record layout in a ring: RecordHeader, then per argument a tag byte and its
+// payload (8 bytes, or a u32 length and the characters for strings), padded
+// to a multiple of 8. Padding up to the ring's end can be as short as 8 bytes,
+// so it is marked by its first 8 bytes alone (thread == kPadding).
+struct RecordHeader {
+    uint32_t size;          // whole record including this header
+    uint32_t thread;        // registration order of the writing thread
+    const Site* site;
+    uint64_t timestamp;     // engine_clock ns
+};
+constexpr uint32_t kPadding = UINT32_MAX;
+
+constexpr size_t kRingBytes = size_t{4} << 20;
+constexpr size_t kMaxRecord = kRingBytes / 4;
+
+// Single producer (the owning thread), single consumer (the writer)
+struct Ring {
+    explicit Ring(uint32_t id) : id(id), data(new uint8_t[kRingBytes]) {}
+
+    const uint32_t id;
+    std::unique_ptr<uint8_t[]> data;
+    alignas(64) std::atomic<uint64_t> head{0};   // bytes written, producer only
+    uint64_t cached_tail = 0;
+    alignas(64) std::atomic<uint64_t> tail{0};   // bytes consumed, consumer only
+};
+
+std::mutex g_rings_mutex;
+std::vector<std::unique_ptr<Ring>>& rings() {
+    static std::vector<std::unique_ptr<Ring>> all;
+    return all;
+}
+
+Ring& localRing() {
+    thread_local Ring* ring = nullptr;
+    if (!ring) {
+        std::lock_guard<std::mutex> lk(g_rings_mutex);
+        rings().push_back(std::make_unique<Ring>(static_cast<uint32_t>(rings().size())));
+        ring = rings().back().get();
+    }
+    return *ring;
+}
+
+std::atomic<uint64_t> g_dropped{0};
+
+// Writer state; flush() and the writer thread serialize on g_write_mutex
+std::mutex g_write_mutex;
+FILE* g_out = stderr;
+uint64_t g_reported_drops = 0;
+std::string g_buffer;
+
+std::mutex g_thread_mutex;
+std::condition_variable g_wake;
+std::thread g_writer;
+bool g_running = false;
+
+// UTC, microseconds: 2024-01-02T03:04:05.123456Z. The date part is reformatted once per second.
+void appendTime(std::string& out, uint64_t ns) {
+    static time_t cached_secs = -1;
+    static char date[32];
+    static size_t date_len = 0;
+    time_t secs = static_cast<time_t>(ns / 1000000000ull);
+    if (secs != cached_secs) {
+        tm parts;
+        gmtime_r(&secs, &parts);
+        date_len = std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S.", &parts);
+        cached_secs = secs;
+    }
+    out.append(date, date_len);
+    char micros[8];
+    uint32_t us = static_cast<uint32_t>(ns % 1000000000ull / 1000);
+    for (int i = 5; i >= 0; --i, us /= 10) micros[i] = static_cast<char>('0' + us % 10);
+    micros[6] = 'Z';
+    out.append(micros, 7);
+}
+
+// Append one argument's text; returns the bytes it occupied in the record
+size_t appendArg(std::string& out, const uint8_t* p) {
+    char text[32];
+    char* end = text;
+    uint64_t raw = 0;
+    auto tag = static_cast<detail::Tag>(p[0]);
+    if (tag == detail::TagString) {
+        uint32_t len = 0;
+        std::memcpy(&len, p + 1, sizeof(len));
+        out.append(reinterpret_cast<const char*>(p + 5), len);
+        return 5 + len;
+    }
+    std::memcpy(&raw, p + 1, sizeof(raw));
+    switch (tag) {
+    case detail::TagInt: end = std::to_chars(text, text + sizeof(text), static_cast<int64_t>(raw)).ptr; break;
+    case detail::TagUint: end = std::to_chars(text, text + sizeof(text), raw).ptr; break;
+    case detail::TagDouble: {
+        double d;
+        std::memcpy(&d, &raw, sizeof(d));
+        end = std::to_chars(text, text + sizeof(text), d).ptr; // shortest text that reads back exactly
+        break;
+    }
+    case detail::TagBool: out += raw ? "true" : "false"; break;
+    case detail::TagChar: out += static_cast<char>(raw); break;
+    case detail::TagString: break;
+    }
+    out.append(text, static_cast<size_t>(end - text));
+    return 9;
+}
+
+void format(std::string& out, const RecordHeader& h, const uint8_t* args, const uint8_t* end) {
+    appendTime(out, h.timestamp);
+    out += ' ';
+    out += levelName(h.site->level);
+    out += " [";
+    char thread[12];
+    out.append(thread, static_cast<size_t>(std::to_chars(thread, thread + sizeof(thread), h.thread).ptr - thread));
+    out += "] ";
+    for (const char* f = h.site->format; *f; ++f) {
+        if (f[0] == '{' && f[1] == '}' && args < end) {
+            args += appendArg(out, args);
+            ++f;
+        } else {
+            out += *f;
+        }
+    }
+    out += '\n';
+}
+
+// Drain every ring up to its current head, oldest record first; returns the records
+// written. Caller holds g_write_mutex.
+size_t drain() {
+    std::vector<Ring*> sources;
+    std::vector<uint64_t> limits;
+    {
+        std::lock_guard<std::mutex> lk(g_rings_mutex);
+        for (auto& r : rings()) {
+            sources.push_back(r.get());
+            limits.push_back(r->head.load(std::memory_order_acquire));
+        }
+    }
+    std::vector<uint64_t> pos(sources.size());
+    for (size_t i = 0; i < sources.size(); ++i) pos[i] = sources[i]->tail.load(std::memory_order_relaxed);
+
+    auto peek = [&](size_t i) -> const RecordHeader* {
+        while (pos[i] < limits[i]) {
+            const auto* h = reinterpret_cast<const RecordHeader*>(sources[i]->data.get() + (pos[i] & (kRingBytes - 1)));
+            if (h->thread != kPadding) return h;
+            pos[i] += h->size;
+        }
+        return nullptr;
+    };
+    size_t written = 0;
+    while (true) {
+        size_t best = sources.size();
+        const RecordHeader* best_h = nullptr;
+        for (size_t i = 0; i < sources.size(); ++i) {
+            const RecordHeader* h = peek(i);
+            if (h && (!best_h || h->timestamp < best_h->timestamp)) { best = i; best_h = h; }
+        }
+        if (!best_h) break;
+        const auto* body = reinterpret_cast<const uint8_t*>(best_h + 1);
+        format(g_buffer, *best_h, body, reinterpret_cast<const uint8_t*>(best_h) + best_h->size);
+        pos[best] += best_h->size;
+        ++written;
+    }
+    for (size_t i = 0; i < sources.size(); ++i) sources[i]->tail.store(pos[i], std::memory_order_release);
+
+    uint64_t drops = g_dropped.load(std::memory_order_relaxed);
+    if (drops != g_reported_drops) {
+        g_buffer += "logging: " + std::to_string(drops - g_reported_drops) + " records dropped (ring full)\n";
+        g_reported_drops = drops;
+    }
+    if (!g_buffer.empty()) {
+        std::fwrite(g_buffer.data(), 1, g_buffer.size(), g_out);
+        std::fflush(g_out);
+        g_buffer.clear();
+    }
+    return written;
+}
+
+void writerLoop() {
+    std::unique_lock<std::mutex> lk(g_thread_mutex);
+    size_t written = 0;
+    while (g_running) {
+        // Keep going while records arrive; sleep once the rings run dry
+        if (!written) g_wake.wait_for(lk, std::chrono::milliseconds(5));
+        lk.unlock();
+        {
+            std::lock_guard<std::mutex> wl(g_write_mutex);
+            written = drain();
+        }
+        lk.lock();
+    }
+}
+
+} // namespace
+
+const char* levelName(Level level) {
+    switch (level) {
+    case Debug: return "DEBUG";
+    case Info: return "INFO ";
+    case Warn: return "WARN ";
+    case Error: return "ERROR";
+    }
+    return "?";
+}
+
+bool parseLevel(const char* name, Level& level) {
+    static const char* const names[] = {"debug", "info", "warn", "error"};
+    for (uint8_t i = 0; i < 4; ++i) {
+        if (std::strcmp(name, names[i]) == 0) {
+            level = static_cast<Level>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+void start(FILE* out) {
+    std::lock_guard<std::mutex> lk(g_thread_mutex);
+    if (g_running) return;
+    {
+        std::lock_guard<std::mutex> wl(g_write_mutex);
+        g_out = out ? out : stderr;
+    }
+    g_running = true;
+    g_writer = std::thread(writerLoop);
+}
+
+void stop() {
+    {
+        std::lock_guard<std::mutex> lk(g_thread_mutex);
+        if (!g_running) return;
+        g_running = false;
+    }
+    g_wake.notify_one();
+    g_writer.join();
+    flush();
+}
+
+void flush() {
+    std::lock_guard<std::mutex> wl(g_write_mutex);
+    drain();
+}
+
+uint64_t dropped() { return g_dropped.load(std::memory_order_relaxed); }
+
+namespace detail {
+
+void write(const Site* site, const Arg* args, size_t count) {
+    size_t size = sizeof(RecordHeader);
+    for (size_t i = 0; i < count; ++i) {
+        size += args[i].tag == TagString ? 5 + std::min(args[i].s.size(), kMaxString) : 9;
+    }
+    size = (size + 7) & ~size_t{7};
+    if (size > kMaxRecord) {
+        g_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Ring& ring = localRing();
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    size_t offset = head & (kRingBytes - 1);
+    size_t pad = offset + size > kRingBytes ? kRingBytes - offset : 0;
+    if (head + pad + size - ring.cached_tail > kRingBytes) {
+        ring.cached_tail = ring.tail.load(std::memory_order_acquire);
+        if (head + pad + size - ring.cached_tail > kRingBytes) {
+            g_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+    if (pad) {
+        auto* filler = reinterpret_cast<RecordHeader*>(ring.data.get() + offset);
+        filler->size = static_cast<uint32_t>(pad);
+        filler->thread = kPadding;
+        head += pad;
+        offset = 0;
+    }
+
+    uint8_t* p = ring.data.get() + offset;
+    auto* h = reinterpret_cast<RecordHeader*>(p);
+    h->size = static_cast<uint32_t>(size);
+    h->thread = ring.id;
+    h->site = site;
+    h->timestamp = engine_clock::nowNs();
+    p += sizeof(RecordHeader);
+    for (size_t i = 0; i < count; ++i) {
+        *p++ = args[i].tag;
+        if (args[i].tag == TagString) {
+            uint32_t len = static_cast<uint32_t>(std::min(args[i].s.size(), kMaxString));
+            std::memcpy(p, &len, sizeof(len));
+            std::memcpy(p + 4, args[i].s.data(), len);
+            p += 4 + len;
+        } else {
+            std::memcpy(p, &args[i].u, sizeof(uint64_t));
+            p += 8;
+        }
+    }
+    ring.head.store(head + size, std::memory_order_release);
+}
+
+} // namespace detail
+
+} // namespace logging
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Asynchronous logger for the server.
+//
+// A log call on the hot path checks the runtime level, then copies a compact
+// binary record into a lock-free ring owned by the calling thread: a pointer
+// to the call site's static format string, an engine_clock timestamp and the
+// raw arguments. Nothing is formatted and no lock or syscall is taken. A
+// background thread drains all threads' rings in batches, merged by
+// timestamp within a batch, formats the records ("{}" placeholders) and
+// writes each batch with a single write.
+//
+// When a ring is full the record is dropped and counted; the writer reports
+// the count instead of blocking the caller. Records are lost only if the
+// process dies without calling stop() or flush().
+//
+//   LOG_INFO("Recovered {}: {} resting orders", symbol, count);
+//
+// Levels below LOG_MIN_LEVEL (compile time, default 0 = keep everything)
+// generate no code at all; setLevel() filters the rest at run time.
+
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
+
+namespace logging {
+
+enum Level : uint8_t { Debug, Info, Warn, Error };
+
+const char* levelName(Level level);
+// "debug", "info", "warn" or "error"; false if the name is unknown
+bool parseLevel(const char* name, Level& level);
+
+inline std::atomic<uint8_t>& levelFlag() {
+    static std::atomic<uint8_t> level{Info};
+    return level;
+}
+inline void setLevel(Level level) { levelFlag().store(level, std::memory_order_relaxed); }
+inline bool enabled(Level level) { return level >= levelFlag().load(std::memory_order_relaxed); }
+
+// Static description of one log statement; its address identifies the format
+struct Site {
+    Level level;
+    const char* format;
+};
+
+// Start the writer thread; records logged before this wait in their rings
+void start(FILE* out = stderr);
+// Write everything logged so far, then stop the writer thread
+void stop();
+// Write everything logged so far from the calling thread (for exits that skip stop())
+void flush();
+// Records dropped because a ring was full
+uint64_t dropped();
+
+namespace detail {
+
+enum Tag : uint8_t { TagInt, TagUint, TagDouble, TagBool, TagChar, TagString };
+
+// Strings longer than this are cut (request payloads can be large)
+constexpr size_t kMaxString = 1024;
+
+struct Arg {
+    Tag tag;
+    union {
+        int64_t i;
+        uint64_t u;
+        double d;
+    };
+    std::string_view s;
+};
+
+inline Arg toArg(bool v) { Arg a{TagBool, {}, {}}; a.u = v; return a; }
+inline Arg toArg(char v) { Arg a{TagChar, {}, {}}; a.u = static_cast<unsigned char>(v); return a; }
+inline Arg toArg(const char* v) { Arg a{TagString, {}, {}}; a.s = v ? std::string_view(v) : std::string_view("(null)"); return a; }
+inline Arg toArg(std::string_view v) { Arg a{TagString, {}, {}}; a.s = v; return a; }
+inline Arg toArg(const std::string& v) { return toArg(std::string_view(v)); }
+// Any other number; anything that is not a number, bool, char or string does not compile
+template <typename T, typename = std::enable_if_t<std::is_arithmetic_v<T>>>
+Arg toArg(T v) {
+    Arg a{TagInt, {}, {}};
+    if constexpr (std::is_floating_point_v<T>) {
+        a.tag = TagDouble;
+        a.d = static_cast<double>(v);
+    } else if constexpr (std::is_signed_v<T>) {
+        a.i = static_cast<int64_t>(v);
+    } else {
+        a.tag = TagUint;
+        a.u = static_cast<uint64_t>(v);
+    }
+    return a;
+}
+
+// Encode and enqueue one record on the calling thread's ring
+void write(const Site* site, const Arg* args, size_t count);
+
+} // namespace detail
+
+template <typename... Args>
+void write(const Site* site, const Args&... args) {
+    if constexpr (sizeof...(Args) == 0) {
+        detail::write(site, nullptr, 0);
+    } else {
+        const detail::Arg encoded[] = {detail::toArg(args)...};
+        detail::write(site, encoded, sizeof...(Args));
+    }
+}
+
+} // namespace logging
+
+#define LOG_AT(level, format, ...)                                                   \
+    do {                                                                             \
+        if constexpr (static_cast<int>(level) >= LOG_MIN_LEVEL) {                   \
+            if (::logging::enabled(level)) {                                         \
+                static constexpr ::logging::Site log_site_{level, format};           \
+                ::logging::write(&log_site_, ##__VA_ARGS__);                         \
+            }                                                                        \
+        }                                                                            \
+    } while (0)
+
+#define LOG_DEBUG(format, ...) LOG_AT(::logging::Debug, format, ##__VA_ARGS__)
+#define LOG_INFO(format, ...) LOG_AT(::logging::Info, format, ##__VA_ARGS__)
+#define LOG_WARN(format, ...) LOG_AT(::logging::Warn, format, ##__VA_ARGS__)
+#define LOG_ERROR(format, ...) LOG_AT(::logging::Error, format, ##__VA_ARGS__)
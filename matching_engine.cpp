@@ -0,0 +1,552 @@
+#include "matching_engine.h"
+#include "metrics.h"
+#include "engine_clock.h"
+#include "log.h"
+#include <chrono>
+#include <algorithm>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+MatchingEngine::MatchingEngine(OrderBook& book, size_t queue_depth)
+    : m_book(book), m_queue_depth(ringCapacity(queue_depth)), m_commands(m_queue_depth) {
+    m_pending_trades.reserve(256);
+    m_book.onMatchBatch = [this](const Trade* trades, size_t count) {
+        m_pending_trades.insert(m_pending_trades.end(), trades, trades + count);
+    };
+    m_book.track_level_changes = true;
+}
+
+MatchingEngine::~MatchingEngine() {
+    stop();
+    m_book.onMatchBatch = nullptr;
+    m_book.track_level_changes = false;
+}
+
+void MatchingEngine::start(int cpu, size_t consumers) {
+    if (m_threaded) return;
+    m_own_thread = std::make_unique<EngineThread>();
+    attach(*m_own_thread, consumers);
+    m_own_thread->start(cpu);
+}
+
+void MatchingEngine::attach(EngineThread& thread, size_t consumers) {
+    if (m_threaded) return;
+    m_events.resize(std::max<size_t>(consumers, 1));
+    for (auto& ring : m_events) if (!ring) ring = std::make_unique<SpscRing<EngineEvent>>(m_queue_depth);
+    m_book.single_writer = true;
+    m_threaded = true;
+    m_runner = &thread;
+    thread.m_engines.push_back(this);
+}
+
+void MatchingEngine::stop() {
+    if (m_threaded) {
+        m_runner->stop();
+        // A shared thread may have stopped for another engine before our last commands arrived
+        while (drain(SIZE_MAX)) {}
+        if (onEventsReady) onEventsReady();
+        auto& engines = m_runner->m_engines;
+        engines.erase(std::remove(engines.begin(), engines.end(), this), engines.end());
+        m_runner = nullptr;
+        m_own_thread.reset();
+        m_threaded = false;
+        m_book.single_writer = false;
+    }
+    checkpoint(true);
+}
+
+bool MatchingEngine::openJournal(const JournalConfig& config, const std::string& name) {
+    if (m_journal || m_threaded) return false;
+    auto journal = std::make_unique<Journal>(config, name);
+    SnapshotImage image;
+    SnapshotStatus snapshot = journal->loadSnapshot(image);
+    if (snapshot == SnapshotStatus::Corrupt) return false;
+    if (snapshot == SnapshotStatus::Loaded) restore(image);
+    // Trades regenerated by the replay keep their original sequence numbers
+    m_book.trade_log.beginReplay(image.trade_seq);
+    m_recovered = 0;
+    uint64_t last = 0;
+    bool contiguous = journal->replay(image.lsn, last, [this](const WalRecord& rec) {
+        replay(rec);
+        ++m_recovered;
+    });
+    m_book.trade_log.endReplay();
+    m_pending_trades.clear();
+    m_book.changed_levels.clear();
+    m_resumed = snapshot == SnapshotStatus::Loaded || last > 0;
+    if (!contiguous || !journal->open(last)) return false;
+    m_journal = std::move(journal);
+    updateGauges();
+    return true;
+}
+
+void MatchingEngine::restore(const SnapshotImage& image) {
+    m_book.order_directory.importStatus(image.directory.data(), image.directory.size());
+    for (const SnapshotOrder& o : image.orders) {
+        m_book.restoreOrder(o.id, o.price_ticks, o.quantity, o.is_buy != 0, o.owner);
+    }
+    m_book.next_order_id = image.next_order_id;
+    m_depth_seq = image.depth_seq;
+    for (const SnapshotAccount& a : image.accounts) {
+        PnLTracker& t = m_accounts[a.owner];
+        t.position = a.position;
+        t.avg_cost = a.avg_cost;
+        t.realized_pnl = a.realized_pnl;
+    }
+    m_book.changed_levels.clear();
+}
+
+// Re-execute one logged command; nothing is published or logged again
+void MatchingEngine::replay(const WalRecord& rec) {
+    m_pending_trades.clear();
+    m_book.changed_levels.clear();
+    switch (static_cast<WalType>(rec.type)) {
+    case WalType::Submit: {
+        // Ids burnt by failed submits were never logged; reuse the recorded one
+        m_book.next_order_id = rec.order_id;
+        OrderRequest request;
+        request.price_ticks = rec.price_ticks;
+        request.quantity = rec.quantity;
+        request.is_buy = rec.is_buy != 0;
+        request.market = rec.market != 0;
+        request.tif = static_cast<TimeInForce>(rec.tif);
+        request.owner = rec.owner;
+        m_book.placeOrder(request);
+        break;
+    }
+    case WalType::Cancel:
+        m_book.cancelOrder(rec.order_id);
+        break;
+    case WalType::Modify:
+        m_book.modifyOrderTicks(rec.order_id, rec.price_ticks, rec.quantity);
+        break;
+    }
+    settleTrades();
+}
+
+// Capture the book on the engine thread and hand it to the journal's writer.
+// The capture is a copy of the resting orders and directory bits; all file
+// I/O happens off the engine thread. force: wait for any snapshot in flight
+// and take one now if anything was logged since. After a log failure the
+// snapshot is the only way the commands since the hole become durable.
+void MatchingEngine::checkpoint(bool force) {
+    if (!m_journal) return;
+    if (force) {
+        m_journal->sync();
+        if (m_journal->lastLsn() == m_journal->snapshotLsn()) return;
+    } else if (!m_journal->snapshotDue()) {
+        return;
+    }
+    auto image = std::make_unique<SnapshotImage>();
+    image->lsn = m_journal->lastLsn();
+    image->next_order_id = m_book.next_order_id.load();
+    image->trade_seq = m_book.lastTradeSeq();
+    image->depth_seq = m_depth_seq;
+    image->orders.reserve(m_book.order_directory.liveCount());
+    auto capture = [&](int64_t, const PriceLevel& level) {
+        for (const Order* o = level.head; o; o = o->next) {
+            image->orders.push_back(SnapshotOrder{o->id, o->price_ticks, o->quantity, o->owner, o->is_buy, {}});
+        }
+    };
+    m_book.bids.forEach(capture);
+    m_book.asks.forEach(capture);
+    m_book.order_directory.exportStatus(image->directory);
+    image->accounts.reserve(m_accounts.size());
+    for (const auto& [owner, t] : m_accounts) {
+        image->accounts.push_back(SnapshotAccount{owner, 0, t.position, t.avg_cost, t.realized_pnl});
+    }
+    m_journal->submitSnapshot(std::move(image));
+    if (force && !m_journal->sync() && m_journal->snapshotLsn() < m_journal->lastLsn()) {
+        LOG_ERROR("Journal {}: commands after lsn {} are not durable", m_journal->name(),
+                  std::max(m_journal->durableLsn(), m_journal->snapshotLsn()));
+    }
+}
+
+bool MatchingEngine::post(EngineCommand cmd) {
+    if (!m_threaded) {
+        execute(cmd);
+        return true;
+    }
+    if (!m_commands.tryPush(std::move(cmd))) return false;
+    m_runner->notify();
+    return true;
+}
+
+size_t MatchingEngine::poll(size_t consumer) {
+    if (consumer >= m_events.size()) return 0;
+    auto& ring = *m_events[consumer];
+    size_t n = 0;
+    EngineEvent ev;
+    while (ring.tryPop(ev)) {
+        if (onEvent) onEvent(ev);
+        ev = EngineEvent{}; // release payloads promptly
+        ++n;
+    }
+    return n;
+}
+
+size_t MatchingEngine::drain(size_t max) {
+    size_t n = 0;
+    EngineCommand cmd;
+    while (n < max && m_commands.tryPop(cmd)) {
+        execute(cmd);
+        ++n;
+    }
+    return n;
+}
+
+void MatchingEngine::publish(EngineEvent&& ev) {
+    if (!m_threaded) {
+        if (onEvent) onEvent(ev);
+        return;
+    }
+    // A consumer is behind; nudge it and wait for room rather than dropping events.
+    // Once stopping, a full ring is skipped (and counted) without starving the others.
+    for (size_t i = 0; i < m_events.size(); ++i) {
+        EngineEvent copy = i + 1 < m_events.size() ? ev : std::move(ev);
+        while (!m_events[i]->tryPush(std::move(copy))) {
+            if (m_runner->stopping()) {
+                m_gauges.dropped_events.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+            if (onEventsReady) onEventsReady();
+            std::this_thread::yield();
+        }
+    }
+}
+
+// Apply the fills of the last command to their owners' positions
+void MatchingEngine::settleTrades() {
+    for (const Trade& t : m_pending_trades) {
+        if (t.buy_owner) m_accounts[t.buy_owner].applyFill(true, t.quantity, t.price);
+        if (t.sell_owner) m_accounts[t.sell_owner].applyFill(false, t.quantity, t.price);
+    }
+}
+
+// One Depth event per distinct level the last command touched, with its final aggregate
+void MatchingEngine::publishDepth(double best_bid, double best_ask) {
+    auto& changed = m_book.changed_levels;
+    if (changed.empty()) return;
+    if (changed.size() > 1) {
+        std::sort(changed.begin(), changed.end(), [](const LevelChange& a, const LevelChange& b) {
+            return a.is_buy != b.is_buy ? a.is_buy : a.price_ticks < b.price_ticks;
+        });
+        changed.erase(std::unique(changed.begin(), changed.end(), [](const LevelChange& a, const LevelChange& b) {
+            return a.is_buy == b.is_buy && a.price_ticks == b.price_ticks;
+        }), changed.end());
+    }
+    for (const LevelChange& c : changed) {
+        EngineEvent ev;
+        ev.type = EngineEventType::Depth;
+        ev.is_buy = c.is_buy;
+        ev.level = m_book.getLevel(c.is_buy, c.price_ticks);
+        ev.price = ev.level.price;
+        ev.depth_seq = ++m_depth_seq;
+        ev.best_bid = best_bid;
+        ev.best_ask = best_ask;
+        publish(std::move(ev));
+    }
+    changed.clear();
+}
+
+void MatchingEngine::execute(const EngineCommand& cmd) {
+    EngineEvent result;
+    result.client_id = cmd.client_id;
+    result.corr = cmd.corr;
+    result.has_corr = cmd.has_corr;
+    result.order_id = cmd.order_id;
+    result.price = cmd.price;
+    result.quantity = cmd.quantity;
+    result.is_buy = cmd.is_buy;
+    m_pending_trades.clear();
+    m_trade_aggressors.clear();
+    m_book.changed_levels.clear();
+    result.timestamp = engine_clock::nowNs();
+
+    switch (cmd.type) {
+    case EngineCommandType::Submit: {
+        result.type = EngineEventType::SubmitResult;
+        OrderRequest request;
+        request.quantity = cmd.quantity;
+        request.is_buy = cmd.is_buy;
+        request.market = cmd.market;
+        request.tif = cmd.tif;
+        request.owner = cmd.account;
+        request.client = cmd.client_id;
+        SubmitResult placed = submitOne(request, cmd.price);
+        result.order_id = placed.id;
+        result.success = (placed.id != 0);
+        if (result.success) {
+            result.status = placed.status;
+            result.remaining = placed.remaining;
+            result.filled_qty = placed.filled;
+        }
+        break;
+    }
+    case EngineCommandType::Cancel: {
+        result.type = EngineEventType::CancelResult;
+        auto start = std::chrono::steady_clock::now();
+        result.success = cancelOne(cmd.order_id);
+        result.elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        result.status = result.success ? OrderStatus::Canceled : m_book.getOrderStatus(cmd.order_id);
+        break;
+    }
+    case EngineCommandType::Modify: {
+        result.type = EngineEventType::ModifyResult;
+        OrderStatus before = m_book.getOrderStatus(cmd.order_id);
+        if (before != OrderStatus::Open) {
+            result.status = before;
+            break;
+        }
+        int64_t ticks = 0;
+        result.success = !halted() && m_book.priceToTicks(cmd.price, ticks) && m_book.modifyOrderTicks(cmd.order_id, ticks, cmd.quantity);
+        if (result.success && m_journal) m_journal->append(WalType::Modify, cmd.order_id, ticks, cmd.quantity, false, 0);
+        const Order* ord = m_book.getOrderById(cmd.order_id);
+        result.status = ord ? ord->status : m_book.getOrderStatus(cmd.order_id);
+        result.remaining = ord ? ord->quantity : 0;
+        if (ord) result.price = ord->price;
+        break;
+    }
+    case EngineCommandType::Snapshot: {
+        result.type = EngineEventType::SnapshotResult;
+        auto snap = std::make_shared<BookSnapshot>();
+        m_book.getOrderBookSnapshot(snap->bids, snap->asks);
+        result.snapshot = std::move(snap);
+        result.success = true;
+        break;
+    }
+    case EngineCommandType::DepthSnapshot: {
+        result.type = EngineEventType::DepthSnapshotResult;
+        auto depth = std::make_shared<DepthSnapshot>();
+        depth->seq = m_depth_seq;
+        m_book.getDepth(depth->bids, depth->asks);
+        result.depth = std::move(depth);
+        result.success = true;
+        break;
+    }
+    case EngineCommandType::AccountState: {
+        result.type = EngineEventType::AccountStateResult;
+        auto state = std::make_shared<AccountState>();
+        state->account = cmd.account;
+        auto it = m_accounts.find(cmd.account);
+        if (it != m_accounts.end()) {
+            state->position = it->second.position;
+            state->avg_cost = it->second.avg_cost;
+            state->realized_pnl = it->second.realized_pnl;
+        }
+        if (cmd.account) {
+            // The requesting session takes the account's resting orders over: their fills route to it
+            m_book.order_directory.forEachLive([&](Order* o) {
+                if (o->owner != cmd.account) return;
+                o->client = cmd.client_id;
+                state->orders.push_back(*o);
+            });
+        }
+        result.account = std::move(state);
+        result.success = true;
+        break;
+    }
+    case EngineCommandType::SubmitBatch: {
+        result.type = EngineEventType::SubmitBatchResult;
+        auto items = std::make_shared<std::vector<BatchItemResult>>();
+        if (cmd.orders) {
+            items->reserve(cmd.orders->size());
+            for (const BatchOrder& o : *cmd.orders) {
+                OrderRequest request;
+                request.quantity = o.quantity;
+                request.is_buy = o.is_buy;
+                request.market = o.market;
+                request.tif = o.tif;
+                request.owner = cmd.account;
+                request.client = cmd.client_id;
+                SubmitResult placed = submitOne(request, o.price);
+                m_trade_aggressors.resize(m_pending_trades.size(), placed.id);
+                BatchItemResult item;
+                item.order_id = placed.id;
+                item.success = placed.id != 0;
+                item.is_buy = o.is_buy;
+                item.status = placed.status;
+                item.filled_qty = placed.filled;
+                item.remaining = placed.remaining;
+                item.price = o.price;
+                items->push_back(item);
+            }
+        }
+        result.success = true;
+        result.batch = std::move(items);
+        break;
+    }
+    case EngineCommandType::CancelBatch: {
+        result.type = EngineEventType::CancelBatchResult;
+        auto items = std::make_shared<std::vector<BatchItemResult>>();
+        if (cmd.order_ids) {
+            items->reserve(cmd.order_ids->size());
+            for (uint64_t id : *cmd.order_ids) {
+                BatchItemResult item;
+                item.order_id = id;
+                item.success = cancelOne(id);
+                item.status = item.success ? OrderStatus::Canceled : m_book.getOrderStatus(id);
+                items->push_back(item);
+            }
+        }
+        result.success = true;
+        result.batch = std::move(items);
+        break;
+    }
+    }
+    settleTrades();
+
+    double best_bid = m_book.getBestBidPrice();
+    double best_ask = m_book.getBestAskPrice();
+    // Trades first, in match order, then level updates, then the command's own result
+    for (size_t i = 0; i < m_pending_trades.size(); ++i) {
+        const Trade& t = m_pending_trades[i];
+        EngineEvent ev;
+        ev.type = EngineEventType::Trade;
+        ev.trade = t;
+        ev.client_id = cmd.client_id;
+        ev.order_id = i < m_trade_aggressors.size() ? m_trade_aggressors[i] : result.order_id;
+        ev.seq = ++m_event_seq;
+        ev.timestamp = t.timestamp;
+        ev.batch_last = (i + 1 == m_pending_trades.size());
+        ev.buy_filled = m_book.getOrderStatus(t.buy_order_id) == OrderStatus::Filled;
+        ev.sell_filled = m_book.getOrderStatus(t.sell_order_id) == OrderStatus::Filled;
+        ev.best_bid = best_bid;
+        ev.best_ask = best_ask;
+        publish(std::move(ev));
+    }
+    publishDepth(best_bid, best_ask);
+    result.best_bid = best_bid;
+    result.best_ask = best_ask;
+    switch (result.type) {
+    case EngineEventType::SubmitResult:
+    case EngineEventType::CancelResult:
+    case EngineEventType::ModifyResult:
+    case EngineEventType::SubmitBatchResult:
+    case EngineEventType::CancelBatchResult:
+        result.seq = ++m_event_seq;
+        break;
+    default:
+        break;
+    }
+    publish(std::move(result));
+    m_gauges.commands.store(m_gauges.commands.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    updateGauges();
+    if (m_journal && (++m_commands_since_check & 1023) == 0) checkpoint(false);
+}
+
+// Place one order and log it if it was accepted; price is ignored for market orders
+SubmitResult MatchingEngine::submitOne(OrderRequest request, double price) {
+    SubmitResult placed;
+    if (halted()) return placed;
+    if (request.market || m_book.priceToTicks(price, request.price_ticks)) {
+        metrics::ScopedTimer timer(metrics::Submit);
+        placed = m_book.placeOrder(request);
+    }
+    if (placed.id && m_journal) {
+        m_journal->append(WalType::Submit, placed.id, request.price_ticks, request.quantity, request.is_buy, request.owner,
+                          static_cast<uint8_t>(request.tif), request.market);
+    }
+    return placed;
+}
+
+bool MatchingEngine::cancelOne(uint64_t order_id) {
+    if (halted()) return false;
+    bool canceled = m_book.cancelOrder(order_id);
+    if (canceled && m_journal) m_journal->append(WalType::Cancel, order_id, 0, 0, false, 0);
+    return canceled;
+}
+
+void MatchingEngine::updateGauges() {
+    m_gauges.resting_orders.store(m_book.order_directory.liveCount(), std::memory_order_relaxed);
+    m_gauges.bid_levels.store(static_cast<uint32_t>(m_book.bids.size()), std::memory_order_relaxed);
+    m_gauges.ask_levels.store(static_cast<uint32_t>(m_book.asks.size()), std::memory_order_relaxed);
+}
+
+EngineThread::~EngineThread() {
+    stop();
+    while (!m_engines.empty()) m_engines.back()->stop();
+}
+
+void EngineThread::start(int cpu) {
+    if (m_thread.joinable()) return;
+    m_stop.store(false, std::memory_order_relaxed);
+    m_thread = std::thread([this, cpu]() {
+#ifdef __linux__
+        if (cpu >= 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        }
+#else
+        (void)cpu;
+#endif
+        run();
+    });
+}
+
+void EngineThread::stop() {
+    if (!m_thread.joinable()) return;
+    m_stop.store(true, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lk(m_wake_mutex);
+        m_wake_cv.notify_one();
+    }
+    m_thread.join();
+}
+
+bool EngineThread::pending() const {
+    for (const MatchingEngine* engine : m_engines) {
+        if (!engine->m_commands.empty()) return true;
+    }
+    return false;
+}
+
+void EngineThread::notify() {
+    // Pairs with the fence in run(): either we see the thread asleep or it sees our command
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_sleeping.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lk(m_wake_mutex);
+        m_wake_cv.notify_one();
+    }
+}
+
+void EngineThread::run() {
+    constexpr int kSpinsBeforeSleep = 4096;
+    constexpr size_t kBatch = 256; // per engine and pass, so one busy book cannot starve the rest
+    int idle = 0;
+    while (true) {
+        size_t ran = 0;
+        for (MatchingEngine* engine : m_engines) {
+            size_t n = engine->drain(kBatch);
+            if (n && engine->onEventsReady) engine->onEventsReady();
+            ran += n;
+        }
+        if (ran) {
+            idle = 0;
+            continue;
+        }
+        if (m_stop.load(std::memory_order_acquire)) break;
+        if (idle < kSpinsBeforeSleep) {
+            ++idle;
+            cpuRelax();
+            continue;
+        }
+        // Quiet moment: a good time for due snapshots. Then sleep until posted to;
+        // a wakeup with nothing to do goes straight back to sleep without spinning.
+        for (MatchingEngine* engine : m_engines) engine->checkpoint(false);
+        std::unique_lock<std::mutex> lk(m_wake_mutex);
+        m_sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (!pending() && !m_stop.load(std::memory_order_acquire)) m_wake_cv.wait(lk);
+        m_sleeping.store(false, std::memory_order_relaxed);
+    }
+    // Commands that raced with stop()
+    for (MatchingEngine* engine : m_engines) {
+        while (engine->drain(kBatch)) {}
+        if (engine->onEventsReady) engine->onEventsReady();
+    }
+}
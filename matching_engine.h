@@ -0,0 +1,269 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <unordered_map>
+#include <string>
+#include <cstdint>
+#include "order-book.h"
+#include "lockfree_ring.h"
+#include "journal.h"
+#include "pnl_tracker.h"
+
+// Commands accepted by the engine. client_id/corr are opaque to the engine
+// and echoed back on the matching result so the gateway can route replies;
+// client_id also stays on the orders a command rests, so fills route too.
+enum class EngineCommandType : uint8_t { Submit, Cancel, Modify, Snapshot, DepthSnapshot, AccountState, SubmitBatch, CancelBatch };
+
+// One order of a SubmitBatch
+struct BatchOrder {
+    double price = 0.0;
+    uint32_t quantity = 0;
+    bool is_buy = false;
+    bool market = false;
+    TimeInForce tif = TimeInForce::GTC;
+};
+
+// Per-item outcome of a SubmitBatch or CancelBatch, in request order
+struct BatchItemResult {
+    uint64_t order_id = 0;
+    bool success = false;
+    bool is_buy = false;
+    OrderStatus status = OrderStatus::NotFound;
+    uint32_t filled_qty = 0;
+    uint32_t remaining = 0;
+    double price = 0.0;
+};
+
+struct EngineCommand {
+    EngineCommandType type = EngineCommandType::Submit;
+    bool is_buy = false;
+    bool has_corr = false;
+    uint32_t quantity = 0;
+    uint32_t client_id = 0;         // stamped on submitted orders and their trades; AccountState: new holder of the orders
+    uint32_t account = 0;           // owner stamped on submitted orders; AccountState: account to report
+    TimeInForce tif = TimeInForce::GTC; // submit only
+    bool market = false;            // submit: take any price (price ignored), never rest
+    uint64_t order_id = 0;
+    uint64_t corr = 0;
+    double price = 0.0;
+    // Batches run as one command: no other command interleaves, and trades,
+    // depth updates and the single combined result go out once at the end
+    std::shared_ptr<const std::vector<BatchOrder>> orders;  // SubmitBatch
+    std::shared_ptr<const std::vector<uint64_t>> order_ids; // CancelBatch
+};
+
+enum class EngineEventType : uint8_t { SubmitResult, CancelResult, ModifyResult, SnapshotResult, DepthSnapshotResult, AccountStateResult, Trade, Depth,
+                                       SubmitBatchResult, CancelBatchResult };
+
+struct BookSnapshot {
+    std::vector<Order> bids;
+    std::vector<Order> asks;
+};
+
+// Aggregated levels as of depth sequence seq; Depth events with a higher seq follow it
+struct DepthSnapshot {
+    uint64_t seq = 0;
+    std::vector<DepthLevel> bids;
+    std::vector<DepthLevel> asks;
+};
+
+// Position and live orders of one account in this book, as the engine sees them
+struct AccountState {
+    uint32_t account = 0;
+    int64_t position = 0;
+    double avg_cost = 0.0;
+    double realized_pnl = 0.0;
+    std::vector<Order> orders;
+};
+
+// Results and trade prints published by the engine, in execution order.
+struct EngineEvent {
+    EngineEventType type = EngineEventType::Trade;
+    bool success = false;
+    bool is_buy = false;
+    bool has_corr = false;
+    bool buy_filled = false;        // Trade: buy order fully filled by this pass
+    bool sell_filled = false;       // Trade: sell order fully filled by this pass
+    bool batch_last = false;        // Trade: last trade of its match pass
+    OrderStatus status = OrderStatus::NotFound;
+    uint32_t client_id = 0;         // Trade: client of the command that produced it (with order_id)
+    uint32_t quantity = 0;          // requested quantity (submit/modify)
+    uint32_t remaining = 0;         // quantity still resting after the command
+    uint32_t filled_qty = 0;        // quantity filled by the command itself
+    uint64_t order_id = 0;
+    uint64_t corr = 0;
+    int64_t elapsed_ms = 0;
+    double price = 0.0;
+    // Trade and order results (submit, cancel, modify, batches): per-book event sequence,
+    // contiguous across both kinds and starting at 1 when the engine is created,
+    // and the engine clock (ns since the Unix epoch) when the command ran
+    uint64_t seq = 0;
+    uint64_t timestamp = 0;
+    Trade trade{};
+    // Depth: new aggregate of the level at (is_buy, price); depth_seq increases by one per Depth event
+    DepthLevel level{};
+    uint64_t depth_seq = 0;
+    // Top of book once the command that produced this event has completed
+    double best_bid = 0.0;
+    double best_ask = 0.0;
+    std::shared_ptr<const BookSnapshot> snapshot;
+    std::shared_ptr<const DepthSnapshot> depth;
+    std::shared_ptr<const AccountState> account;
+    std::shared_ptr<const std::vector<BatchItemResult>> batch;
+};
+
+// Book and pool figures refreshed by the engine after every command; readable from any thread
+struct EngineGauges {
+    std::atomic<uint64_t> commands{0};
+    std::atomic<uint64_t> resting_orders{0};
+    std::atomic<uint32_t> bid_levels{0};
+    std::atomic<uint32_t> ask_levels{0};
+    std::atomic<uint64_t> dropped_events{0};    // not delivered to a consumer whose ring was full at shutdown
+};
+
+class EngineThread;
+
+// Owns all mutation of one OrderBook.
+//
+// Inline mode (default): post() executes the command on the caller's thread
+// and hands events straight to onEvent.
+// Threaded mode (start() or attach()): an EngineThread drains the engine's MPSC
+// command ring and owns the book with locking disabled; events go out through
+// one SPSC ring per consumer. Every consumer sees every event, in order, and
+// drains its ring with poll(consumer), prompted by onEventsReady. Both rings
+// hold queue_depth entries.
+//
+// With openJournal() every command that changed the book is written ahead to
+// a group-committed log, and the engine periodically captures a snapshot of
+// the book, id directory and account positions for a background writer.
+class MatchingEngine {
+public:
+    static constexpr size_t kDefaultQueueDepth = 1 << 14;
+
+    explicit MatchingEngine(OrderBook& book, size_t queue_depth = kDefaultQueueDepth);
+    ~MatchingEngine();
+
+    MatchingEngine(const MatchingEngine&) = delete;
+    MatchingEngine& operator=(const MatchingEngine&) = delete;
+
+    // Run on a thread of its own; cpu >= 0 pins it to that core (Linux only).
+    // Events are fanned out to `consumers` rings.
+    void start(int cpu = -1, size_t consumers = 1);
+    // Run on a shared thread instead, from its start(); call before that.
+    void attach(EngineThread& thread, size_t consumers = 1);
+    // Drain outstanding commands, stop the thread (a shared one stops for all its
+    // engines) and hand the book back to locked mode. With a journal, also takes
+    // a final snapshot and waits until it and the log are durable.
+    void stop();
+    bool threaded() const { return m_threaded; }
+
+    // Queue (threaded) or execute (inline) a command. False if the ring is full.
+    bool post(EngineCommand cmd);
+
+    // Deliver queued events to onEvent; call from that consumer's thread. Returns count.
+    size_t poll(size_t consumer = 0);
+
+    // Consumer-side event sink (called on whichever thread runs poll)
+    std::function<void(const EngineEvent&)> onEvent = nullptr;
+    // Called on the engine thread after a batch of events is published to every consumer
+    std::function<void()> onEventsReady = nullptr;
+
+    OrderBook& book() { return m_book; }
+
+    // Recover the book from config.dir (latest snapshot of `name`, then the
+    // WAL after it) and start logging. Call before start() and before any command.
+    // False, with the book only partly recovered, if the snapshot is corrupt or
+    // the log does not continue it; the book must not be served then.
+    bool openJournal(const JournalConfig& config, const std::string& name);
+    bool journaling() const { return m_journal != nullptr; }
+    // The journal cannot be written (for now, or for good): submits, cancels and
+    // modifies are refused so nothing is acked that the log cannot hold. Queries still work.
+    bool halted() const { return m_journal && (m_journal->failing() || m_journal->failed()); }
+    // Commands replayed by the last openJournal
+    uint64_t recoveredCommands() const { return m_recovered; }
+    // The last openJournal found a snapshot or logged commands (the book may still be empty)
+    bool resumed() const { return m_resumed; }
+
+    const EngineGauges& gauges() const { return m_gauges; }
+
+private:
+    friend class EngineThread;
+
+    // Execute up to max queued commands on the engine thread; returns how many ran
+    size_t drain(size_t max);
+    void execute(const EngineCommand& cmd);
+    // Single submit / cancel plus its WAL record; shared by the plain and batch commands
+    SubmitResult submitOne(OrderRequest request, double price);
+    bool cancelOne(uint64_t order_id);
+    void settleTrades();
+    void replay(const WalRecord& rec);
+    void restore(const SnapshotImage& image);
+    void checkpoint(bool force);
+    void publish(EngineEvent&& ev);
+    void publishDepth(double best_bid, double best_ask);
+    void updateGauges();
+
+    OrderBook& m_book;
+    std::vector<Trade> m_pending_trades;    // match batch produced by the command in flight
+    std::vector<uint64_t> m_trade_aggressors; // SubmitBatch: incoming order id of each pending trade
+    uint64_t m_depth_seq = 0;               // sequence of the last Depth event
+    uint64_t m_event_seq = 0;               // sequence of the last Trade or order result event
+    std::unordered_map<uint32_t, PnLTracker> m_accounts; // position per order owner, from fills
+
+    std::unique_ptr<Journal> m_journal;
+    uint64_t m_recovered = 0;
+    bool m_resumed = false;
+    uint32_t m_commands_since_check = 0;    // snapshot due-check runs every 1024 commands
+    EngineGauges m_gauges;
+
+    const size_t m_queue_depth;
+    MpscRing<EngineCommand> m_commands;
+    std::vector<std::unique_ptr<SpscRing<EngineEvent>>> m_events; // one per consumer, created by attach()
+
+    EngineThread* m_runner = nullptr;       // thread the engine runs on (threaded mode)
+    std::unique_ptr<EngineThread> m_own_thread; // start(): a thread for this engine alone
+    bool m_threaded = false;
+};
+
+// One engine thread serving any number of engines: each pass drains a batch of
+// commands from every engine in turn. Idle, it spins briefly, then sleeps on
+// a condition variable until a post() or stop() wakes it; there is no timed
+// wakeup. Sharding many instruments over a few of these bounds the thread
+// count instead of spending a thread per symbol.
+class EngineThread {
+public:
+    EngineThread() = default;
+    // Stops the thread and hands every engine still attached back to inline mode
+    ~EngineThread();
+
+    EngineThread(const EngineThread&) = delete;
+    EngineThread& operator=(const EngineThread&) = delete;
+
+    // cpu >= 0 pins the thread to that core (Linux only). Engines attach before this.
+    void start(int cpu = -1);
+    // Run every command already queued, then join. Engines stay attached.
+    void stop();
+    bool stopping() const { return m_stop.load(std::memory_order_acquire); }
+    size_t engines() const { return m_engines.size(); }
+
+private:
+    friend class MatchingEngine;
+
+    void run();
+    bool pending() const;
+    // Producer side of post(): wake the thread if it sleeps
+    void notify();
+
+    std::vector<MatchingEngine*> m_engines;
+    std::thread m_thread;
+    std::atomic<bool> m_stop{false};
+    std::atomic<bool> m_sleeping{false};
+    std::mutex m_wake_mutex;
+    std::condition_variable m_wake_cv;
+};
@@ -0,0 +1,123 @@
+#include "metrics.h"
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+
+namespace metrics {
+
+namespace {
+
+struct ThreadSet {
+    std::array<Histogram, kStageCount> stages;
+};
+
+std::mutex g_registry_mutex;
+std::vector<std::unique_ptr<ThreadSet>>& registry() {
+    static std::vector<std::unique_ptr<ThreadSet>> sets;
+    return sets;
+}
+
+ThreadSet& threadSet() {
+    thread_local ThreadSet* set = nullptr;
+    if (!set) {
+        auto owned = std::make_unique<ThreadSet>();
+        set = owned.get();
+        std::lock_guard<std::mutex> lk(g_registry_mutex);
+        registry().push_back(std::move(owned));
+    }
+    return *set;
+}
+
+// Prometheus bucket bounds in ns; coarser than the recorded buckets on purpose
+constexpr uint64_t kBounds[] = {250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000,
+                                500000, 1000000, 2500000, 10000000, 100000000, 1000000000};
+
+} // namespace
+
+const char* stageName(Stage stage) {
+    switch (stage) {
+    case Parse: return "parse";
+    case Handler: return "handler";
+    case Submit: return "submit_order";
+    case Match: return "match_orders";
+    case Serialize: return "serialize";
+    case Broadcast: return "broadcast";
+    case kStageCount: break;
+    }
+    return "unknown";
+}
+
+void setEnabled(bool on) { enabledFlag().store(on, std::memory_order_relaxed); }
+
+Histogram& local(Stage stage) { return threadSet().stages[stage]; }
+
+void Summary::merge(const Histogram& h) {
+    for (size_t i = 0; i < Histogram::kBuckets; ++i) counts[i] += h.m_counts[i].load(std::memory_order_relaxed);
+    count += h.m_count.load(std::memory_order_relaxed);
+    sum += h.m_sum.load(std::memory_order_relaxed);
+    max = std::max(max, h.m_max.load(std::memory_order_relaxed));
+}
+
+uint64_t Summary::quantile(double q) const {
+    // Bucket totals, not count: the two are read at slightly different moments
+    uint64_t total = 0;
+    for (uint64_t c : counts) total += c;
+    if (!total) return 0;
+    uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(total - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        seen += counts[i];
+        if (seen >= rank) return std::min(Histogram::bucketUpper(i), max);
+    }
+    return max;
+}
+
+uint64_t Summary::countAtOrBelow(uint64_t ns) const {
+    uint64_t n = 0;
+    for (size_t i = 0; i < counts.size() && Histogram::bucketUpper(i) <= ns; ++i) n += counts[i];
+    return n;
+}
+
+Summary collect(Stage stage) {
+    Summary s;
+    std::lock_guard<std::mutex> lk(g_registry_mutex);
+    for (const auto& set : registry()) s.merge(set->stages[stage]);
+    return s;
+}
+
+void appendPrometheus(std::string& out) {
+    char line[160];
+    out += "# HELP trading_stage_latency_seconds Time spent per processing stage\n";
+    out += "# TYPE trading_stage_latency_seconds histogram\n";
+    std::array<uint64_t, kStageCount> maxima{};
+    for (int st = 0; st < kStageCount; ++st) {
+        Stage stage = static_cast<Stage>(st);
+        Summary s = collect(stage);
+        uint64_t total = s.countAtOrBelow(UINT64_MAX);
+        for (uint64_t bound : kBounds) {
+            std::snprintf(line, sizeof(line), "trading_stage_latency_seconds_bucket{stage=\"%s\",le=\"%g\"} %llu\n",
+                          stageName(stage), static_cast<double>(bound) / 1e9, static_cast<unsigned long long>(s.countAtOrBelow(bound)));
+            out += line;
+        }
+        std::snprintf(line, sizeof(line), "trading_stage_latency_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %llu\n",
+                      stageName(stage), static_cast<unsigned long long>(total));
+        out += line;
+        std::snprintf(line, sizeof(line), "trading_stage_latency_seconds_sum{stage=\"%s\"} %.9f\n",
+                      stageName(stage), static_cast<double>(s.sum) / 1e9);
+        out += line;
+        std::snprintf(line, sizeof(line), "trading_stage_latency_seconds_count{stage=\"%s\"} %llu\n",
+                      stageName(stage), static_cast<unsigned long long>(total));
+        out += line;
+        maxima[st] = s.max;
+    }
+    out += "# HELP trading_stage_latency_max_seconds Slowest sample per stage since start\n";
+    out += "# TYPE trading_stage_latency_max_seconds gauge\n";
+    for (int st = 0; st < kStageCount; ++st) {
+        std::snprintf(line, sizeof(line), "trading_stage_latency_max_seconds{stage=\"%s\"} %.9f\n",
+                      stageName(static_cast<Stage>(st)), static_cast<double>(maxima[st]) / 1e9);
+        out += line;
+    }
+}
+
+} // namespace metrics
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <array>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "engine_clock.h"
+
+// Latency histograms for the hot path, cheap enough to leave on in production.
+//
+// Every thread that records gets its own set of histograms (registered on
+// first use and kept for the life of the process), so recording is two clock
+// reads and a few uncontended relaxed stores. Readers merge all threads'
+// sets on demand; counts are monotonic, so a scrape racing with writers only
+// misses the samples still in flight.
+namespace metrics {
+
+enum Stage : uint8_t {
+    Parse,          // JSON request decode
+    Handler,        // whole message callback, JSON or binary
+    Submit,         // engine: placeOrder, match included
+    Match,          // OrderBook matching: placeOrder / modify under the side locks
+    Serialize,      // JSON dump of replies and market data
+    Broadcast,      // topic publish (copy into every subscriber's send buffer)
+    kStageCount
+};
+
+const char* stageName(Stage stage);
+
+// Log-linear (HDR-style) buckets: 32 per power of two, so any value is
+// reported within about 3%. Values are nanoseconds; anything past ~68s lands
+// in the last bucket. Single writer per instance.
+class Histogram {
+public:
+    static constexpr unsigned kSubBits = 5;
+    static constexpr unsigned kMaxBits = 36;
+    static constexpr size_t kBuckets = (kMaxBits - kSubBits + 1) << kSubBits;
+
+    void record(uint64_t ns) {
+        bump(m_counts[bucketOf(ns)], 1);
+        bump(m_count, 1);
+        bump(m_sum, ns);
+        if (ns > m_max.load(std::memory_order_relaxed)) m_max.store(ns, std::memory_order_relaxed);
+    }
+
+    static size_t bucketOf(uint64_t v) {
+        if (v < (uint64_t{1} << kSubBits)) return static_cast<size_t>(v);
+        unsigned msb = 63 - static_cast<unsigned>(__builtin_clzll(v));
+        if (msb >= kMaxBits) return kBuckets - 1;
+        unsigned shift = msb - kSubBits;
+        return (static_cast<size_t>(shift + 1) << kSubBits) + static_cast<size_t>((v >> shift) & ((1u << kSubBits) - 1));
+    }
+    // Largest value that lands in bucket i
+    static uint64_t bucketUpper(size_t i) {
+        if (i < (size_t{1} << kSubBits)) return i;
+        unsigned shift = static_cast<unsigned>(i >> kSubBits) - 1;
+        uint64_t sub = (i & ((1u << kSubBits) - 1)) | (uint64_t{1} << kSubBits);
+        return ((sub + 1) << shift) - 1;
+    }
+
+private:
+    friend struct Summary;
+    // Only the owning thread writes, so a plain load + store replaces a locked RMW
+    static void bump(std::atomic<uint64_t>& a, uint64_t by) {
+        a.store(a.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+    }
+
+    std::array<std::atomic<uint64_t>, kBuckets> m_counts{};
+    std::atomic<uint64_t> m_count{0};
+    std::atomic<uint64_t> m_sum{0};
+    std::atomic<uint64_t> m_max{0};
+};
+
+// Merged view of one stage across all threads
+struct Summary {
+    std::vector<uint64_t> counts = std::vector<uint64_t>(Histogram::kBuckets, 0);
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+
+    void merge(const Histogram& h);
+    // Upper bound (ns) of the bucket holding quantile q, capped at max
+    uint64_t quantile(double q) const;
+    // Samples <= ns, to bucket resolution
+    uint64_t countAtOrBelow(uint64_t ns) const;
+    double mean() const { return count ? static_cast<double>(sum) / static_cast<double>(count) : 0.0; }
+};
+
+// Recording is off until enabled, so library users (the benchmark) pay one branch
+void setEnabled(bool on);
+inline std::atomic<bool>& enabledFlag() {
+    static std::atomic<bool> flag{false};
+    return flag;
+}
+inline bool enabled() { return enabledFlag().load(std::memory_order_relaxed); }
+
+// This thread's histogram for a stage
+Histogram& local(Stage stage);
+Summary collect(Stage stage);
+
+inline uint64_t nowNs() { return engine_clock::nowNs(); }
+
+// Records the lifetime of the scope; no clock reads when disabled
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Stage stage) : m_stage(stage), m_start(enabled() ? nowNs() : 0) {}
+    ~ScopedTimer() { if (m_start) local(m_stage).record(nowNs() - m_start); }
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    Stage m_stage;
+    uint64_t m_start;
+};
+
+// Prometheus text for every stage: one histogram family (seconds) plus a max gauge
+void appendPrometheus(std::string& out);
+
+} // namespace metrics
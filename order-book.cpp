@@ -1,45 +1,47 @@
 
 #include "order-book.h"
+#include "metrics.h"
+#include "engine_clock.h"
+#include <cmath>
 
-OrderBook::OrderBook() {
-    pools.push_back(new PoolAllocator<Order, 1024>());
-}
+OrderBook::OrderBook(double tick_size, const SlabConfig& pool_config, const DirectoryConfig& directory_config,
+                     const TradeLogConfig& trade_log_config)
+    : tick_size(tick_size), order_pool(pool_config), order_directory(directory_config), trade_log(trade_log_config),
+      next_order_id(directory_config.id_base + 1) {}
 
-OrderBook::~OrderBook() {
-    for (auto pool : pools) delete pool;
-}
+OrderBook::~OrderBook() = default;
 
 Order* OrderBook::getOrderById(uint64_t id) {
-    std::shared_lock lookup_lock(order_lookup_mutex);
-    auto it = order_lookup.find(id);
-    return (it != order_lookup.end()) ? it->second : nullptr;
+    auto lookup_lock = readLock(order_lookup_mutex);
+    return order_directory.find(id);
 }
 
-Order* OrderBook::createOrder(uint64_t id, double price, uint32_t quantity, bool is_buy) {
-    PoolAllocator<Order, 1024>* allocator = nullptr;
-    Order* order = nullptr;
-    {
-        // Protect pool vector access, expansion, and allocation
-        std::unique_lock pools_lock(pools_mutex);
-        allocator = pools[current_pool];
-        order = allocator->allocate();
-        if (!order) {
-            pools.push_back(new PoolAllocator<Order, 1024>());
-            current_pool++;
-            allocator = pools[current_pool];
-            order = allocator->allocate();
-            if (!order) return nullptr;
-        }
-    }
+bool OrderBook::priceToTicks(double price, int64_t& ticks) const {
+    if (!(price > 0)) return false;
+    double scaled = price / tick_size;
+    double rounded = std::nearbyint(scaled);
+    // Reject prices that are off the grid beyond floating point noise
+    if (std::fabs(scaled - rounded) > 1e-6 || rounded > 9.0e18) return false;
+    ticks = static_cast<int64_t>(rounded);
+    return ticks > 0;
+}
+
+Order* OrderBook::createOrder(uint64_t id, int64_t price_ticks, uint32_t quantity, bool is_buy, uint32_t owner, uint32_t client) {
+    Order* order = order_pool.allocate();
+    if (!order) return nullptr;
+    order->next = order->prev = nullptr;
+    order->level = nullptr;
     order->id = id;
-    order->price = price;
+    order->price_ticks = price_ticks;
+    order->price = ticksToPrice(price_ticks);
     order->quantity = quantity;
     order->is_buy = is_buy;
-    order->pool_index = current_pool;
     order->status = OrderStatus::Open;
+    order->owner = owner;
+    order->client = client;
     {
-        std::unique_lock lk(order_lookup_mutex);
-        order_lookup[id] = order;
+        auto lk = writeLock(order_lookup_mutex);
+        order_directory.insert(id, order);
     }
     return order;
 }
@@ -50,86 +52,178 @@ void OrderBook::destroyOrder(Order* order) {
     OrderStatus st = order->status;
 
     {
-        std::unique_lock lookup_lock(order_lookup_mutex);
-        // Archive final status for future status queries
-        final_status_archive[id] = st;
-        order_lookup.erase(id);
-    }
-    {
-        std::unique_lock pools_lock(pools_mutex);
-        pools[order->pool_index]->deallocate(order);
+        auto lookup_lock = writeLock(order_lookup_mutex);
+        // Keep only the final status for future status queries
+        order_directory.finish(id, st);
     }
+    order_pool.deallocate(order);
 }
 
 void OrderBook::removeOrderFromBook(Order* order) {
+    auto unlink = [this, order](auto& side) {
+        PriceLevel* level = order->level;
+        if (!level) return;
+        noteLevelChange(order->is_buy, order->price_ticks);
+        level->unlink(order);
+        if (level->empty()) side.erase(order->price_ticks);
+    };
     if (order->is_buy) {
-        std::unique_lock<std::shared_mutex> bids_lock(bids_mutex);
-        auto it = bids.find(order->price);
-        if (it != bids.end()) {
-            auto& level = it->second;
-            auto id_it = level.id_map.find(order->id);
-            if (id_it != level.id_map.end()) {
-                level.orders.erase(id_it->second);
-                level.id_map.erase(id_it);
-            }
-            if (level.orders.empty()) bids.erase(it);
-        }
+        auto bids_lock = writeLock(bids_mutex);
+        unlink(bids);
     } else {
-        std::unique_lock<std::shared_mutex> asks_lock(asks_mutex);
-        auto it = asks.find(order->price);
-        if (it != asks.end()) {
-            auto& level = it->second;
-            auto id_it = level.id_map.find(order->id);
-            if (id_it != level.id_map.end()) {
-                level.orders.erase(id_it->second);
-                level.id_map.erase(id_it);
-            }
-            if (level.orders.empty()) asks.erase(it);
-        }
+        auto asks_lock = writeLock(asks_mutex);
+        unlink(asks);
     }
 }
 
-uint64_t OrderBook::getUnixTimestamp() const {
-    return std::chrono::duration_cast<std::chrono::seconds>(
-        std::chrono::system_clock::now().time_since_epoch()
-    ).count();
+void OrderBook::addOrderToBook(Order* order) {
+    auto lock = writeLock(order->is_buy ? bids_mutex : asks_mutex);
+    restOrder(order);
+}
+
+void OrderBook::restOrder(Order* order) {
+    noteLevelChange(order->is_buy, order->price_ticks);
+    if (order->is_buy) bids.getOrCreate(order->price_ticks).push_back(order);
+    else asks.getOrCreate(order->price_ticks).push_back(order);
+}
+
+uint64_t OrderBook::getTimestampNs() const {
+    return engine_clock::nowNs();
 }
 
 uint64_t OrderBook::generateOrderId() {
     return next_order_id++;
 }
 
-uint64_t OrderBook::submitOrder(double price, uint32_t quantity, bool is_buy) {
-    if (price <= 0 || quantity == 0) return 0;
+uint64_t OrderBook::submitOrder(double price, uint32_t quantity, bool is_buy, uint32_t owner) {
+    int64_t price_ticks = 0;
+    if (!priceToTicks(price, price_ticks)) return 0;
+    return submitOrderTicks(price_ticks, quantity, is_buy, owner);
+}
+
+uint64_t OrderBook::submitOrderTicks(int64_t price_ticks, uint32_t quantity, bool is_buy, uint32_t owner) {
+    OrderRequest request;
+    request.price_ticks = price_ticks;
+    request.quantity = quantity;
+    request.is_buy = is_buy;
+    request.owner = owner;
+    return placeOrder(request).id;
+}
+
+SubmitResult OrderBook::placeOrder(const OrderRequest& request) {
+    SubmitResult result;
+    if (request.quantity == 0 || (!request.market && request.price_ticks <= 0)) return result;
     uint64_t id = generateOrderId();
     {
-        std::unique_lock lock(order_lookup_mutex);
-        if (order_lookup.count(id)) return 0;
+        auto lock = writeLock(order_lookup_mutex);
+        if (order_directory.contains(id)) return result;
     }
-    Order* order = createOrder(id, price, quantity, is_buy);
-    if (!order) return 0;
-    if (is_buy) {
-        std::unique_lock<std::shared_mutex> bids_lock(bids_mutex);
-        auto& level = bids[price];
-        level.orders.push_back(order);
-        level.id_map[order->id] = std::prev(level.orders.end());
-    } else {
-        std::unique_lock<std::shared_mutex> asks_lock(asks_mutex);
-        auto& level = asks[price];
-        level.orders.push_back(order);
-        level.id_map[order->id] = std::prev(level.orders.end());
+    uint64_t timestamp = getTimestampNs();
+    std::vector<Trade> to_fire;
+    {
+        metrics::ScopedTimer timer(metrics::Match);
+        // Both sides stay locked until the remainder rests, so the book is never left crossed
+        auto bids_lock = writeLock(bids_mutex);
+        auto asks_lock = writeLock(asks_mutex);
+
+        bool killed = false;
+        if (request.tif == TimeInForce::FOK) {
+            uint64_t available = request.is_buy ? availableFor(asks, request) : availableFor(bids, request);
+            killed = available < request.quantity;
+        }
+        if (!killed) {
+            result.filled = request.is_buy ? fillIncoming(asks, id, request, timestamp, to_fire)
+                                           : fillIncoming(bids, id, request, timestamp, to_fire);
+        }
+        uint32_t left = request.quantity - result.filled;
+        bool rests = left > 0 && !request.market && request.tif == TimeInForce::GTC;
+        Order* order = rests ? createOrder(id, request.price_ticks, left, request.is_buy, request.owner, request.client) : nullptr;
+        if (order) {
+            restOrder(order);
+            result.remaining = left;
+            result.status = OrderStatus::Open;
+        } else if (rests && result.filled == 0) {
+            // Pool exhausted before anything happened: reject. The id is burned; record it
+            // as canceled so its directory page can still complete and spill.
+            auto lookup_lock = writeLock(order_lookup_mutex);
+            order_directory.retire(id, OrderStatus::Canceled);
+            return result;
+        } else {
+            result.status = left == 0 ? OrderStatus::Filled : OrderStatus::Canceled;
+            auto lookup_lock = writeLock(order_lookup_mutex);
+            order_directory.retire(id, result.status);
+        }
+    }
+    result.id = id;
+    fireTrades(to_fire);
+    return result;
+}
+
+template <typename Side>
+uint64_t OrderBook::availableFor(const Side& side, const OrderRequest& request) const {
+    uint64_t available = 0;
+    side.forEachWhile([&](int64_t tick, const PriceLevel& level) {
+        if (!request.market && (request.is_buy ? tick > request.price_ticks : tick < request.price_ticks)) return false;
+        available += level.total_quantity;
+        return available < request.quantity;
+    });
+    return available;
+}
+
+template <typename Side>
+uint32_t OrderBook::fillIncoming(Side& side, uint64_t id, const OrderRequest& request, uint64_t timestamp, std::vector<Trade>& to_fire) {
+    uint32_t left = request.quantity;
+    while (left > 0) {
+        int64_t tick = 0;
+        PriceLevel* level = side.best(&tick);
+        if (!level) break;
+        if (!request.market && (request.is_buy ? tick > request.price_ticks : tick < request.price_ticks)) break;
+        noteLevelChange(!request.is_buy, tick);
+        while (left > 0 && !level->empty()) {
+            Order* resting = level->head;
+            uint32_t trade_qty = std::min(left, resting->quantity);
+            // Trades print at the resting order's price
+            Trade trade = request.is_buy ? Trade{id, resting->id, resting->price, trade_qty, timestamp}
+                                         : Trade{resting->id, id, resting->price, trade_qty, timestamp};
+            trade.buy_owner = request.is_buy ? request.owner : resting->owner;
+            trade.sell_owner = request.is_buy ? resting->owner : request.owner;
+            trade.buy_client = request.is_buy ? request.client : resting->client;
+            trade.sell_client = request.is_buy ? resting->client : request.client;
+            trade_log.append(trade);
+            to_fire.push_back(trade);
+
+            left -= trade_qty;
+            resting->quantity -= trade_qty;
+            level->total_quantity -= trade_qty;
+            if (resting->quantity == 0) {
+                resting->status = OrderStatus::Filled;
+                level->unlink(resting);
+                destroyOrder(resting);
+            }
+        }
+        if (level->empty()) side.erase(tick);
+    }
+    return request.quantity - left;
+}
+
+bool OrderBook::restoreOrder(uint64_t id, int64_t price_ticks, uint32_t quantity, bool is_buy, uint32_t owner) {
+    if (price_ticks <= 0 || quantity == 0) return false;
+    {
+        auto lock = writeLock(order_lookup_mutex);
+        if (order_directory.contains(id)) return false;
     }
-    matchOrders(getUnixTimestamp());
-    return id;
+    Order* order = createOrder(id, price_ticks, quantity, is_buy, owner);
+    if (!order) return false;
+    addOrderToBook(order);
+    return true;
 }
 
 bool OrderBook::cancelOrder(uint64_t id) {
     Order* order = nullptr;
     {
-        std::unique_lock lookup_lock(order_lookup_mutex);
-        auto it = order_lookup.find(id);
-        if (it == order_lookup.end() || it->second->status != OrderStatus::Open) return false;
-        order = it->second;
+        auto lookup_lock = writeLock(order_lookup_mutex);
+        order = order_directory.find(id);
+        if (!order || order->status != OrderStatus::Open) return false;
         order->status = OrderStatus::Canceled;
     }
     removeOrderFromBook(order);
@@ -138,136 +232,141 @@ bool OrderBook::cancelOrder(uint64_t id) {
 }
 
 bool OrderBook::modifyOrder(uint64_t id, double new_price, uint32_t new_quantity) {
-    if (new_price <= 0 || new_quantity == 0) return false;
+    int64_t price_ticks = 0;
+    if (!priceToTicks(new_price, price_ticks)) return false;
+    return modifyOrderTicks(id, price_ticks, new_quantity);
+}
+
+bool OrderBook::modifyOrderTicks(uint64_t id, int64_t new_price_ticks, uint32_t new_quantity) {
+    if (new_price_ticks <= 0 || new_quantity == 0) return false;
     Order* order = nullptr;
     {
-        std::unique_lock lookup_lock(order_lookup_mutex);
-        auto it = order_lookup.find(id);
-        if (it == order_lookup.end() || it->second->status != OrderStatus::Open) return false;
-        order = it->second;
+        auto lookup_lock = writeLock(order_lookup_mutex);
+        order = order_directory.find(id);
+        if (!order || order->status != OrderStatus::Open) return false;
+    }
+    // Same price, same or smaller size: amend in place. The order keeps its
+    // queue position and cannot cross, so there is nothing to match.
+    if (new_price_ticks == order->price_ticks && new_quantity <= order->quantity) {
+        auto lock = writeLock(order->is_buy ? bids_mutex : asks_mutex);
+        PriceLevel* level = order->level;
+        if (!level) return false;
+        level->total_quantity -= order->quantity - new_quantity;
+        order->quantity = new_quantity;
+        noteLevelChange(order->is_buy, order->price_ticks);
+        return true;
     }
     removeOrderFromBook(order);
-    order->price = new_price;
+    order->price_ticks = new_price_ticks;
+    order->price = ticksToPrice(new_price_ticks);
     order->quantity = new_quantity;
-    if (order->is_buy) {
-        std::unique_lock<std::shared_mutex> bids_lock(bids_mutex);
-        auto& level = bids[new_price];
-        level.orders.push_back(order);
-        level.id_map[order->id] = std::prev(level.orders.end());
-    } else {
-        std::unique_lock<std::shared_mutex> asks_lock(asks_mutex);
-        auto& level = asks[new_price];
-        level.orders.push_back(order);
-        level.id_map[order->id] = std::prev(level.orders.end());
+    // The amended order is the aggressor: it trades first, then rests what is left
+    OrderRequest request;
+    request.price_ticks = new_price_ticks;
+    request.quantity = new_quantity;
+    request.is_buy = order->is_buy;
+    request.owner = order->owner;
+    request.client = order->client;
+    std::vector<Trade> to_fire;
+    {
+        metrics::ScopedTimer timer(metrics::Match);
+        auto bids_lock = writeLock(bids_mutex);
+        auto asks_lock = writeLock(asks_mutex);
+        uint32_t filled = order->is_buy ? fillIncoming(asks, id, request, getTimestampNs(), to_fire)
+                                        : fillIncoming(bids, id, request, getTimestampNs(), to_fire);
+        order->quantity = new_quantity - filled;
+        if (order->quantity == 0) {
+            order->status = OrderStatus::Filled;
+            destroyOrder(order);
+        } else {
+            restOrder(order);
+        }
     }
-    matchOrders(getUnixTimestamp());
+    fireTrades(to_fire);
     return true;
 }
 
 OrderStatus OrderBook::getOrderStatus(uint64_t id) {
-    {
-        std::shared_lock lock(order_lookup_mutex);
-        auto it = order_lookup.find(id);
-        if (it != order_lookup.end()) return it->second->status;
-    }
-    auto it = final_status_archive.find(id);
-    if (it != final_status_archive.end()) return it->second;
-    return OrderStatus::NotFound;
+    auto lock = readLock(order_lookup_mutex);
+    return order_directory.status(id);
 }
 
 void OrderBook::getOrderBookSnapshot(std::vector<Order>& bid_snapshot, std::vector<Order>& ask_snapshot) {
     {
-        std::shared_lock bids_lock(bids_mutex);
-        for (const auto& [price, level] : bids) {
-            for (const auto& order : level.orders) {
+        auto bids_lock = readLock(bids_mutex);
+        bids.forEach([&](int64_t, const PriceLevel& level) {
+            for (const Order* order = level.head; order; order = order->next) {
                 if (order->status == OrderStatus::Open)
                     bid_snapshot.push_back(*order);
             }
-        }
+        });
     }
     {
-        std::shared_lock asks_lock(asks_mutex);
-        for (const auto& [price, level] : asks) {
-            for (const auto& order : level.orders) {
+        auto asks_lock = readLock(asks_mutex);
+        asks.forEach([&](int64_t, const PriceLevel& level) {
+            for (const Order* order = level.head; order; order = order->next) {
                 if (order->status == OrderStatus::Open)
                     ask_snapshot.push_back(*order);
             }
-        }
+        });
+    }
+}
+
+void OrderBook::getDepth(std::vector<DepthLevel>& bid_depth, std::vector<DepthLevel>& ask_depth) const {
+    {
+        auto bids_lock = readLock(bids_mutex);
+        bids.forEach([&](int64_t tick, const PriceLevel& level) {
+            bid_depth.push_back({ticksToPrice(tick), level.total_quantity, level.order_count});
+        });
+    }
+    {
+        auto asks_lock = readLock(asks_mutex);
+        asks.forEach([&](int64_t tick, const PriceLevel& level) {
+            ask_depth.push_back({ticksToPrice(tick), level.total_quantity, level.order_count});
+        });
     }
 }
 
-std::vector<Trade> OrderBook::getTradeHistory() const {
-    std::shared_lock trade_lock(trade_history_mutex);
-    return trade_history; // copy under lock
+DepthLevel OrderBook::getLevel(bool is_buy, int64_t price_ticks) const {
+    const PriceLevel* level = nullptr;
+    DepthLevel out{ticksToPrice(price_ticks), 0, 0};
+    if (is_buy) {
+        auto bids_lock = readLock(bids_mutex);
+        level = bids.find(price_ticks);
+        if (level) { out.quantity = level->total_quantity; out.order_count = level->order_count; }
+    } else {
+        auto asks_lock = readLock(asks_mutex);
+        level = asks.find(price_ticks);
+        if (level) { out.quantity = level->total_quantity; out.order_count = level->order_count; }
+    }
+    return out;
 }
 
 double OrderBook::getBestBidPrice() const {
-    std::shared_lock bids_lock(bids_mutex);
-    return bids.empty() ? 0.0 : bids.begin()->first;
+    return ticksToPrice(getBestBidTicks());
 }
 
 double OrderBook::getBestAskPrice() const {
-    std::shared_lock asks_lock(asks_mutex);
-    return asks.empty() ? 0.0 : asks.begin()->first;
+    return ticksToPrice(getBestAskTicks());
 }
 
-void OrderBook::matchOrders(uint64_t timestamp) {
-    if (timestamp == 0) {
-        timestamp = getUnixTimestamp();
-    }
-    // Collect trades to notify after releasing book locks
-    std::vector<Trade> to_fire;
-
-    {
-        std::unique_lock bids_lock(bids_mutex);
-        std::unique_lock asks_lock(asks_mutex);
-
-        if (bids.empty() || asks.empty()) return;
-        while (!bids.empty() && !asks.empty()) {
-            auto bid_it = bids.begin();
-            auto ask_it = asks.begin();
-            if (bid_it->first < ask_it->first) break;
-
-            auto& bid_level = bid_it->second;
-            auto& ask_level = ask_it->second;
-            if (bid_level.orders.empty()) { bids.erase(bid_it); continue; }
-            if (ask_level.orders.empty()) { asks.erase(ask_it); continue; }
-
-            Order* buy_order = bid_level.orders.front();
-            Order* sell_order = ask_level.orders.front();
-
-            uint32_t trade_qty = std::min(buy_order->quantity, sell_order->quantity);
-            double trade_price = sell_order->price;
-
-            {
-                std::unique_lock trade_lock(trade_history_mutex);
-                trade_history.push_back({buy_order->id, sell_order->id, trade_price, trade_qty, timestamp});
-            }
-            // Defer external notifications
-            to_fire.push_back({buy_order->id, sell_order->id, trade_price, trade_qty, timestamp});
-
-            buy_order->quantity -= trade_qty;
-            sell_order->quantity -= trade_qty;
+int64_t OrderBook::getBestBidTicks() const {
+    auto bids_lock = readLock(bids_mutex);
+    int64_t tick = 0;
+    return bids.bestTick(tick) ? tick : 0;
+}
 
-            if (buy_order->quantity == 0) {
-                buy_order->status = OrderStatus::Filled;
-                bid_level.id_map.erase(buy_order->id);
-                bid_level.orders.pop_front();
-                destroyOrder(buy_order);
-            }
-            if (sell_order->quantity == 0) {
-                sell_order->status = OrderStatus::Filled;
-                ask_level.id_map.erase(sell_order->id);
-                ask_level.orders.pop_front();
-                destroyOrder(sell_order);
-            }
-            if (bid_level.orders.empty()) bids.erase(bid_it);
-            if (ask_level.orders.empty()) asks.erase(ask_it);
-        }
-    } // release bids_mutex and asks_mutex
+int64_t OrderBook::getBestAskTicks() const {
+    auto asks_lock = readLock(asks_mutex);
+    int64_t tick = 0;
+    return asks.bestTick(tick) ? tick : 0;
+}
 
-    // Safe to notify; callbacks may read the book
-    for (const auto& t : to_fire) {
+// Called with no book lock held; callbacks may read the book
+void OrderBook::fireTrades(std::vector<Trade>& trades) {
+    if (trades.empty()) return;
+    if (onMatchBatch) onMatchBatch(trades.data(), trades.size());
+    for (const auto& t : trades) {
         if (onTradeEvent) onTradeEvent(t);
     }
 }
\ No newline at end of file
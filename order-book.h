@@ -2,9 +2,8 @@
 #pragma once
 
 #include <map>
-#include <list>
 #include <vector>
-#include <unordered_map>
+#include <cstddef>
 #include <cstdint>
 #include <algorithm>
 #include <shared_mutex>
@@ -12,95 +11,242 @@
 #include <chrono>
 #include <atomic>
 #include <functional>
+#include <string>
 #include "pool_allocator.h"
+#include "price_ladder.h"
+#include "order_directory.h"
+#include "trade_log.h"
 
-enum class OrderStatus { Open, Filled, Canceled, NotFound };
+enum class OrderStatus : uint8_t { Open, Filled, Canceled, NotFound };
 
-struct Order {
+struct PriceLevel;
+
+// One cache line per order. Hot fields (everything the match loop and
+// cancel path touch) come first; cold fields are only read for reporting.
+struct alignas(64) Order {
+    // Hot
+    Order* next = nullptr;          // intrusive FIFO links within the price level
+    Order* prev = nullptr;
+    PriceLevel* level = nullptr;    // level this order rests in, nullptr if not in the book
     uint64_t id;
-    double price;
+    int64_t price_ticks;
     uint32_t quantity;
     bool is_buy;
-    size_t pool_index;
     OrderStatus status = OrderStatus::Open;
+    // Cold
+    double price;
+    uint32_t owner = 0;             // account that entered the order (0 = none)
+    uint32_t client = 0;            // gateway session that owns it now (0 = none); not journaled
 };
+static_assert(offsetof(Order, price) <= 64, "Order hot fields must fit in one cache line");
 
-struct Trade {
-    uint64_t buy_order_id;
-    uint64_t sell_order_id;
+// FIFO queue of resting orders at one price, linked through the orders themselves
+struct PriceLevel {
+    Order* head = nullptr;
+    Order* tail = nullptr;
+    uint64_t total_quantity = 0;    // sum of remaining quantity of all orders in the level
+    uint32_t order_count = 0;
+
+    PriceLevel() = default;
+    PriceLevel(const PriceLevel&) = delete;
+    PriceLevel& operator=(const PriceLevel&) = delete;
+    PriceLevel(PriceLevel&& other) noexcept { *this = std::move(other); }
+    PriceLevel& operator=(PriceLevel&& other) noexcept {
+        head = other.head;
+        tail = other.tail;
+        total_quantity = other.total_quantity;
+        order_count = other.order_count;
+        other.head = other.tail = nullptr;
+        other.total_quantity = 0;
+        other.order_count = 0;
+        // Orders point back at their level; follow the move
+        for (Order* o = head; o; o = o->next) o->level = this;
+        return *this;
+    }
+
+    bool empty() const { return head == nullptr; }
+
+    void push_back(Order* order) {
+        order->next = nullptr;
+        order->prev = tail;
+        order->level = this;
+        if (tail) tail->next = order; else head = order;
+        tail = order;
+        total_quantity += order->quantity;
+        ++order_count;
+    }
+
+    void unlink(Order* order) {
+        if (order->prev) order->prev->next = order->next; else head = order->next;
+        if (order->next) order->next->prev = order->prev; else tail = order->prev;
+        total_quantity -= order->quantity;
+        --order_count;
+        order->next = order->prev = nullptr;
+        order->level = nullptr;
+    }
+};
+
+// Aggregated view of one price level
+struct DepthLevel {
     double price;
-    uint32_t quantity;
-    uint64_t timestamp;
+    uint64_t quantity;
+    uint32_t order_count;
 };
 
-struct PriceLevel {
-    std::list<Order*> orders;
-    std::unordered_map<uint64_t, std::list<Order*>::iterator> id_map;
+// GTC rests any remainder, IOC cancels it, FOK trades the whole quantity or nothing
+enum class TimeInForce : uint8_t { GTC, IOC, FOK };
+
+// One incoming order. Market orders ignore price_ticks and never rest.
+struct OrderRequest {
+    int64_t price_ticks = 0;
+    uint32_t quantity = 0;
+    bool is_buy = false;
+    bool market = false;
+    TimeInForce tif = TimeInForce::GTC;
+    uint32_t owner = 0;
+    uint32_t client = 0;
+};
+
+// Outcome of placeOrder; id is 0 if the request was rejected
+struct SubmitResult {
+    uint64_t id = 0;
+    uint32_t filled = 0;            // traded on arrival
+    uint32_t remaining = 0;         // left resting in the book
+    OrderStatus status = OrderStatus::NotFound;
+};
+
+// A price level whose aggregate quantity may have changed
+struct LevelChange {
+    int64_t price_ticks;
+    bool is_buy;
 };
 
 class OrderBook {
 public:
-    OrderBook();
+    explicit OrderBook(double tick_size = 0.01, const SlabConfig& pool_config = SlabConfig{},
+                       const DirectoryConfig& directory_config = DirectoryConfig{},
+                       const TradeLogConfig& trade_log_config = TradeLogConfig{});
     ~OrderBook();
 
     // Expose getOrderById for external access
     Order* getOrderById(uint64_t id);
 
-    // Price -> PriceLevel
-    std::map<double, PriceLevel, std::greater<double>> bids;
-    std::map<double, PriceLevel, std::less<double>> asks;
+    // Price tick -> PriceLevel (dense ladder around the mid, overflow map for outliers)
+    PriceLadder<PriceLevel, true> bids;
+    PriceLadder<PriceLevel, false> asks;
 
-    // Multiple pools for dynamic expansion
-    std::vector<PoolAllocator<Order, 1024>*> pools;
-    size_t current_pool = 0;
+    // Price grid; all book prices are integer multiples of tick_size
+    const double tick_size;
 
-    // Lookup for all orders by ID
-    std::unordered_map<uint64_t, Order*> order_lookup;
-    // Final status archive for orders that have been removed from memory (filled/canceled)
-    std::unordered_map<uint64_t, OrderStatus> final_status_archive;
+    // Order storage: chunked slab with slot reuse across chunks and per-thread caches
+    SegmentedPool<Order> order_pool;
 
-    // Trade history log
-    std::vector<Trade> trade_history;
+    // Id-indexed lookup: live order pointers plus packed final status of removed orders
+    OrderDirectory order_directory;
+
+    // Trade history: bounded in-memory ring plus optional mmap journal
+    TradeLog trade_log;
 
     mutable std::shared_mutex bids_mutex;
     mutable std::shared_mutex asks_mutex;
-    std::shared_mutex order_lookup_mutex;
-    mutable std::shared_mutex trade_history_mutex;
-    std::shared_mutex pools_mutex;
+    mutable std::shared_mutex order_lookup_mutex;
+
+    // Set when one thread (the MatchingEngine) owns the book exclusively;
+    // all internal locking is skipped. Must not change while other threads use the book.
+    bool single_writer = false;
 
     std::atomic<uint64_t> next_order_id = 1;
 
-    uint64_t submitOrder(double price, uint32_t quantity, bool is_buy);
+    // When set, every level touched by an add, removal or fill is appended to
+    // changed_levels (a level may appear more than once). The owner drains it.
+    bool track_level_changes = false;
+    std::vector<LevelChange> changed_levels;
+
+    uint64_t submitOrder(double price, uint32_t quantity, bool is_buy, uint32_t owner = 0);
     bool cancelOrder(uint64_t id);
     bool modifyOrder(uint64_t id, double new_price, uint32_t new_quantity);
+
+    // Match against the opposite side first and rest only what is left (GTC
+    // limit orders). An order that fills or dies on arrival never touches the
+    // order pool or its own side of the book; its final status is still recorded.
+    SubmitResult placeOrder(const OrderRequest& request);
+
+    // Tick-native entry points (price expressed as a count of tick_size)
+    uint64_t submitOrderTicks(int64_t price_ticks, uint32_t quantity, bool is_buy, uint32_t owner = 0);
+    // Put a previously resting order back at the tail of its level, without matching (recovery)
+    bool restoreOrder(uint64_t id, int64_t price_ticks, uint32_t quantity, bool is_buy, uint32_t owner);
+    // Same price and no larger size amends in place and keeps queue priority;
+    // anything else re-queues at the new price and matches first
+    bool modifyOrderTicks(uint64_t id, int64_t new_price_ticks, uint32_t new_quantity);
+
+    // Convert a price to ticks; false if it is not positive or not on the tick grid
+    bool priceToTicks(double price, int64_t& ticks) const;
+    double ticksToPrice(int64_t ticks) const { return static_cast<double>(ticks) * tick_size; }
     OrderStatus getOrderStatus(uint64_t id);
     void getOrderBookSnapshot(std::vector<Order>& bid_snapshot, std::vector<Order>& ask_snapshot);
-    // Return a copy to avoid exposing internal storage after releasing the lock
-    std::vector<Trade> getTradeHistory() const;
+    // Per-level aggregates, best first
+    void getDepth(std::vector<DepthLevel>& bid_depth, std::vector<DepthLevel>& ask_depth) const;
+    // Current aggregate at one level (zero quantity if the level is gone)
+    DepthLevel getLevel(bool is_buy, int64_t price_ticks) const;
+    // Visit trades with seq > since_seq, oldest first, at most limit; fn(const Trade&).
+    // Lock-free and safe from any thread while matching continues.
+    template <typename F>
+    size_t forEachTrade(uint64_t since_seq, size_t limit, F&& fn) const {
+        return trade_log.forEach(since_seq, limit, std::forward<F>(fn));
+    }
+    uint64_t lastTradeSeq() const { return trade_log.lastSeq(); }
+    // Append every trade to a memory-mapped journal at path (call before trading starts)
+    bool openTradeJournal(const std::string& path) { return trade_log.openJournal(path); }
 
     // Fast best price accessors (avoid full snapshots for simple queries)
     double getBestBidPrice() const;
     double getBestAskPrice() const;
+    // Best prices in ticks; 0 when the side is empty
+    int64_t getBestBidTicks() const;
+    int64_t getBestAskTicks() const;
 
     // Trade event callback (broadcast individual trade details externally)
     std::function<void(const Trade&)> onTradeEvent = nullptr;
+    // Every trade of one match pass (one submit or modify), delivered in a single call
+    std::function<void(const Trade* trades, size_t count)> onMatchBatch = nullptr;
 
     void removeOrderFromBook(Order* order);
     void destroyOrder(Order* order);
 
-    // Helper to get current Unix timestamp
-    uint64_t getUnixTimestamp() const;
+    // Trade timestamp: ns since the Unix epoch from the engine clock (a few ns per read)
+    uint64_t getTimestampNs() const;
 
     // Generate a unique order ID
     uint64_t generateOrderId();
 
-    // Create a new order using the latest pool allocator
-    Order* createOrder(uint64_t id, double price, uint32_t quantity, bool is_buy);
+    // Occupancy / fragmentation of the order pool
+    SlabStats getPoolStats() const { return order_pool.stats(); }
 
-    // Match orders (simple matching engine)
-    void matchOrders(uint64_t timestamp = 0);
+    // Create a new order from the order pool
+    Order* createOrder(uint64_t id, int64_t price_ticks, uint32_t quantity, bool is_buy, uint32_t owner = 0, uint32_t client = 0);
 
 private:
-    
+    void addOrderToBook(Order* order);
+    // Insert into its side with the side lock already held
+    void restOrder(Order* order);
+    // Trade an incoming order against `side` while it crosses; caller holds both side locks.
+    // Returns the quantity filled.
+    template <typename Side>
+    uint32_t fillIncoming(Side& side, uint64_t id, const OrderRequest& request, uint64_t timestamp, std::vector<Trade>& to_fire);
+    // Opposite-side quantity the request could trade right now, counted up to its own quantity
+    template <typename Side>
+    uint64_t availableFor(const Side& side, const OrderRequest& request) const;
+    void fireTrades(std::vector<Trade>& trades);
+    void noteLevelChange(bool is_buy, int64_t price_ticks) {
+        if (track_level_changes) changed_levels.push_back({price_ticks, is_buy});
+    }
+
+    // Lock helpers that degrade to no-ops in single-writer mode
+    std::unique_lock<std::shared_mutex> writeLock(std::shared_mutex& m) const {
+        return single_writer ? std::unique_lock<std::shared_mutex>(m, std::defer_lock) : std::unique_lock<std::shared_mutex>(m);
+    }
+    std::shared_lock<std::shared_mutex> readLock(std::shared_mutex& m) const {
+        return single_writer ? std::shared_lock<std::shared_mutex>(m, std::defer_lock) : std::shared_lock<std::shared_mutex>(m);
+    }
 };
 
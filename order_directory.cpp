@@ -0,0 +1,176 @@
+#include "order_directory.h"
+#include "order-book.h"
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+OrderDirectory::OrderDirectory(const DirectoryConfig& config) : m_config(config) {
+    if (!m_config.spill_path.empty()) {
+        m_spill_fd = ::open(m_config.spill_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        // Spilling is best effort; without a file every page simply stays resident
+    }
+}
+
+OrderDirectory::~OrderDirectory() {
+    if (m_spill_fd >= 0) ::close(m_spill_fd);
+}
+
+uint8_t OrderDirectory::rawState(uint64_t id) const {
+    if (id < m_config.id_base) return kUnknown;
+    id -= m_config.id_base;
+    uint64_t page_no = id >> kPageBits;
+    if (page_no >= m_pages.size() || !m_pages[page_no]) return kUnknown;
+    const Page& page = *m_pages[page_no];
+    size_t slot = id & (kPageSize - 1);
+    uint8_t byte = 0;
+    if (page.status) {
+        byte = page.status[slot / 4];
+    } else if (m_spill_fd < 0 || ::pread(m_spill_fd, &byte, 1, static_cast<off_t>(page_no * kStatusBytes + slot / 4)) != 1) {
+        return kUnknown;
+    }
+    return (byte >> ((slot % 4) * 2)) & 3;
+}
+
+void OrderDirectory::setState(Page& page, size_t slot, uint8_t state) {
+    uint8_t& byte = page.status[slot / 4];
+    unsigned shift = (slot % 4) * 2;
+    byte = static_cast<uint8_t>((byte & ~(3u << shift)) | (state << shift));
+}
+
+OrderDirectory::Page& OrderDirectory::pageFor(uint64_t id) {
+    uint64_t page_no = id >> kPageBits;
+    if (page_no >= m_pages.size()) m_pages.resize(page_no + 1);
+    auto& page = m_pages[page_no];
+    if (!page) {
+        page = std::make_unique<Page>();
+        page->status = std::make_unique<uint8_t[]>(kStatusBytes);
+    }
+    return *page;
+}
+
+OrderStatus OrderDirectory::status(uint64_t id) const {
+    switch (rawState(id)) {
+    case kLive: {
+        const Order* order = find(id);
+        return order ? order->status : OrderStatus::NotFound;
+    }
+    case kFilled: return OrderStatus::Filled;
+    case kCanceled: return OrderStatus::Canceled;
+    default: return OrderStatus::NotFound;
+    }
+}
+
+void OrderDirectory::insert(uint64_t id, Order* order) {
+    if (id < m_config.id_base) return;
+    id -= m_config.id_base;
+    Page& page = pageFor(id);
+    if (!page.status) return; // page already spilled; ids are never reused
+    if (!page.live) page.live = std::make_unique<Order*[]>(kPageSize);
+    size_t slot = id & (kPageSize - 1);
+    if (!page.live[slot]) {
+        ++page.live_count;
+        ++page.assigned;
+        ++m_live;
+    }
+    page.live[slot] = order;
+    setState(page, slot, kLive);
+}
+
+void OrderDirectory::finish(uint64_t id, OrderStatus final_status) {
+    if (id < m_config.id_base) return;
+    id -= m_config.id_base;
+    uint64_t page_no = id >> kPageBits;
+    if (page_no >= m_pages.size() || !m_pages[page_no]) return;
+    Page& page = *m_pages[page_no];
+    if (!page.status || !page.live) return;
+    size_t slot = id & (kPageSize - 1);
+    if (!page.live[slot]) return;
+    page.live[slot] = nullptr;
+    setState(page, slot, final_status == OrderStatus::Filled ? kFilled : kCanceled);
+    --m_live;
+    ++m_finished;
+    if (--page.live_count == 0) {
+        page.live.reset(); // nothing live left: keep only the status bits
+        if (m_spill_fd >= 0 && page.assigned == kPageSize) {
+            m_complete_pages.push_back(page_no);
+            maybeSpill();
+        }
+    }
+}
+
+void OrderDirectory::retire(uint64_t id, OrderStatus final_status) {
+    if (id < m_config.id_base) return;
+    id -= m_config.id_base;
+    uint64_t page_no = id >> kPageBits;
+    Page& page = pageFor(id);
+    if (!page.status) return;
+    size_t slot = id & (kPageSize - 1);
+    if ((page.status[slot / 4] >> ((slot % 4) * 2)) & 3) return; // already known
+    setState(page, slot, final_status == OrderStatus::Filled ? kFilled : kCanceled);
+    ++page.assigned;
+    ++m_finished;
+    if (page.live_count == 0 && m_spill_fd >= 0 && page.assigned == kPageSize) {
+        m_complete_pages.push_back(page_no);
+        maybeSpill();
+    }
+}
+
+void OrderDirectory::maybeSpill() {
+    if (m_spill_fd < 0) return;
+    while (m_complete_pages.size() > m_config.resident_pages) {
+        size_t page_no = m_complete_pages.front();
+        Page& page = *m_pages[page_no];
+        ssize_t n = ::pwrite(m_spill_fd, page.status.get(), kStatusBytes, static_cast<off_t>(page_no * kStatusBytes));
+        if (n != static_cast<ssize_t>(kStatusBytes)) return; // keep it resident and retry later
+        page.status.reset();
+        m_complete_pages.pop_front();
+        ++m_spilled_pages;
+    }
+}
+
+void OrderDirectory::exportStatus(std::vector<uint8_t>& out) const {
+    out.assign(m_pages.size() * kStatusBytes, 0);
+    for (size_t page_no = 0; page_no < m_pages.size(); ++page_no) {
+        const Page* page = m_pages[page_no].get();
+        if (!page) continue;
+        uint8_t* dst = out.data() + page_no * kStatusBytes;
+        if (page->status) {
+            std::memcpy(dst, page->status.get(), kStatusBytes);
+        } else if (m_spill_fd < 0 || ::pread(m_spill_fd, dst, kStatusBytes, static_cast<off_t>(page_no * kStatusBytes)) != static_cast<ssize_t>(kStatusBytes)) {
+            std::memset(dst, 0, kStatusBytes);
+            continue;
+        }
+        // Clear live states (01): they are restored with the orders themselves
+        for (size_t i = 0; i < kStatusBytes; ++i) {
+            uint8_t live = dst[i] & static_cast<uint8_t>(~(dst[i] >> 1)) & 0x55;
+            dst[i] &= static_cast<uint8_t>(~live);
+        }
+    }
+}
+
+void OrderDirectory::importStatus(const uint8_t* data, size_t size) {
+    size_t pages = size / kStatusBytes;
+    for (size_t page_no = 0; page_no < pages; ++page_no) {
+        const uint8_t* src = data + page_no * kStatusBytes;
+        uint32_t assigned = 0;
+        for (size_t i = 0; i < kStatusBytes; ++i) assigned += __builtin_popcount((src[i] | (src[i] >> 1)) & 0x55);
+        if (!assigned) continue;
+        Page& page = pageFor(static_cast<uint64_t>(page_no) << kPageBits);
+        std::memcpy(page.status.get(), src, kStatusBytes);
+        page.assigned = assigned;
+        m_finished += assigned;
+        if (m_spill_fd >= 0 && assigned == kPageSize) m_complete_pages.push_back(page_no);
+    }
+    maybeSpill();
+}
+
+size_t OrderDirectory::memoryBytes() const {
+    size_t bytes = m_pages.capacity() * sizeof(m_pages[0]);
+    for (const auto& page : m_pages) {
+        if (!page) continue;
+        bytes += sizeof(Page);
+        if (page->status) bytes += kStatusBytes;
+        if (page->live) bytes += kPageSize * sizeof(Order*);
+    }
+    return bytes;
+}
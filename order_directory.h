@@ -0,0 +1,114 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+struct Order;
+enum class OrderStatus : uint8_t;
+
+struct DirectoryConfig {
+    std::string spill_path;        // file for finished status pages; empty disables spilling
+    size_t resident_pages = 256;   // fully finished pages kept in memory before spilling (when enabled)
+    uint64_t id_base = 0;          // first id this directory covers; lower ids are unknown
+};
+
+// Id-indexed directory of every order the book has seen.
+//
+// Ids are dense and monotonic from id_base, so each id maps to page
+// ((id - id_base) >> kPageBits) and a slot within it. A page holds a packed
+// 2-bit state per id (unknown / live / filled / canceled) and, while any of
+// its orders is still live, an array of Order pointers. Pointer arrays are
+// freed as soon as a page has no live orders, leaving 1 KiB of status bits
+// per 4096 ids. Old fully finished pages can be written to spill_path and
+// dropped from memory; lookups then read the status byte back from the file.
+// A page only spills once all its ids are finished, so the book retires
+// every id it hands out, including ids burned by a rejected submit.
+//
+// Live entries are Order pointers rather than pool slot indices: SegmentedPool
+// maps and unmaps chunks on demand, so it has no stable index space, and a
+// pointer saves a chunk-table load on every lookup.
+class OrderDirectory {
+public:
+    static constexpr unsigned kPageBits = 12;
+    static constexpr size_t kPageSize = size_t{1} << kPageBits;
+
+    explicit OrderDirectory(const DirectoryConfig& config = DirectoryConfig{});
+    ~OrderDirectory();
+
+    OrderDirectory(const OrderDirectory&) = delete;
+    OrderDirectory& operator=(const OrderDirectory&) = delete;
+
+    // Live order for id, or nullptr once it has finished (or was never seen)
+    Order* find(uint64_t id) const {
+        if (id < m_config.id_base) return nullptr;
+        id -= m_config.id_base;
+        uint64_t page = id >> kPageBits;
+        if (page >= m_pages.size() || !m_pages[page] || !m_pages[page]->live) return nullptr;
+        return m_pages[page]->live[id & (kPageSize - 1)];
+    }
+
+    // Current status: live orders report their own status field
+    OrderStatus status(uint64_t id) const;
+
+    bool contains(uint64_t id) const { return rawState(id) != kUnknown; }
+
+    // Register a newly created (live) order
+    void insert(uint64_t id, Order* order);
+
+    // Order left the book: drop its pointer and remember how it ended
+    void finish(uint64_t id, OrderStatus final_status);
+    // Order that filled or died on arrival and never rested: record only how it ended
+    void retire(uint64_t id, OrderStatus final_status);
+
+    size_t liveCount() const { return m_live; }
+    size_t finishedCount() const { return m_finished; }
+    size_t spilledPages() const { return m_spilled_pages; }
+    // Approximate heap footprint of the directory itself
+    size_t memoryBytes() const;
+
+    // Final status of every finished id as packed 2-bit pages (kStatusBytes per
+    // page, spilled pages read back); live ids read as unknown
+    void exportStatus(std::vector<uint8_t>& out) const;
+    // Load exportStatus output into an empty directory. Live orders are
+    // re-inserted afterwards by whoever restores the book.
+    void importStatus(const uint8_t* data, size_t size);
+
+    // Visit every live order in id order: fn(Order*)
+    template <typename F>
+    void forEachLive(F&& fn) const {
+        for (const auto& page : m_pages) {
+            if (!page || !page->live) continue;
+            for (size_t i = 0; i < kPageSize; ++i) {
+                if (page->live[i]) fn(page->live[i]);
+            }
+        }
+    }
+
+private:
+    enum State : uint8_t { kUnknown = 0, kLive = 1, kFilled = 2, kCanceled = 3 };
+    static constexpr size_t kStatusBytes = kPageSize / 4;
+
+    struct Page {
+        std::unique_ptr<uint8_t[]> status;   // 2 bits per id; nullptr once spilled
+        std::unique_ptr<Order*[]> live;      // nullptr when no order in the page is live
+        uint32_t live_count = 0;
+        uint32_t assigned = 0;               // ids in this page seen so far
+    };
+
+    uint8_t rawState(uint64_t id) const;
+    void setState(Page& page, size_t slot, uint8_t state);
+    Page& pageFor(uint64_t id);
+    void maybeSpill();
+
+    DirectoryConfig m_config;
+    std::vector<std::unique_ptr<Page>> m_pages;
+    size_t m_live = 0;
+    size_t m_finished = 0;
+    std::deque<size_t> m_complete_pages; // resident pages with every id finished, oldest first
+    size_t m_spilled_pages = 0;
+    int m_spill_fd = -1;
+};
@@ -0,0 +1,74 @@
+#include "pnl_tracker.h"
+#include <algorithm>
+
+void PnLTracker::applyFill(bool is_buy, uint32_t qty, double px) {
+    int64_t pos = position;
+    double avg = avg_cost;
+    if (pos == 0) avg = 0.0; // reset anchor
+    if (is_buy) {
+        if (pos < 0) { // covering short
+            uint32_t closing = std::min<uint32_t>(qty, static_cast<uint32_t>(-pos));
+            realized_pnl += (avg - px) * closing; // short profit if avg>px
+            pos += closing; // less negative
+            uint32_t opening = qty - closing;
+            if (opening > 0) { pos += opening; avg = px; }
+            else if (pos == 0) avg = 0.0;
+        } else { // adding / starting long
+            int64_t new_pos = pos + qty;
+            avg = (pos > 0) ? ((avg * pos) + (px * qty)) / new_pos : px;
+            pos = new_pos;
+        }
+    } else { // sell side
+        if (pos > 0) { // reducing long
+            uint32_t closing = std::min<uint32_t>(qty, static_cast<uint32_t>(pos));
+            realized_pnl += (px - avg) * closing; // long profit if px>avg
+            pos -= closing;
+            uint32_t opening = qty - closing;
+            if (opening > 0) { pos -= opening; avg = px; }
+            else if (pos == 0) avg = 0.0;
+        } else { // adding / starting short
+            uint64_t absPos = static_cast<uint64_t>(-pos);
+            uint64_t new_abs = absPos + qty;
+            avg = (absPos > 0) ? ((avg * absPos) + (px * qty)) / new_abs : px;
+            pos -= qty;
+        }
+    }
+    position = pos;
+    avg_cost = avg;
+}
+
+void PnLTracker::addOpen(bool is_buy, double price, uint32_t remaining) {
+    ++open_orders;
+    if (is_buy) {
+        open_buy_qty += remaining;
+        open_buy_notional += price * remaining;
+    } else {
+        open_sell_qty += remaining;
+        open_sell_notional += price * remaining;
+    }
+}
+
+void PnLTracker::removeOpen(bool is_buy, double price, uint32_t remaining) {
+    if (open_orders) --open_orders;
+    if (is_buy) {
+        open_buy_qty -= std::min<uint64_t>(open_buy_qty, remaining);
+        open_buy_notional -= price * remaining;
+        if (open_buy_qty == 0) open_buy_notional = 0.0; // drop accumulated rounding
+    } else {
+        open_sell_qty -= std::min<uint64_t>(open_sell_qty, remaining);
+        open_sell_notional -= price * remaining;
+        if (open_sell_qty == 0) open_sell_notional = 0.0;
+    }
+}
+
+double PnLTracker::unrealized(double mark, double best_bid, double best_ask) const {
+    double pnl = 0.0;
+    // Inventory component
+    if (position != 0 && avg_cost > 0 && mark > 0) {
+        pnl += (mark - avg_cost) * position;
+    }
+    // Open order component: sum((ask - price) * qty) for buys, sum((price - bid) * qty) for sells
+    if (best_ask > 0) pnl += best_ask * open_buy_qty - open_buy_notional;
+    if (best_bid > 0) pnl += open_sell_notional - best_bid * open_sell_qty;
+    return pnl;
+}
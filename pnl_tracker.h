@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+
+// Running position and risk aggregates for one client.
+//
+// Everything needed for PnL is kept as a running total and updated on fills,
+// order rests, cancels and modifies, so valuing the client is O(1) given a
+// mark price and the top of book.
+struct PnLTracker {
+    int64_t position = 0;           // net position (>0 long, <0 short)
+    double avg_cost = 0.0;          // average entry cost for current absolute position
+    double realized_pnl = 0.0;
+
+    // Resting orders: count, remaining quantity and price * remaining per side
+    uint32_t open_orders = 0;
+    uint64_t open_buy_qty = 0;
+    uint64_t open_sell_qty = 0;
+    double open_buy_notional = 0.0;
+    double open_sell_notional = 0.0;
+
+    // Execution of qty at px on the given side: updates position, avg cost and realized PnL
+    void applyFill(bool is_buy, uint32_t qty, double px);
+
+    // An order starts / stops resting with `remaining` at `price`
+    void addOpen(bool is_buy, double price, uint32_t remaining);
+    void removeOpen(bool is_buy, double price, uint32_t remaining);
+
+    // Inventory marked at mark, plus the edge of resting orders against the
+    // opposite best price (buys vs best ask, sells vs best bid). Zero prices are skipped.
+    double unrealized(double mark, double best_bid, double best_ask) const;
+};
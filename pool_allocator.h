@@ -8,6 +8,14 @@
 #include <string>
 #include <new>
 #include <type_traits>
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <algorithm>
+#include <unordered_map>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
 
 struct DummyMutex {
     void lock() {}
@@ -20,7 +28,8 @@ public:
     PoolAllocator() {
         // Ensure proper alignment
         static_assert(sizeof(T) >= sizeof(void*), "Type T must be at least pointer-sized");
-        static_assert(alignof(T) <= alignof(std::max_align_t), "Type T alignment too large");
+        // Over-aligned types (e.g. cache-line aligned) are handled by the aligned new below
+        static_assert((alignof(T) & (alignof(T) - 1)) == 0, "Type T alignment must be a power of two");
         
         m_pool = new(std::align_val_t{alignof(T)}) char[N * sizeof(T)];
         for (size_t i = 0; i < N - 1; ++i) {
@@ -129,3 +138,342 @@ private:
     mutable size_t m_destructions = 0;
     #endif
 };
+
+// Tuning for SegmentedPool.
+struct SlabConfig {
+    size_t chunk_bytes = size_t{1} << 17;  // bytes per chunk, power of two (chunk header included)
+    bool huge_pages = false;               // back chunks with huge pages when available (Linux, chunk_bytes >= 2 MiB)
+    size_t high_water_chunks = 16;         // completely empty chunks kept in reserve; extra ones are returned
+    size_t thread_cache_slots = 64;        // slots each thread caches before flushing back to the chunks
+};
+
+struct SlabStats {
+    size_t chunks = 0;
+    size_t huge_page_chunks = 0;
+    size_t empty_chunks = 0;
+    size_t capacity = 0;       // total slots across all chunks
+    size_t in_use = 0;         // slots handed out to callers
+    size_t cached = 0;         // free slots parked in thread caches
+    size_t free = 0;           // free slots on chunk free lists
+    size_t chunks_released = 0;
+    double occupancy = 0.0;      // in_use / capacity
+    double fragmentation = 0.0;  // share of free capacity stranded in partially used chunks
+};
+
+// Growable slab allocator built from fixed-size chunks.
+//
+// Every chunk keeps its own free list and chunks with free slots are linked
+// together, so a slot freed in any chunk is reused before the pool grows.
+// Allocation and deallocation go through a per-thread cache of slots and take
+// no lock; the shared chunk lists are touched (under a mutex) only to refill or
+// flush a cache in batches. Chunks that become completely empty are unmapped
+// once more than high_water_chunks of them are idle.
+template <typename T>
+class SegmentedPool {
+    struct ChunkHeader {
+        uint64_t magic;
+        ChunkHeader* prev;     // links in the list of chunks that have free slots
+        ChunkHeader* next;
+        void* free_head;
+        size_t free_count;
+        bool in_list;
+        bool huge;
+    };
+    static constexpr uint64_t kChunkMagic = 0x5345475f504f4f4cULL; // "SEG_POOL"
+    static constexpr size_t kHeaderBytes = (sizeof(ChunkHeader) + alignof(T) - 1) / alignof(T) * alignof(T);
+
+    struct ThreadCache {
+        std::vector<void*> slots;
+        std::atomic<size_t> in_use{0};  // written by the owning thread only
+    };
+
+public:
+    explicit SegmentedPool(const SlabConfig& config = SlabConfig{})
+        : m_config(config), m_uid(nextUid()) {
+        static_assert(sizeof(T) >= sizeof(void*), "Type T must be at least pointer-sized");
+        static_assert((alignof(T) & (alignof(T) - 1)) == 0, "Type T alignment must be a power of two");
+        if (m_config.chunk_bytes & (m_config.chunk_bytes - 1)) m_config.chunk_bytes = size_t{1} << 17;
+        m_slots_per_chunk = (m_config.chunk_bytes - kHeaderBytes) / sizeof(T);
+        if (m_slots_per_chunk == 0) {
+            m_config.chunk_bytes = size_t{1} << 17;
+            m_slots_per_chunk = (m_config.chunk_bytes - kHeaderBytes) / sizeof(T);
+        }
+        if (m_config.thread_cache_slots < 2) m_config.thread_cache_slots = 2;
+        std::lock_guard<std::mutex> lk(registryMutex());
+        registry()[m_uid] = this;
+    }
+
+    ~SegmentedPool() {
+        {
+            std::lock_guard<std::mutex> lk(registryMutex());
+            registry().erase(m_uid);
+        }
+        std::lock_guard<std::mutex> lk(m_mutex);
+        for (ChunkHeader* chunk : m_chunks) releaseChunk(chunk);
+        for (ThreadCache* cache : m_caches) delete cache;
+    }
+
+    SegmentedPool(const SegmentedPool&) = delete;
+    SegmentedPool& operator=(const SegmentedPool&) = delete;
+
+    T* allocate() {
+        ThreadCache* cache = localCache();
+        if (cache->slots.empty()) refill(cache);
+        if (cache->slots.empty()) return nullptr;
+        void* slot = cache->slots.back();
+        cache->slots.pop_back();
+        cache->in_use.store(cache->in_use.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return static_cast<T*>(slot);
+    }
+
+    void deallocate(T* ptr) {
+        if (!ptr || !owns(ptr)) return;
+        ThreadCache* cache = localCache();
+        cache->slots.push_back(ptr);
+        cache->in_use.store(cache->in_use.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+        if (cache->slots.size() >= m_config.thread_cache_slots) flush(cache, m_config.thread_cache_slots / 2);
+    }
+
+    template<typename... Args>
+    T* construct(Args&&... args) {
+        T* ptr = allocate();
+        if (ptr) new(ptr) T(std::forward<Args>(args)...);
+        return ptr;
+    }
+
+    void destroy(T* ptr) {
+        if (ptr && owns(ptr)) {
+            ptr->~T();
+            deallocate(ptr);
+        }
+    }
+
+    // True if ptr is a slot handed out by this pool (ptr must point into some SegmentedPool chunk)
+    bool owns(const T* ptr) const {
+        const ChunkHeader* chunk = chunkOf(ptr);
+        if (chunk->magic != kChunkMagic) return false;
+        const char* base = reinterpret_cast<const char*>(chunk) + kHeaderBytes;
+        const char* p = reinterpret_cast<const char*>(ptr);
+        return p >= base && p < base + m_slots_per_chunk * sizeof(T) && (p - base) % sizeof(T) == 0;
+    }
+
+    size_t slotsPerChunk() const { return m_slots_per_chunk; }
+
+    SlabStats stats() const {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        SlabStats s;
+        s.chunks = m_chunks.size();
+        s.capacity = s.chunks * m_slots_per_chunk;
+        s.chunks_released = m_chunks_released;
+        size_t stranded = 0;
+        for (const ChunkHeader* chunk : m_chunks) {
+            if (chunk->huge) ++s.huge_page_chunks;
+            s.free += chunk->free_count;
+            if (chunk->free_count == m_slots_per_chunk) ++s.empty_chunks;
+            else stranded += chunk->free_count;
+        }
+        long long in_use = 0;
+        for (const ThreadCache* cache : m_caches) {
+            in_use += static_cast<long long>(cache->in_use.load(std::memory_order_relaxed));
+        }
+        s.in_use = in_use > 0 ? static_cast<size_t>(in_use) : 0;
+        s.cached = s.capacity - s.free > s.in_use ? s.capacity - s.free - s.in_use : 0;
+        s.occupancy = s.capacity ? static_cast<double>(s.in_use) / s.capacity : 0.0;
+        size_t idle = s.capacity - s.in_use;
+        s.fragmentation = idle ? static_cast<double>(stranded) / idle : 0.0;
+        return s;
+    }
+
+private:
+    // One-entry fast path in front of a per-thread map of caches keyed by pool uid.
+    // Uids are never reused, so entries left behind by destroyed pools are never hit.
+    struct LocalCaches {
+        uint64_t last_uid = 0;
+        ThreadCache* last = nullptr;
+        std::unordered_map<uint64_t, ThreadCache*> by_uid;
+        ~LocalCaches() {
+            // Hand cached slots back to pools that are still alive
+            std::lock_guard<std::mutex> lk(registryMutex());
+            for (auto& [uid, cache] : by_uid) {
+                auto it = registry().find(uid);
+                if (it != registry().end()) it->second->flush(cache, 0);
+            }
+        }
+    };
+
+    ThreadCache* localCache() {
+        static thread_local LocalCaches tl;
+        if (tl.last_uid == m_uid) return tl.last;
+        auto it = tl.by_uid.find(m_uid);
+        ThreadCache* cache;
+        if (it != tl.by_uid.end()) {
+            cache = it->second;
+        } else {
+            cache = new ThreadCache();
+            cache->slots.reserve(m_config.thread_cache_slots);
+            {
+                std::lock_guard<std::mutex> lk(m_mutex);
+                m_caches.push_back(cache);
+            }
+            tl.by_uid[m_uid] = cache;
+        }
+        tl.last_uid = m_uid;
+        tl.last = cache;
+        return cache;
+    }
+
+    void refill(ThreadCache* cache) {
+        size_t want = m_config.thread_cache_slots / 2;
+        std::lock_guard<std::mutex> lk(m_mutex);
+        while (cache->slots.size() < want) {
+            if (!m_partial && !addChunk()) break;
+            ChunkHeader* chunk = m_partial;
+            if (chunk->free_count == m_slots_per_chunk) --m_empty_chunks;
+            while (chunk->free_head && cache->slots.size() < want) {
+                void* slot = chunk->free_head;
+                chunk->free_head = *static_cast<void**>(slot);
+                --chunk->free_count;
+                cache->slots.push_back(slot);
+            }
+            if (!chunk->free_head) unlinkPartial(chunk);
+        }
+    }
+
+    // Return cached slots to their chunks until only keep remain
+    void flush(ThreadCache* cache, size_t keep) {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        while (cache->slots.size() > keep) {
+            void* slot = cache->slots.back();
+            cache->slots.pop_back();
+            ChunkHeader* chunk = chunkOf(static_cast<T*>(slot));
+            *static_cast<void**>(slot) = chunk->free_head;
+            chunk->free_head = slot;
+            ++chunk->free_count;
+            if (!chunk->in_list) linkPartialFront(chunk);
+            if (chunk->free_count == m_slots_per_chunk) {
+                // Fully idle: park at the back so allocation drains busier chunks first
+                unlinkPartial(chunk);
+                linkPartialBack(chunk);
+                ++m_empty_chunks;
+                if (m_empty_chunks > m_config.high_water_chunks) trimEmptyChunks();
+            }
+        }
+    }
+
+    bool addChunk() {
+        ChunkHeader* chunk = mapChunk();
+        if (!chunk) return false;
+        char* base = reinterpret_cast<char*>(chunk) + kHeaderBytes;
+        chunk->magic = kChunkMagic;
+        chunk->prev = chunk->next = nullptr;
+        chunk->in_list = false;
+        chunk->free_head = nullptr;
+        for (size_t i = m_slots_per_chunk; i-- > 0;) {
+            void* slot = base + i * sizeof(T);
+            *static_cast<void**>(slot) = chunk->free_head;
+            chunk->free_head = slot;
+        }
+        chunk->free_count = m_slots_per_chunk;
+        m_chunks.push_back(chunk);
+        linkPartialFront(chunk);
+        ++m_empty_chunks;
+        return true;
+    }
+
+    // Drop idle chunks from the back of the list down to the high-water mark
+    void trimEmptyChunks() {
+        ChunkHeader* chunk = m_partial_tail;
+        while (chunk && m_empty_chunks > m_config.high_water_chunks) {
+            ChunkHeader* prev = chunk->prev;
+            if (chunk->free_count == m_slots_per_chunk) {
+                unlinkPartial(chunk);
+                m_chunks.erase(std::find(m_chunks.begin(), m_chunks.end(), chunk));
+                releaseChunk(chunk);
+                --m_empty_chunks;
+                ++m_chunks_released;
+            }
+            chunk = prev;
+        }
+    }
+
+    ChunkHeader* mapChunk() {
+        const size_t bytes = m_config.chunk_bytes;
+#if defined(__linux__) && defined(MAP_HUGETLB)
+        if (m_config.huge_pages && bytes >= (size_t{2} << 20)) {
+            void* mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (mem != MAP_FAILED) {
+                if ((reinterpret_cast<uintptr_t>(mem) & (bytes - 1)) == 0) {
+                    auto* chunk = static_cast<ChunkHeader*>(mem);
+                    chunk->huge = true;
+                    return chunk;
+                }
+                munmap(mem, bytes); // not aligned to the chunk size; fall back to regular pages
+            }
+        }
+#endif
+        void* mem = operator new(bytes, std::align_val_t{bytes}, std::nothrow);
+        if (!mem) return nullptr;
+        auto* chunk = static_cast<ChunkHeader*>(mem);
+        chunk->huge = false;
+        return chunk;
+    }
+
+    void releaseChunk(ChunkHeader* chunk) {
+        chunk->magic = 0;
+#if defined(__linux__) && defined(MAP_HUGETLB)
+        if (chunk->huge) {
+            munmap(chunk, m_config.chunk_bytes);
+            return;
+        }
+#endif
+        operator delete(chunk, std::align_val_t{m_config.chunk_bytes});
+    }
+
+    ChunkHeader* chunkOf(const T* ptr) const {
+        return reinterpret_cast<ChunkHeader*>(reinterpret_cast<uintptr_t>(ptr) & ~(uintptr_t)(m_config.chunk_bytes - 1));
+    }
+
+    void linkPartialFront(ChunkHeader* chunk) {
+        chunk->prev = nullptr;
+        chunk->next = m_partial;
+        if (m_partial) m_partial->prev = chunk; else m_partial_tail = chunk;
+        m_partial = chunk;
+        chunk->in_list = true;
+    }
+    void linkPartialBack(ChunkHeader* chunk) {
+        chunk->next = nullptr;
+        chunk->prev = m_partial_tail;
+        if (m_partial_tail) m_partial_tail->next = chunk; else m_partial = chunk;
+        m_partial_tail = chunk;
+        chunk->in_list = true;
+    }
+    void unlinkPartial(ChunkHeader* chunk) {
+        if (!chunk->in_list) return;
+        if (chunk->prev) chunk->prev->next = chunk->next; else m_partial = chunk->next;
+        if (chunk->next) chunk->next->prev = chunk->prev; else m_partial_tail = chunk->prev;
+        chunk->prev = chunk->next = nullptr;
+        chunk->in_list = false;
+    }
+
+    static uint64_t nextUid() {
+        static std::atomic<uint64_t> uid{1};
+        return uid.fetch_add(1);
+    }
+    static std::mutex& registryMutex() { static std::mutex m; return m; }
+    static std::unordered_map<uint64_t, SegmentedPool*>& registry() {
+        static std::unordered_map<uint64_t, SegmentedPool*> r;
+        return r;
+    }
+
+    SlabConfig m_config;
+    const uint64_t m_uid;
+    size_t m_slots_per_chunk = 0;
+
+    mutable std::mutex m_mutex;    // guards everything below
+    std::vector<ChunkHeader*> m_chunks;
+    std::vector<ThreadCache*> m_caches;
+    ChunkHeader* m_partial = nullptr;       // chunks with at least one free slot
+    ChunkHeader* m_partial_tail = nullptr;
+    size_t m_empty_chunks = 0;
+    size_t m_chunks_released = 0;
+};
@@ -0,0 +1,305 @@
+#pragma once
+
+#include <map>
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <algorithm>
+#include <functional>
+
+// Dense price ladder for one side of the book, keyed by integer tick.
+//
+// Levels within a window of N ticks [base, base + N) live in a ring of N
+// slots indexed by tick mod N; a two-level bitmap records which slots are
+// occupied so the best level is found with a few bit scans. Prices outside
+// the window fall back to an ordered overflow map.
+//
+// The window follows the best price: whenever the best level leaves the
+// middle half of the window, the window slides to centre on it. Sliding only
+// touches the ticks that leave and enter the window. Levels falling off the
+// far edge move to overflow, overflow levels now inside move in, and every
+// level that stays put keeps its slot. Under drifting flow inserts and
+// erases near the touch therefore stay O(1) and never allocate, and a stale
+// order far from the mid cannot pin the window.
+//
+// Level must be default constructible, movable, and expose empty(). Levels
+// move between the ring and overflow when the window slides.
+// Descending = true orders best-first from the highest tick (bids).
+template <typename Level, bool Descending, size_t N = 4096>
+class PriceLadder {
+    static_assert(N >= 64 && (N & (N - 1)) == 0 && N / 64 <= 64, "Ladder window must be a power of two from 64 to 4096 ticks");
+    static constexpr size_t kWords = N / 64;
+    static constexpr size_t kNone = SIZE_MAX;
+    static constexpr int64_t kSpan = static_cast<int64_t>(N);
+
+public:
+    PriceLadder() : slots_(N) {}
+    PriceLadder(const PriceLadder&) = delete;
+    PriceLadder& operator=(const PriceLadder&) = delete;
+
+    bool empty() const { return window_count_ == 0 && overflow_.empty(); }
+    size_t size() const { return window_count_ + overflow_.size(); }
+    size_t windowSize() const { return window_count_; }
+    size_t overflowSize() const { return overflow_.size(); }
+    int64_t windowBase() const { return base_; }
+
+    Level* find(int64_t tick) {
+        if (inWindow(tick)) {
+            size_t slot = slotOf(tick);
+            return testBit(slot) ? &slots_[slot] : nullptr;
+        }
+        auto it = overflow_.find(tick);
+        return it != overflow_.end() ? &it->second : nullptr;
+    }
+    const Level* find(int64_t tick) const { return const_cast<PriceLadder*>(this)->find(tick); }
+
+    // Return the level at tick, marking it present if it was not. A new best
+    // price outside the middle half of the window slides the window first.
+    Level& getOrCreate(int64_t tick) {
+        if (!inMiddle(tick)) {
+            int64_t best_tick = 0;
+            if (!bestTick(best_tick) || better(tick, best_tick)) recentre(tick);
+        }
+        if (inWindow(tick)) {
+            size_t slot = slotOf(tick);
+            if (!testBit(slot)) {
+                setBit(slot);
+                ++window_count_;
+            }
+            return slots_[slot];
+        }
+        return overflow_[tick];
+    }
+
+    // Drop the level at tick. The level is expected to be empty already. If
+    // the best level moves out of the middle half, the window follows it.
+    void erase(int64_t tick) {
+        if (inWindow(tick)) {
+            size_t slot = slotOf(tick);
+            if (testBit(slot)) {
+                clearBit(slot);
+                --window_count_;
+            }
+        } else {
+            overflow_.erase(tick);
+        }
+        int64_t best_tick = 0;
+        if (bestTick(best_tick) && !inMiddle(best_tick)) recentre(best_tick);
+    }
+
+    // Best level (highest for bids, lowest for asks), or nullptr if empty.
+    Level* best(int64_t* tick_out = nullptr) {
+        int64_t tick = 0;
+        Level* level = nullptr;
+        if (window_count_ > 0) {
+            // Ticks [base, base + N) sit in slots [off, N) then [0, off)
+            size_t off = slotOf(base_);
+            size_t slot = Descending ? highestIn(0, off) : lowestIn(off, N);
+            if (slot == kNone) slot = Descending ? highestIn(off, N) : lowestIn(0, off);
+            tick = tickOf(slot);
+            level = &slots_[slot];
+        }
+        if (!overflow_.empty()) {
+            auto& entry = Descending ? *overflow_.rbegin() : *overflow_.begin();
+            if (!level || better(entry.first, tick)) {
+                tick = entry.first;
+                level = &entry.second;
+            }
+        }
+        if (level && tick_out) *tick_out = tick;
+        return level;
+    }
+
+    // Best tick without exposing the level; false if the side is empty.
+    bool bestTick(int64_t& tick) const {
+        return const_cast<PriceLadder*>(this)->best(&tick) != nullptr;
+    }
+
+    // Visit every present level best-first: fn(tick, const Level&).
+    template <typename F>
+    void forEach(F&& fn) const {
+        forEachWhile([&](int64_t tick, const Level& level) { fn(tick, level); return true; });
+    }
+
+    // As forEach, stopping as soon as fn returns false. Returns false if it stopped early.
+    template <typename F>
+    bool forEachWhile(F&& fn) const {
+        const int64_t lo = base_;
+        const int64_t hi = base_ + kSpan;
+        const size_t off = anchored_ ? slotOf(base_) : 0;
+        if (Descending) {
+            for (auto it = overflow_.rbegin(); it != overflow_.rend() && it->first >= hi; ++it) {
+                if (!fn(it->first, it->second)) return false;
+            }
+            if (!visitDown(0, off, fn) || !visitDown(off, N, fn)) return false;
+            for (auto it = overflow_.lower_bound(lo); it != overflow_.begin();) {
+                --it;
+                if (!fn(it->first, it->second)) return false;
+            }
+        } else {
+            for (auto it = overflow_.begin(); it != overflow_.end() && it->first < lo; ++it) {
+                if (!fn(it->first, it->second)) return false;
+            }
+            if (!visitUp(off, N, fn) || !visitUp(0, off, fn)) return false;
+            for (auto it = overflow_.lower_bound(hi); it != overflow_.end(); ++it) {
+                if (!fn(it->first, it->second)) return false;
+            }
+        }
+        return true;
+    }
+
+    void clear() {
+        for (size_t w = 0; w < kWords; ++w) {
+            uint64_t bits = words_[w];
+            while (bits) {
+                int b = __builtin_ctzll(bits);
+                bits &= bits - 1;
+                slots_[w * 64 + static_cast<size_t>(b)] = Level{};
+            }
+            words_[w] = 0;
+        }
+        summary_ = 0;
+        window_count_ = 0;
+        overflow_.clear();
+    }
+
+    // True if a beats b for this side.
+    static bool better(int64_t a, int64_t b) { return Descending ? a > b : a < b; }
+
+private:
+    static size_t slotOf(int64_t tick) { return static_cast<size_t>(static_cast<uint64_t>(tick) & (N - 1)); }
+    int64_t tickOf(size_t slot) const {
+        return base_ + static_cast<int64_t>((slot - slotOf(base_)) & (N - 1));
+    }
+
+    bool inWindow(int64_t tick) const {
+        return anchored_ && tick >= base_ && tick < base_ + kSpan;
+    }
+    bool inMiddle(int64_t tick) const {
+        return anchored_ && tick >= base_ + kSpan / 4 && tick < base_ + kSpan - kSpan / 4;
+    }
+
+    // Slide the window so tick sits in the middle. Levels on ticks that leave
+    // the window go to overflow, overflow levels on ticks that enter come in;
+    // the rest keep their slots.
+    void recentre(int64_t tick) {
+        int64_t new_base = tick - kSpan / 2;
+        if (anchored_) {
+            int64_t shift = new_base - base_;
+            if (shift == 0) return;
+            // Ticks leaving: the low end when moving up, the high end when moving down
+            int64_t gone_lo = shift > 0 ? base_ : std::max(base_, new_base + kSpan);
+            int64_t gone_hi = shift > 0 ? std::min(base_ + kSpan, new_base) : base_ + kSpan;
+            if (window_count_ > 0) {
+                for (int64_t t = gone_lo; t < gone_hi;) {
+                    size_t slot = slotOf(t);
+                    size_t w = slot / 64;
+                    size_t run = std::min<int64_t>(64 - slot % 64, gone_hi - t);
+                    uint64_t bits = (words_[w] >> (slot % 64)) & (run == 64 ? ~uint64_t{0} : (uint64_t{1} << run) - 1);
+                    while (bits) {
+                        size_t s = slot + static_cast<size_t>(__builtin_ctzll(bits));
+                        bits &= bits - 1;
+                        overflow_.emplace(t + static_cast<int64_t>(s - slot), std::move(slots_[s]));
+                        clearBit(s);
+                        --window_count_;
+                    }
+                    t += static_cast<int64_t>(run);
+                }
+            }
+        }
+        base_ = new_base;
+        anchored_ = true;
+        auto it = overflow_.lower_bound(base_);
+        while (it != overflow_.end() && it->first < base_ + kSpan) {
+            size_t slot = slotOf(it->first);
+            slots_[slot] = std::move(it->second);
+            setBit(slot);
+            ++window_count_;
+            it = overflow_.erase(it);
+        }
+    }
+
+    bool testBit(size_t slot) const { return (words_[slot / 64] >> (slot % 64)) & 1; }
+    void setBit(size_t slot) {
+        words_[slot / 64] |= uint64_t{1} << (slot % 64);
+        summary_ |= uint64_t{1} << (slot / 64);
+    }
+    void clearBit(size_t slot) {
+        words_[slot / 64] &= ~(uint64_t{1} << (slot % 64));
+        if (!words_[slot / 64]) summary_ &= ~(uint64_t{1} << (slot / 64));
+    }
+
+    // Bits of word w that fall inside slots [lo, hi)
+    static uint64_t rangeMask(size_t w, size_t lo, size_t hi) {
+        size_t first = w * 64;
+        uint64_t mask = ~uint64_t{0};
+        if (lo > first) mask &= ~uint64_t{0} << (lo - first);
+        if (hi < first + 64) mask &= (uint64_t{1} << (hi - first)) - 1;
+        return mask;
+    }
+    // Non-empty words overlapping slots [lo, hi), from the summary
+    uint64_t wordsIn(size_t lo, size_t hi) const {
+        if (lo >= hi) return 0;
+        size_t wlo = lo / 64, whi = (hi - 1) / 64;
+        uint64_t mask = (whi == 63 ? ~uint64_t{0} : (uint64_t{1} << (whi + 1)) - 1) & (~uint64_t{0} << wlo);
+        return summary_ & mask;
+    }
+    size_t highestIn(size_t lo, size_t hi) const {
+        for (uint64_t words = wordsIn(lo, hi); words;) {
+            size_t w = 63 - static_cast<size_t>(__builtin_clzll(words));
+            uint64_t bits = words_[w] & rangeMask(w, lo, hi);
+            if (bits) return w * 64 + 63 - static_cast<size_t>(__builtin_clzll(bits));
+            words &= ~(uint64_t{1} << w);
+        }
+        return kNone;
+    }
+    size_t lowestIn(size_t lo, size_t hi) const {
+        for (uint64_t words = wordsIn(lo, hi); words; words &= words - 1) {
+            size_t w = static_cast<size_t>(__builtin_ctzll(words));
+            uint64_t bits = words_[w] & rangeMask(w, lo, hi);
+            if (bits) return w * 64 + static_cast<size_t>(__builtin_ctzll(bits));
+        }
+        return kNone;
+    }
+
+    // Visit occupied slots in [lo, hi) by descending / ascending slot
+    template <typename F>
+    bool visitDown(size_t lo, size_t hi, F& fn) const {
+        for (uint64_t words = wordsIn(lo, hi); words;) {
+            size_t w = 63 - static_cast<size_t>(__builtin_clzll(words));
+            words &= ~(uint64_t{1} << w);
+            uint64_t bits = words_[w] & rangeMask(w, lo, hi);
+            while (bits) {
+                int b = 63 - __builtin_clzll(bits);
+                bits &= ~(uint64_t{1} << b);
+                size_t slot = w * 64 + static_cast<size_t>(b);
+                if (!fn(tickOf(slot), slots_[slot])) return false;
+            }
+        }
+        return true;
+    }
+    template <typename F>
+    bool visitUp(size_t lo, size_t hi, F& fn) const {
+        for (uint64_t words = wordsIn(lo, hi); words; words &= words - 1) {
+            size_t w = static_cast<size_t>(__builtin_ctzll(words));
+            uint64_t bits = words_[w] & rangeMask(w, lo, hi);
+            while (bits) {
+                int b = __builtin_ctzll(bits);
+                bits &= bits - 1;
+                size_t slot = w * 64 + static_cast<size_t>(b);
+                if (!fn(tickOf(slot), slots_[slot])) return false;
+            }
+        }
+        return true;
+    }
+
+    std::vector<Level> slots_;
+    std::array<uint64_t, kWords> words_{};
+    uint64_t summary_ = 0;
+    size_t window_count_ = 0;
+    int64_t base_ = 0;
+    bool anchored_ = false;
+    std::map<int64_t, Level> overflow_;
+};
@@ -0,0 +1,163 @@
+// Crash/recover check for the journal: a child process runs a random command
+// session against a journaled engine and is killed without stop() (so no final
+// snapshot); the parent recovers a fresh book from the data directory and
+// compares it with the same session run without a journal.
+//
+//   make test
+//
+// Runs twice: with a snapshot every 1024 commands (recovery = snapshot + WAL
+// tail) and with none (recovery = the whole WAL). Exits non-zero on a mismatch.
+
+#include "matching_engine.h"
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <sys/wait.h>
+
+static constexpr int kCommands = 20000;
+static constexpr uint32_t kAccounts = 5;
+
+// Deterministic mix of submits (all order types), batches, cancels and modifies
+static void runSession(MatchingEngine& engine) {
+    std::mt19937 rng(42);
+    std::vector<uint64_t> ids;
+    engine.onEvent = [&](const EngineEvent& ev) {
+        if (ev.type == EngineEventType::SubmitResult && ev.success) ids.push_back(ev.order_id);
+        if (ev.type == EngineEventType::SubmitBatchResult) {
+            for (const auto& item : *ev.batch) if (item.success) ids.push_back(item.order_id);
+        }
+    };
+    auto price = [&]() { return (10000 + static_cast<int>(rng() % 40) - 20) * 0.01; };
+    for (int i = 0; i < kCommands; ++i) {
+        EngineCommand c;
+        int r = rng() % 10;
+        if (r < 6 || ids.empty()) {
+            c.type = EngineCommandType::Submit;
+            c.is_buy = rng() & 1;
+            c.quantity = 1 + rng() % 20;
+            c.price = price();
+            c.account = rng() % (kAccounts + 1);
+            switch (rng() % 8) {
+            case 0: c.tif = TimeInForce::IOC; break;
+            case 1: c.tif = TimeInForce::FOK; break;
+            case 2: c.market = true; break;
+            default: break;
+            }
+        } else if (r == 6) {
+            c.type = EngineCommandType::SubmitBatch;
+            c.account = rng() % (kAccounts + 1);
+            auto orders = std::make_shared<std::vector<BatchOrder>>();
+            for (int k = 0, n = 1 + rng() % 8; k < n; ++k) {
+                BatchOrder o;
+                o.is_buy = rng() & 1;
+                o.quantity = 1 + rng() % 20;
+                o.price = price();
+                orders->push_back(o);
+            }
+            c.orders = orders;
+        } else if (r == 7) {
+            c.type = EngineCommandType::CancelBatch;
+            auto order_ids = std::make_shared<std::vector<uint64_t>>();
+            for (int k = 0; k < 5; ++k) order_ids->push_back(ids[rng() % ids.size()]);
+            c.order_ids = order_ids;
+        } else if (r == 8) {
+            c.type = EngineCommandType::Cancel;
+            c.order_id = ids[rng() % ids.size()];
+        } else {
+            c.type = EngineCommandType::Modify;
+            c.order_id = ids[rng() % ids.size()];
+            c.price = price();
+            c.quantity = 1 + rng() % 20;
+        }
+        engine.post(c);
+    }
+}
+
+// Resting orders, id allocation, trade sequence, account positions and every id's status
+static std::string describe(MatchingEngine& engine, OrderBook& book) {
+    std::ostringstream os;
+    std::vector<Order> bids, asks;
+    book.getOrderBookSnapshot(bids, asks);
+    for (const Order& o : bids) os << "B " << o.id << ' ' << o.price_ticks << ' ' << o.quantity << ' ' << o.owner << '\n';
+    for (const Order& o : asks) os << "A " << o.id << ' ' << o.price_ticks << ' ' << o.quantity << ' ' << o.owner << '\n';
+    os << "next " << book.next_order_id << " trades " << book.lastTradeSeq() << '\n';
+    std::shared_ptr<const AccountState> state;
+    engine.onEvent = [&](const EngineEvent& ev) {
+        if (ev.type == EngineEventType::AccountStateResult) state = ev.account;
+    };
+    for (uint32_t account = 1; account <= kAccounts; ++account) {
+        EngineCommand c;
+        c.type = EngineCommandType::AccountState;
+        c.account = account;
+        engine.post(c);
+        char line[160];
+        std::snprintf(line, sizeof(line), "account %u position %lld avg %.6f realized %.6f orders %zu\n", account,
+                      static_cast<long long>(state->position), state->avg_cost, state->realized_pnl, state->orders.size());
+        os << line;
+    }
+    for (uint64_t id = 1; id < book.next_order_id; ++id) os << static_cast<int>(book.getOrderStatus(id));
+    os << '\n';
+    return os.str();
+}
+
+static bool check(const char* label, std::chrono::seconds snapshot_interval) {
+    char dir[] = "/tmp/recovery_test.XXXXXX";
+    if (!::mkdtemp(dir)) {
+        std::perror("mkdtemp");
+        return false;
+    }
+    JournalConfig config;
+    config.dir = dir;
+    config.snapshot_interval = snapshot_interval;
+
+    pid_t pid = ::fork();
+    if (pid == 0) {
+        OrderBook book(0.01);
+        MatchingEngine engine(book);
+        if (!engine.openJournal(config, "TEST")) _exit(2);
+        runSession(engine);
+        // Acks do not wait for the fsync; give the last group commit time to land, then crash
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        ::raise(SIGKILL);
+        _exit(3);
+    }
+    int status = 0;
+    ::waitpid(pid, &status, 0);
+    bool ok = WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL;
+    if (!ok) std::fprintf(stderr, "%s: journaled session did not run (status %d)\n", label, status);
+
+    if (ok) {
+        OrderBook expected_book(0.01);
+        MatchingEngine expected(expected_book);
+        runSession(expected);
+
+        OrderBook recovered_book(0.01);
+        MatchingEngine recovered(recovered_book);
+        ok = recovered.openJournal(config, "TEST");
+        if (!ok) {
+            std::fprintf(stderr, "%s: recovery failed\n", label);
+        } else if (describe(recovered, recovered_book) != describe(expected, expected_book)) {
+            std::fprintf(stderr, "%s: recovered book differs from the journal-less run\n", label);
+            ok = false;
+        } else {
+            std::printf("%s: ok, %llu commands replayed\n", label, static_cast<unsigned long long>(recovered.recoveredCommands()));
+        }
+        recovered.stop();
+    }
+    std::string cleanup = std::string("rm -rf ") + dir;
+    std::system(cleanup.c_str());
+    return ok;
+}
+
+int main() {
+    bool ok = check("snapshot + wal", std::chrono::seconds(0));
+    ok = check("wal only", std::chrono::seconds(3600)) && ok;
+    return ok ? 0 : 1;
+}
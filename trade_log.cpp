@@ -0,0 +1,248 @@
+#include "trade_log.h"
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+constexpr char kJournalMagic[8] = {'T', 'R', 'D', 'J', 'R', 'N', 'L', '1'};
+constexpr size_t kHeaderBytes = 4096;
+
+// One background thread that maps journal segments ahead of their writers, shared by every log
+class SegmentMapper {
+public:
+    // Never destroyed: logs owned by static objects may be torn down after it would be
+    static SegmentMapper& instance() {
+        static SegmentMapper* mapper = new SegmentMapper;
+        return *mapper;
+    }
+
+    void request(const void* owner, std::function<void()> job) {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_jobs.push_back({owner, std::move(job)});
+        m_wake.notify_one();
+    }
+
+    // Drop owner's queued jobs and wait for one that is running
+    void cancel(const void* owner) {
+        std::unique_lock<std::mutex> lk(m_mutex);
+        for (auto it = m_jobs.begin(); it != m_jobs.end();) {
+            it = it->owner == owner ? m_jobs.erase(it) : it + 1;
+        }
+        m_done.wait(lk, [&] { return m_running != owner; });
+    }
+
+private:
+    struct Job {
+        const void* owner;
+        std::function<void()> run;
+    };
+
+    SegmentMapper() : m_thread([this] { loop(); }) {}
+
+    void loop() {
+        std::unique_lock<std::mutex> lk(m_mutex);
+        while (true) {
+            m_wake.wait(lk, [&] { return !m_jobs.empty(); });
+            Job job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+            m_running = job.owner;
+            lk.unlock();
+            job.run();
+            lk.lock();
+            m_running = nullptr;
+            m_done.notify_all();
+        }
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    std::deque<Job> m_jobs;
+    const void* m_running = nullptr;
+    std::thread m_thread; // last: starts once the rest is constructed
+};
+}
+
+struct TradeLog::Slot {
+    std::atomic<uint64_t> seq{0};   // 0 while being written
+    Trade trade{};
+};
+
+TradeLog::TradeLog(const TradeLogConfig& config) : m_config(config) {
+    size_t cap = 2;
+    while (cap < m_config.ring_capacity) cap <<= 1;
+    m_config.ring_capacity = cap;
+    m_config.segment_bytes = (m_config.segment_bytes + kHeaderBytes - 1) / kHeaderBytes * kHeaderBytes;
+    if (m_config.segment_bytes < kHeaderBytes) m_config.segment_bytes = kHeaderBytes;
+    m_records_per_segment = m_config.segment_bytes / sizeof(TradeRecord);
+    m_ring.reset(new Slot[m_config.ring_capacity]);
+}
+
+TradeLog::~TradeLog() {
+    if (m_fd >= 0) SegmentMapper::instance().cancel(this);
+    for (auto& segment : m_segments) {
+        if (TradeRecord* records = segment.load(std::memory_order_relaxed)) munmap(records, m_config.segment_bytes);
+    }
+    if (m_fd >= 0) ::close(m_fd);
+}
+
+bool TradeLog::openJournal(const std::string& path) {
+    if (m_fd >= 0 || lastSeq() != 0) return false;
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) { ::close(fd); return false; }
+    char header[kHeaderBytes] = {};
+    if (static_cast<size_t>(st.st_size) < kHeaderBytes) {
+        std::memcpy(header, kJournalMagic, sizeof(kJournalMagic));
+        uint32_t record_size = sizeof(TradeRecord);
+        std::memcpy(header + 8, &record_size, sizeof(record_size));
+        uint64_t segment_bytes = m_config.segment_bytes;
+        std::memcpy(header + 16, &segment_bytes, sizeof(segment_bytes));
+        if (::pwrite(fd, header, kHeaderBytes, 0) != static_cast<ssize_t>(kHeaderBytes)) { ::close(fd); return false; }
+    } else {
+        if (::pread(fd, header, kHeaderBytes, 0) != static_cast<ssize_t>(kHeaderBytes) ||
+            std::memcmp(header, kJournalMagic, sizeof(kJournalMagic)) != 0) {
+            ::close(fd);
+            return false;
+        }
+        // An existing journal dictates its own segment size
+        uint64_t segment_bytes = 0;
+        std::memcpy(&segment_bytes, header + 16, sizeof(segment_bytes));
+        if (segment_bytes == 0 || segment_bytes % kHeaderBytes) { ::close(fd); return false; }
+        m_config.segment_bytes = segment_bytes;
+        m_records_per_segment = m_config.segment_bytes / sizeof(TradeRecord);
+    }
+    m_fd = fd;
+    m_journal_active.store(true, std::memory_order_relaxed);
+
+    // Map existing segments and continue after the last complete record
+    size_t existing = static_cast<size_t>(st.st_size) > kHeaderBytes
+        ? (static_cast<size_t>(st.st_size) - kHeaderBytes + m_config.segment_bytes - 1) / m_config.segment_bytes : 0;
+    uint64_t last = 0;
+    for (size_t i = 0; i < existing; ++i) {
+        if (!mapSegment(i, false)) break;
+        const TradeRecord* records = m_segments[i].load(std::memory_order_relaxed);
+        for (size_t r = 0; r < m_records_per_segment; ++r) {
+            if (records[r].seq != last + 1) break;
+            last = records[r].seq;
+        }
+        if (last < (i + 1) * m_records_per_segment) break;
+    }
+    m_last_seq.store(last, std::memory_order_release);
+    return true;
+}
+
+bool TradeLog::mapSegment(size_t index, bool prefault) {
+    if (index >= kMaxSegments) return false;
+    std::lock_guard<std::mutex> lk(m_map_mutex);
+    if (m_segments[index].load(std::memory_order_relaxed)) return true;
+    off_t offset = static_cast<off_t>(kHeaderBytes + index * m_config.segment_bytes);
+    struct stat st;
+    if (fstat(m_fd, &st) != 0) return false;
+    if (st.st_size < offset + static_cast<off_t>(m_config.segment_bytes) &&
+        ftruncate(m_fd, offset + static_cast<off_t>(m_config.segment_bytes)) != 0) {
+        return false;
+    }
+    void* mem = mmap(nullptr, m_config.segment_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, offset);
+    if (mem == MAP_FAILED) return false;
+    if (prefault) {
+        // Take the write fault of every page here rather than on the first append into
+        // it (rewriting a byte leaves the content alone)
+        auto* bytes = static_cast<volatile uint8_t*>(mem);
+        for (size_t i = 0; i < m_config.segment_bytes; i += kHeaderBytes) bytes[i] = bytes[i];
+    }
+    m_segments[index].store(static_cast<TradeRecord*>(mem), std::memory_order_release);
+    return true;
+}
+
+const TradeRecord* TradeLog::recordAt(uint64_t seq) const {
+    if (m_fd < 0 || seq == 0) return nullptr;
+    uint64_t index = seq - 1;
+    size_t segment = static_cast<size_t>(index / m_records_per_segment);
+    if (segment >= kMaxSegments) return nullptr;
+    const TradeRecord* records = m_segments[segment].load(std::memory_order_acquire);
+    return records ? &records[index % m_records_per_segment] : nullptr;
+}
+
+void TradeLog::beginReplay(uint64_t seq) {
+    if (lastSeq() < seq) m_last_seq.store(seq, std::memory_order_release);
+    m_replay_seq = seq;
+    m_replaying = true;
+}
+
+uint64_t TradeLog::append(Trade& trade) {
+    if (m_replaying && ++m_replay_seq <= m_last_seq.load(std::memory_order_relaxed)) {
+        trade.seq = m_replay_seq; // already recorded before the restart
+        return m_replay_seq;
+    }
+    uint64_t seq = m_last_seq.load(std::memory_order_relaxed) + 1;
+    trade.seq = seq;
+
+    Slot& slot = m_ring[(seq - 1) & (m_config.ring_capacity - 1)];
+    slot.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.trade = trade;
+    slot.seq.store(seq, std::memory_order_release);
+
+    if (m_journal_active.load(std::memory_order_relaxed)) {
+        uint64_t index = seq - 1;
+        size_t segment = static_cast<size_t>(index / m_records_per_segment);
+        TradeRecord* records = segment < kMaxSegments ? m_segments[segment].load(std::memory_order_acquire) : nullptr;
+        // Normally mapped ahead; map inline only if the mapper has fallen behind
+        if (!records && mapSegment(segment, false)) records = m_segments[segment].load(std::memory_order_acquire);
+        if (!records) {
+            // Journal full or unwritable: keep trading on the in-memory ring;
+            // already mapped segments stay readable
+            m_journal_active.store(false, std::memory_order_relaxed);
+        } else {
+            if (segment + 1 > m_premapped && segment + 1 < kMaxSegments) {
+                m_premapped = segment + 1;
+                SegmentMapper::instance().request(this, [this, next = segment + 1] { mapSegment(next, true); });
+            }
+            TradeRecord& rec = records[index % m_records_per_segment];
+            rec.buy_order_id = trade.buy_order_id;
+            rec.sell_order_id = trade.sell_order_id;
+            rec.price = trade.price;
+            rec.quantity = trade.quantity;
+            rec.reserved = 0;
+            rec.timestamp = trade.timestamp;
+            rec.seq = seq; // written last: a non-zero seq marks a complete record
+        }
+    }
+    m_last_seq.store(seq, std::memory_order_release);
+    return seq;
+}
+
+uint64_t TradeLog::firstAvailableSeq() const {
+    uint64_t last = lastSeq();
+    if (last == 0) return 1;
+    if (m_journal_active.load(std::memory_order_relaxed)) return 1;
+    return last > m_config.ring_capacity ? last - m_config.ring_capacity + 1 : 1;
+}
+
+bool TradeLog::get(uint64_t seq, Trade& out) const {
+    if (seq == 0 || seq > lastSeq()) return false;
+    const Slot& slot = m_ring[(seq - 1) & (m_config.ring_capacity - 1)];
+    if (slot.seq.load(std::memory_order_acquire) == seq) {
+        std::memcpy(static_cast<void*>(&out), &slot.trade, sizeof(Trade));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) == seq) return true;
+    }
+    // Recycled out of the ring: read it back from the journal
+    const TradeRecord* rec = recordAt(seq);
+    if (!rec || rec->seq != seq) return false;
+    out.buy_order_id = rec->buy_order_id;
+    out.sell_order_id = rec->sell_order_id;
+    out.price = rec->price;
+    out.quantity = rec->quantity;
+    out.timestamp = rec->timestamp;
+    out.seq = seq;
+    return true;
+}
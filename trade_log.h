@@ -0,0 +1,119 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+struct Trade {
+    uint64_t buy_order_id;
+    uint64_t sell_order_id;
+    double price;
+    uint32_t quantity;
+    uint64_t timestamp;     // ns since the Unix epoch (engine_clock)
+    uint64_t seq = 0;       // trade sequence within the book, assigned by TradeLog
+    uint32_t buy_owner = 0; // accounts behind the two orders (0 = none); not journaled
+    uint32_t sell_owner = 0;
+    uint32_t buy_client = 0; // gateway sessions behind the two orders (0 = none); not journaled
+    uint32_t sell_client = 0;
+};
+
+// On-disk layout of one journaled trade (little-endian, fixed size)
+struct TradeRecord {
+    uint64_t seq;           // 1-based trade sequence; 0 marks an unwritten record
+    uint64_t buy_order_id;
+    uint64_t sell_order_id;
+    double price;
+    uint32_t quantity;
+    uint32_t reserved;
+    uint64_t timestamp;     // ns since the Unix epoch (whole seconds in journals written before the engine clock)
+};
+static_assert(sizeof(TradeRecord) == 48, "TradeRecord layout is part of the journal format");
+
+struct TradeLogConfig {
+    size_t ring_capacity = size_t{1} << 16;     // recent trades kept in memory (power of two)
+    size_t segment_bytes = size_t{64} << 20;    // journal grows and is mapped in segments of this size
+};
+
+// Trade history with bounded memory.
+//
+// The last ring_capacity trades sit in a fixed ring; every trade is also
+// appended to an optional memory-mapped journal file. One thread appends;
+// any thread may read concurrently without locks: ring slots are guarded by
+// a per-slot sequence (seqlock) and journal segments stay mapped for the life
+// of the log, so a reader falls back to the journal when a slot was recycled.
+// When the writer enters a segment, a shared background thread maps and
+// pre-faults the next one, so growing the journal stays off the append path.
+class TradeLog {
+public:
+    static constexpr size_t kMaxSegments = 4096;
+
+    explicit TradeLog(const TradeLogConfig& config = TradeLogConfig{});
+    ~TradeLog();
+
+    TradeLog(const TradeLog&) = delete;
+    TradeLog& operator=(const TradeLog&) = delete;
+
+    // Attach an append-only journal. An existing journal is continued after
+    // its last complete record. Call before the first append.
+    bool openJournal(const std::string& path);
+    bool journaling() const { return m_journal_active.load(std::memory_order_relaxed); }
+
+    // Record a trade; assigns and returns its sequence number (writer thread only)
+    uint64_t append(Trade& trade);
+
+    // Recovery: the appends that follow regenerate the trades after seq.
+    // Those already in the journal keep their seq and are not written again;
+    // without a journal, numbering simply continues after seq.
+    void beginReplay(uint64_t seq);
+    void endReplay() { m_replaying = false; }
+
+    // Sequence of the newest trade (0 if none)
+    uint64_t lastSeq() const { return m_last_seq.load(std::memory_order_acquire); }
+    // Oldest sequence still retrievable: 1 while the journal records every
+    // trade, else the oldest one in the ring
+    uint64_t firstAvailableSeq() const;
+
+    // Fetch one trade by sequence; false if it is no longer (or not yet) available
+    bool get(uint64_t seq, Trade& out) const;
+
+    // Visit trades with seq > since_seq, oldest first, at most limit of them.
+    // Returns the number visited. fn(const Trade&).
+    template <typename F>
+    size_t forEach(uint64_t since_seq, size_t limit, F&& fn) const {
+        uint64_t last = lastSeq();
+        uint64_t first = firstAvailableSeq();
+        uint64_t seq = since_seq + 1 > first ? since_seq + 1 : first;
+        size_t n = 0;
+        Trade t;
+        for (; seq <= last && n < limit; ++seq) {
+            if (!get(seq, t)) continue;
+            fn(static_cast<const Trade&>(t));
+            ++n;
+        }
+        return n;
+    }
+
+private:
+    struct Slot;
+
+    // Map (creating if needed) one journal segment; no-op if already mapped. Any thread.
+    bool mapSegment(size_t index, bool prefault);
+    const TradeRecord* recordAt(uint64_t seq) const;
+
+    TradeLogConfig m_config;
+    size_t m_records_per_segment = 0;
+    std::unique_ptr<Slot[]> m_ring;
+    std::atomic<uint64_t> m_last_seq{0};
+    bool m_replaying = false;
+    uint64_t m_replay_seq = 0;
+
+    int m_fd = -1;
+    std::atomic<bool> m_journal_active{false};  // false once the journal could not grow
+    std::array<std::atomic<TradeRecord*>, kMaxSegments> m_segments{};
+    std::mutex m_map_mutex;                     // serializes mapSegment between writer and mapper
+    size_t m_premapped = 0;                     // writer-side: highest segment handed to the mapper
+};
@@ -7,212 +7,715 @@
 #include <string>
 #include <nlohmann/json.hpp> // Install with vcpkg or add to your project
 #include "order-book.h"
+#include "matching_engine.h"
+#include "instrument_registry.h"
+#include "binary_protocol.h"
+#include "json_request.h"
+#include "json_writer.h"
+#include "pnl_tracker.h"
+#include "metrics.h"
+#include "log.h"
 #include <unordered_set>
 #include <unordered_map>
 #include <vector>
+#include <algorithm>
+#include <limits>
 #include <atomic>
 #include <chrono>
 #include <cmath>
 #include <csignal>
 #include <mutex>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include <thread>
+#include <future>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
-#define LOG(msg) std::cerr << "[WS] " << msg << std::endl
 
 // Forward declare ClientData so we can define globals after
 struct ClientData;
 
-// Track all connected clients and map orders to owners
-static std::unordered_set<uWS::WebSocket<false, true, ClientData>*> connected_clients;
-static std::unordered_map<uint64_t, ClientData*> order_to_client; // moved global
-static std::atomic<bool> snapshotDirty{false};
-static std::atomic<bool> snapshotBroadcastScheduled{false};
-static std::chrono::steady_clock::time_point lastSnapshotBroadcast = std::chrono::steady_clock::now();
+// Track all connected clients. Client and gateway state is thread_local:
+// each worker loop owns the connections it accepted.
+static thread_local std::unordered_set<uWS::WebSocket<false, true, ClientData>*> connected_clients;
+static thread_local std::unordered_map<int, uWS::WebSocket<false, true, ClientData>*> clients_by_id; // engine results and fills are routed by client_id
 static constexpr std::chrono::milliseconds SNAPSHOT_MIN_INTERVAL{100}; // throttle interval
-static double last_trade_price = 0.0; // last executed trade price for marking
+static constexpr size_t TRADE_HISTORY_DEFAULT_LIMIT = 1000; // getTradeHistory without limit
+static constexpr size_t TRADE_HISTORY_MAX_LIMIT = 10000;
+static constexpr size_t BATCH_MAX_ORDERS = 256; // per submit_batch / cancel_batch message
+static constexpr size_t FINISHED_ORDERS_KEPT = 256; // per client, for getOrderStatus after a fill or cancel
 // Stats & shutdown tracking
 static std::atomic<bool> shutdownRequested{false};
 static std::atomic<bool> shutdownInProgress{false};
-static uWS::Loop* g_loop = nullptr;
+static std::atomic<bool> intakeClosed{false}; // shutdown: no more commands go to the engines
+static thread_local uWS::Loop* g_loop = nullptr;
+static thread_local uWS::App* g_app = nullptr;
+static thread_local size_t worker_index = 0;
+static uWS::Loop* g_main_loop = nullptr; // worker 0; handles shutdown
 static std::atomic<uint64_t> stat_orders_submitted{0};
 static std::atomic<uint64_t> stat_orders_canceled{0};
 static std::atomic<uint64_t> stat_trade_events{0};
 static std::atomic<uint64_t> stat_traded_quantity{0};
-static std::mutex filled_set_mutex;
-static std::unordered_set<uint64_t> filled_order_set;
+static std::atomic<uint64_t> stat_orders_filled{0};  // an order fills completely at most once
 static std::atomic<int> next_client_id{1};
 // Simple per-client PnL query rate limiting
 struct RateBucket { std::chrono::steady_clock::time_point windowStart; int count = 0; };
-static std::unordered_map<ClientData*, RateBucket> pnlRate;
+static thread_local std::unordered_map<ClientData*, RateBucket> pnlRate;
 
-OrderBook orderBook; // Global instance
+// Every tradable symbol, each with its own book and engine
+static InstrumentRegistry instruments;
+// Threads the engines are sharded over (threaded mode); declared after instruments
+// so they are torn down first
+static std::vector<std::unique_ptr<EngineThread>> engine_threads;
+
+// Every command from the gateway goes through here; false once shutdown has closed intake
+static bool postToEngine(Instrument& inst, const EngineCommand& cmd) {
+    if (intakeClosed.load(std::memory_order_acquire)) return false;
+    return inst.engine.post(cmd);
+}
+
+// Named accounts (--data-dir only): the auth name maps to a persistent id that
+// the engines stamp on every order, so positions and resting orders can be
+// handed back after a reconnect or a restart. One connection per account at a time.
+struct AccountTable {
+    std::mutex mutex;
+    std::string path;                                   // "<data-dir>/accounts"; empty disables accounts
+    std::unordered_map<std::string, uint32_t> ids;
+    std::unordered_set<uint32_t> online;
+    uint32_t next_id = 1;
+};
+static AccountTable accounts;
 
 using json = nlohmann::json;
 
+// Market-data fan-out goes through uWS pub/sub: each payload is serialized
+// once into its topic's buffer and published with a single call, which
+// copies it into every subscriber's send buffer.
+struct Topic {
+    std::string name;
+    uWS::OpCode opcode;
+    bool compress = false;   // publish compressed (--compress-topics)
+    std::string buffer;      // reused across publishes
+};
+static thread_local Topic topic_pnl{"pnl", uWS::OpCode::BINARY};          // all_pnl_push (all instruments)
+
+static bool hasSubscribers(const Topic& topic) {
+    return g_app && g_app->numSubscribers(topic.name) > 0;
+}
+
+#ifndef JSON_WRITER_CHECK
+#define JSON_WRITER_CHECK 0
+#endif
+
+// JSON_WRITER_CHECK=1 builds verify every JsonWriter message against json::dump()
+static void checkWritten(const std::string& text) {
+    if constexpr (JSON_WRITER_CHECK) {
+        if (!JsonWriter::matchesDump(text)) LOG_ERROR("JsonWriter output differs from json::dump(): {}", text);
+    }
+}
+
+// Publish a JSON payload written straight into the topic buffer
+template <typename Build>
+static void publishWritten(Topic& topic, Build&& build) {
+    {
+        metrics::ScopedTimer timer(metrics::Serialize);
+        topic.buffer.clear();
+        JsonWriter w(topic.buffer);
+        build(w);
+    }
+    checkWritten(topic.buffer);
+    metrics::ScopedTimer timer(metrics::Broadcast);
+    g_app->publish(topic.name, topic.buffer, topic.opcode, topic.compress);
+}
+
+template <typename Msg>
+static void publishBinary(Topic& topic, const Msg& msg) {
+    topic.buffer.assign(bin::view(msg));
+    metrics::ScopedTimer timer(metrics::Broadcast);
+    g_app->publish(topic.name, topic.buffer, uWS::OpCode::BINARY, false);
+}
+
+// Fills of the match pass in progress, aggregated per order until the engine marks the last trade
+struct PendingExec {
+    uint64_t order_id;
+    int client_id;
+    bool is_buy;
+    uint64_t quantity = 0;
+    double notional = 0.0;
+    uint32_t fills = 0;
+};
+
+// Gateway-side state of one instrument: top of book, its market-data topics
+// ("book.SYM", "depth.SYM", "trades.SYM", "trades.bin.SYM"), snapshot throttle
+// and the match pass being assembled. Only touched on the loop thread.
+struct Market {
+    explicit Market(Instrument* inst)
+        : inst(inst),
+          topic_book{"book." + inst->symbol, uWS::OpCode::BINARY},
+          topic_depth{"depth." + inst->symbol, uWS::OpCode::BINARY},
+          topic_trades{"trades." + inst->symbol, uWS::OpCode::BINARY},
+          topic_trades_bin{"trades.bin." + inst->symbol, uWS::OpCode::BINARY} {}
+
+    Instrument* inst;
+    double last_trade_price = 0.0; // last executed trade price for marking
+    double best_bid = 0.0;         // top of book as of the last engine event
+    double best_ask = 0.0;
+    Topic topic_book;              // per-order snapshots
+    Topic topic_depth;             // book_delta
+    Topic topic_trades;            // JSON trade prints
+    Topic topic_trades_bin;        // binary trade prints
+    std::atomic<bool> snapshotDirty{false};
+    std::atomic<bool> snapshotBroadcastScheduled{false};
+    std::chrono::steady_clock::time_point lastSnapshotBroadcast = std::chrono::steady_clock::now();
+    std::atomic<bool> drainScheduled{false};
+    std::vector<Trade> batch_trades;
+    std::vector<PendingExec> batch_execs;
+};
+static thread_local std::vector<std::unique_ptr<Market>> markets; // indexed by instrument index
+
+// One event loop thread with its own uWS::App; all of them listen on the port
+// with SO_REUSEPORT and the kernel spreads connections across them. Workers
+// share nothing but the engines, and every engine fans its events out to every
+// worker, so each keeps its own copy of the market state.
+struct Worker {
+    size_t index = 0;
+    uWS::Loop* loop = nullptr;
+    std::vector<Market*> markets; // this worker's Market per instrument
+    // Connections and their unsent bytes, refreshed once a second by the worker's loop
+    std::atomic<uint64_t> clients{0};
+    std::atomic<uint64_t> send_backlog{0};
+    std::atomic<uint64_t> max_client_backlog{0};
+};
+static std::vector<std::unique_ptr<Worker>> workers;
+
+// Market named by a request's "symbol"; the primary instrument when absent, nullptr if unknown
+static Market* marketFor(const jreq::Request& r) {
+    const jreq::Value& symbol = r[jreq::FSymbol];
+    if (!symbol.present()) return markets.front().get();
+    if (!symbol.isString()) return nullptr;
+    Instrument* inst = instruments.find(symbol.s);
+    return inst ? markets[inst->index].get() : nullptr;
+}
+
+static Market* marketForOrder(uint64_t order_id) {
+    Instrument* inst = instruments.forOrder(order_id);
+    return inst ? markets[inst->index].get() : nullptr;
+}
+
+// Gateway-side view of a resting order, maintained from engine events so
+// queries never have to read the book. Linked into its client's list of live
+// orders in arrival order.
+struct OrderView {
+    uint64_t id = 0;
+    double price = 0.0;
+    uint32_t remaining = 0;
+    uint32_t instrument = 0;
+    bool is_buy = false;
+    OrderView* prev = nullptr;
+    OrderView* next = nullptr;
+};
+
+// How a client's order left the book
+struct FinishedOrder {
+    uint64_t id = 0;
+    OrderStatus status = OrderStatus::NotFound;
+};
+
+// Market-data feeds a client takes from one instrument
+enum Feed : uint8_t { FeedBook = 1, FeedDepth = 2, FeedTrades = 4 };
+
+struct InstrumentPnL {
+    uint32_t instrument;
+    PnLTracker pnl;            // position, avg cost, realized PnL and open-order aggregates
+};
+
 struct ClientData {
     bool authenticated = false;
-    std::unordered_set<uint64_t> my_orders;
-    double realized_pnl = 0.0;
-    double unrealized_pnl = 0.0;
-    int64_t position = 0;      // net position (>0 long, <0 short)
-    double avg_cost = 0.0;     // average entry cost for current absolute position
+    // Resting orders only: an entry goes away when its order fills or is canceled
+    std::unordered_map<uint64_t, OrderView> live_orders;
+    OrderView* oldest_order = nullptr;             // live orders in arrival order
+    OrderView* newest_order = nullptr;
+    std::vector<FinishedOrder> finished_orders;    // ring of the last FINISHED_ORDERS_KEPT
+    size_t finished_next = 0;
+    std::vector<InstrumentPnL> pnl;                // one entry per instrument the client has used
+    std::unordered_map<uint32_t, uint8_t> feeds;   // instrument index -> Feed bits
     int client_id = 0;         // unique id for aggregation
+    uint32_t account = 0;      // persistent account behind the auth name (0 = none)
     std::string name;          // optional human-friendly algorithm name (from auth)
+    bool binary = false;       // order-entry acks, executions and trades go out as binary frames
+};
+
+// Clients trade a handful of instruments; a linear scan beats hashing here
+static PnLTracker& pnlFor(ClientData* cd, uint32_t instrument) {
+    for (auto& p : cd->pnl) if (p.instrument == instrument) return p.pnl;
+    cd->pnl.push_back({instrument, PnLTracker{}});
+    return cd->pnl.back().pnl;
+}
+
+static const PnLTracker* findPnl(const ClientData* cd, uint32_t instrument) {
+    for (const auto& p : cd->pnl) if (p.instrument == instrument) return &p.pnl;
+    return nullptr;
+}
+
+static uint8_t feedsOf(const ClientData* cd, uint32_t instrument) {
+    auto it = cd->feeds.find(instrument);
+    return it != cd->feeds.end() ? it->second : 0;
+}
+
+template <typename WS, typename Msg>
+static void sendBinary(WS* ws, const Msg& msg) {
+    ws->send(bin::view(msg), uWS::OpCode::BINARY);
+}
+
+// Direct replies are serialized into this worker's buffer; send() copies them out
+static thread_local std::string reply_buffer;
+
+template <typename WS>
+static void sendJson(WS* ws, const json& j) {
+    {
+        metrics::ScopedTimer timer(metrics::Serialize);
+        reply_buffer = j.dump();
+    }
+    ws->send(reply_buffer);
+}
+
+// Reply written with JsonWriter (the fixed shapes; same bytes json::dump() would give)
+template <typename WS, typename Build>
+static void sendWritten(WS* ws, Build&& build) {
+    {
+        metrics::ScopedTimer timer(metrics::Serialize);
+        reply_buffer.clear();
+        JsonWriter w(reply_buffer);
+        build(w);
+    }
+    checkWritten(reply_buffer);
+    ws->send(reply_buffer);
+}
+
+// corr, seq and timestamp of a direct reply. Keys are written in sorted order,
+// so each shape places these between its own fields.
+struct ReplyStamp {
+    bool has_corr = false;
+    uint64_t corr = 0;
+    uint64_t seq = 0;           // 0: the reply carries neither seq nor timestamp
+    uint64_t timestamp = 0;
+
+    void corrField(JsonWriter& w) const { if (has_corr) w.field("corr", corr); }
+    void seqField(JsonWriter& w) const { if (seq) w.field("seq", seq); }
+    void timestampField(JsonWriter& w) const { if (seq) w.field("timestamp", timestamp); }
 };
 
-void broadcastOrderBookSnapshot() {
-    std::vector<Order> bid_snapshot, ask_snapshot;
-    orderBook.getOrderBookSnapshot(bid_snapshot, ask_snapshot);
-    json ob_resp = {
-        {"type", "order_book_snapshot_response"},
-        {"bids", json::array()},
-        {"asks", json::array()}
+// {"corr"?, "message", "type": "error"}
+static void writeError(JsonWriter& w, std::string_view message, const ReplyStamp& stamp) {
+    w.beginObject();
+    stamp.corrField(w);
+    w.field("message", message).field("type", "error").endObject();
+}
+
+// Subscribe a connection to exactly `feeds` of one instrument
+template <typename WS>
+static void setFeeds(WS* ws, Market& m, uint8_t feeds) {
+    ClientData* cd = ws->getUserData();
+    uint8_t current = feedsOf(cd, m.inst->index);
+    auto toggle = [&](uint8_t bit, const Topic& topic) {
+        if (!((current ^ feeds) & bit)) return;
+        if (feeds & bit) ws->subscribe(topic.name);
+        else ws->unsubscribe(topic.name);
     };
-    for (const auto& o : bid_snapshot) {
-        ob_resp["bids"].push_back({{"id", o.id}, {"price", o.price}, {"quantity", o.quantity}, {"is_buy", o.is_buy}, {"status", static_cast<int>(o.status)}});
+    toggle(FeedBook, m.topic_book);
+    toggle(FeedDepth, m.topic_depth);
+    toggle(FeedTrades, cd->binary ? m.topic_trades_bin : m.topic_trades);
+    if (feeds) cd->feeds[m.inst->index] = feeds;
+    else cd->feeds.erase(m.inst->index);
+}
+
+// Move a connection to binary acks, executions and trade prints
+template <typename WS>
+static void switchToBinary(WS* ws) {
+    ClientData* cd = ws->getUserData();
+    if (cd->binary) return;
+    cd->binary = true;
+    for (const auto& [index, feeds] : cd->feeds) {
+        if (!(feeds & FeedTrades)) continue;
+        ws->unsubscribe(markets[index]->topic_trades.name);
+        ws->subscribe(markets[index]->topic_trades_bin.name);
     }
-    for (const auto& o : ask_snapshot) {
-        ob_resp["asks"].push_back({{"id", o.id}, {"price", o.price}, {"quantity", o.quantity}, {"is_buy", o.is_buy}, {"status", static_cast<int>(o.status)}});
+}
+
+template <typename WS>
+static void sendBinaryError(WS* ws, bin::Reason reason, uint64_t corr, bool hasCorr) {
+    auto err = bin::make<bin::ErrorMsg>(bin::Error, hasCorr);
+    err.reason = reason;
+    err.corr = corr;
+    sendBinary(ws, err);
+}
+
+static void writeSnapshotOrders(JsonWriter& w, const std::vector<Order>& orders) {
+    w.beginArray();
+    for (const auto& o : orders) {
+        w.beginObject().field("id", o.id).field("is_buy", o.is_buy).field("price", o.price)
+            .field("quantity", o.quantity).field("status", static_cast<int>(o.status)).endObject();
     }
-    for (auto* client : connected_clients) {
-        client->send(ob_resp.dump());
+    w.endArray();
+}
+
+// order_book_snapshot_response: every resting order of both sides
+static void writeSnapshotResponse(JsonWriter& w, const Market& m, const BookSnapshot& snap, const ReplyStamp& stamp) {
+    w.beginObject().key("asks");
+    writeSnapshotOrders(w, snap.asks);
+    w.key("bids");
+    writeSnapshotOrders(w, snap.bids);
+    stamp.corrField(w);
+    stamp.seqField(w);
+    w.field("symbol", m.inst->symbol);
+    stamp.timestampField(w);
+    w.field("type", "order_book_snapshot_response").endObject();
+}
+
+void sendSnapshotToAll(Market& m, const BookSnapshot& snap) {
+    if (!hasSubscribers(m.topic_book)) return;
+    publishWritten(m.topic_book, [&](JsonWriter& w) { writeSnapshotResponse(w, m, snap, ReplyStamp{}); });
+}
+
+static void writeDepthLevels(JsonWriter& w, const std::vector<DepthLevel>& levels) {
+    w.beginArray();
+    for (const auto& l : levels) {
+        w.beginObject().field("orders", l.order_count).field("price", l.price).field("quantity", l.quantity).endObject();
     }
+    w.endArray();
 }
 
-// Broadcast a single trade event to all clients
-void broadcastTradeEvent(const Trade& t) {
-    json tr = {
-        {"type", "trade"},
-        {"buy_order_id", t.buy_order_id},
-        {"sell_order_id", t.sell_order_id},
-        {"price", t.price},
-        {"quantity", t.quantity},
-        {"timestamp", t.timestamp}
-    };
-    auto payload = tr.dump();
-    for (auto* client : connected_clients) {
-        client->send(payload);
+// book_depth_snapshot; its "seq" is the depth sequence the deltas continue from
+static void writeDepthSnapshot(JsonWriter& w, const Market& m, const DepthSnapshot& depth, const ReplyStamp& stamp) {
+    w.beginObject().key("asks");
+    writeDepthLevels(w, depth.asks);
+    w.key("bids");
+    writeDepthLevels(w, depth.bids);
+    stamp.corrField(w);
+    w.field("seq", depth.seq).field("symbol", m.inst->symbol).field("type", "book_depth_snapshot").endObject();
+}
+
+// One changed level to every depth subscriber; quantity 0 means the level is gone
+void broadcastBookDelta(Market& m, const EngineEvent& ev) {
+    if (!hasSubscribers(m.topic_depth)) return;
+    publishWritten(m.topic_depth, [&](JsonWriter& w) {
+        w.beginObject()
+            .field("orders", ev.level.order_count)
+            .field("price", ev.level.price)
+            .field("quantity", ev.level.quantity)
+            .field("seq", ev.depth_seq)
+            .field("side", ev.is_buy ? "bid" : "ask")
+            .field("symbol", m.inst->symbol)
+            .field("type", "book_delta")
+            .endObject();
+    });
+}
+
+// Ask the engine for a snapshot; the result (client_id 0) is fanned out to the book topic
+void broadcastOrderBookSnapshot(Market& m) {
+    EngineCommand cmd;
+    cmd.type = EngineCommandType::Snapshot;
+    if (!postToEngine(*m.inst, cmd) && !intakeClosed.load(std::memory_order_relaxed)) {
+        LOG_WARN("Snapshot request dropped: {} engine queue full", m.inst->symbol);
+    }
+}
+
+// One trade; with a symbol it is the standalone "trade" message
+static void writeTrade(JsonWriter& w, const Trade& t, const std::string* symbol = nullptr) {
+    w.beginObject()
+        .field("buy_order_id", t.buy_order_id)
+        .field("price", t.price)
+        .field("quantity", t.quantity)
+        .field("sell_order_id", t.sell_order_id)
+        .field("seq", t.seq);
+    if (symbol) w.field("symbol", *symbol);
+    w.field("timestamp", t.timestamp);
+    if (symbol) w.field("type", "trade");
+    w.endObject();
+}
+
+// Broadcast the trades of one match pass: a single "trade", or one "trade_batch"
+// for a multi-fill pass. Binary subscribers get one fixed-size print per trade.
+// Binary prints carry no symbol; the instrument index is buy_order_id >> 40.
+void broadcastTradeBatch(Market& m, const std::vector<Trade>& trades) {
+    if (trades.empty()) return;
+    if (hasSubscribers(m.topic_trades_bin)) {
+        for (const Trade& t : trades) {
+            auto print = bin::make<bin::TradeMsg>(bin::TradePrint);
+            print.quantity = t.quantity;
+            print.seq = t.seq;
+            print.buy_order_id = t.buy_order_id;
+            print.sell_order_id = t.sell_order_id;
+            print.price = t.price;
+            print.timestamp = t.timestamp;
+            publishBinary(m.topic_trades_bin, print);
+        }
+    }
+    if (!hasSubscribers(m.topic_trades)) return;
+    if (trades.size() == 1) {
+        publishWritten(m.topic_trades, [&](JsonWriter& w) { writeTrade(w, trades.front(), &m.inst->symbol); });
+        return;
     }
+    uint64_t quantity = 0;
+    for (const Trade& t : trades) quantity += t.quantity;
+    publishWritten(m.topic_trades, [&](JsonWriter& w) {
+        w.beginObject()
+            .field("last_seq", trades.back().seq)
+            .field("quantity", quantity)
+            .field("symbol", m.inst->symbol)
+            .key("trades").beginArray();
+        for (const Trade& t : trades) writeTrade(w, t);
+        w.endArray().field("type", "trade_batch").endObject();
+    });
 }
 
 // Defer broadcasting to avoid holding any internal OrderBook locks while sending
-void scheduleBroadcast() {
-    snapshotDirty.store(true, std::memory_order_relaxed);
+// Worker 0 requests the snapshot; every worker publishes the result to its own clients.
+void scheduleBroadcast(Market& m) {
+    if (worker_index != 0) return;
+    m.snapshotDirty.store(true, std::memory_order_relaxed);
     bool expected = false;
-    if (snapshotBroadcastScheduled.compare_exchange_strong(expected, true)) {
+    if (m.snapshotBroadcastScheduled.compare_exchange_strong(expected, true)) {
         // Defer to event loop; sends will happen outside of user handlers
-        uWS::Loop::get()->defer([](){
+        Market* mp = &m;
+        uWS::Loop::get()->defer([mp](){
+            Market& m = *mp;
             auto now = std::chrono::steady_clock::now();
-            bool dirty = snapshotDirty.load(std::memory_order_relaxed);
-            if (dirty && (now - lastSnapshotBroadcast) >= SNAPSHOT_MIN_INTERVAL) {
-                snapshotDirty.store(false, std::memory_order_relaxed);
-                lastSnapshotBroadcast = now;
-                broadcastOrderBookSnapshot();
-                snapshotBroadcastScheduled.store(false, std::memory_order_relaxed);
+            bool dirty = m.snapshotDirty.load(std::memory_order_relaxed);
+            if (dirty && (now - m.lastSnapshotBroadcast) >= SNAPSHOT_MIN_INTERVAL) {
+                m.snapshotDirty.store(false, std::memory_order_relaxed);
+                m.lastSnapshotBroadcast = now;
+                broadcastOrderBookSnapshot(m);
+                m.snapshotBroadcastScheduled.store(false, std::memory_order_relaxed);
             } else {
                 // Not enough time elapsed; allow future scheduling attempts
-                snapshotBroadcastScheduled.store(false, std::memory_order_relaxed);
+                m.snapshotBroadcastScheduled.store(false, std::memory_order_relaxed);
                 // Keep dirty flag set so a later event schedules broadcast
             }
         });
     }
 }
 
-// Seed a symmetric price ladder if book is empty at startup.
+// Seed a symmetric price ladder if book is empty at startup (never called for a book
+// recovered from a journal).
 // These orders are owned by the system (no client association) and provide initial liquidity.
-void seedInitialBook(double mid_price = 100.0,
+// The ladder spacing is rounded to the instrument's tick grid. Orders go through the
+// (still inline) engine so they are journaled like any other.
+void seedInitialBook(Instrument& inst,
+                     double mid_price = 100.0,
                      double tick = 0.5,
                      int levels_each_side = 5,
                      uint32_t base_qty = 10) {
+    OrderBook& book = inst.book;
     std::vector<Order> bids, asks;
-    orderBook.getOrderBookSnapshot(bids, asks);
+    book.getOrderBookSnapshot(bids, asks);
     if (!bids.empty() || !asks.empty()) {
         return; // already populated, skip
     }
+    double step = std::max(1.0, std::round(tick / book.tick_size)) * book.tick_size;
+    double mid = std::round(mid_price / book.tick_size) * book.tick_size;
     for (int i = 1; i <= levels_each_side; ++i) {
-        double bid_price = mid_price - i * tick;
-        double ask_price = mid_price + i * tick;
-    uint64_t bid_id = orderBook.submitOrder(bid_price, base_qty, true);
-    uint64_t ask_id = orderBook.submitOrder(ask_price, base_qty, false);
-    (void)bid_id; (void)ask_id; // ids not tracked
+        double bid_price = mid - i * step;
+        double ask_price = mid + i * step;
+        if (bid_price <= 0) break;
+        EngineCommand cmd;
+        cmd.type = EngineCommandType::Submit;
+        cmd.quantity = base_qty;
+        cmd.price = bid_price;
+        cmd.is_buy = true;
+        inst.engine.post(cmd);
+        cmd.price = ask_price;
+        cmd.is_buy = false;
+        inst.engine.post(cmd);
     }
 }
 
-// Helper function to count open orders for a user
-size_t getOpenOrdersCount(const ClientData* client) {
-    size_t count = 0;
-    for (auto id : client->my_orders) {
-        if (orderBook.getOrderStatus(id) == OrderStatus::Open) {
-            ++count;
+// Read "<id> <name>" lines written by acquireAccount
+static void loadAccounts(const std::string& path) {
+    accounts.path = path;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        auto space = line.find(' ');
+        if (space == std::string::npos) continue;
+        uint32_t id = static_cast<uint32_t>(std::strtoul(line.c_str(), nullptr, 10));
+        if (id == 0) continue;
+        accounts.ids[line.substr(space + 1)] = id;
+        accounts.next_id = std::max(accounts.next_id, id + 1);
+    }
+}
+
+// Account for an auth name, created (and made durable) on first use. False if
+// it is already connected; id stays 0 when accounts are off or the name is empty.
+static bool acquireAccount(const std::string& name, uint32_t& id) {
+    id = 0;
+    if (name.empty() || name.find('\n') != std::string::npos) return true;
+    std::lock_guard<std::mutex> lk(accounts.mutex);
+    if (accounts.path.empty()) return true;
+    auto it = accounts.ids.find(name);
+    if (it == accounts.ids.end()) {
+        // The id must be on disk before any journaled order carries it
+        std::string line = std::to_string(accounts.next_id) + " " + name + "\n";
+        int fd = ::open(accounts.path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        bool ok = fd >= 0 && ::write(fd, line.data(), line.size()) == static_cast<ssize_t>(line.size()) && ::fsync(fd) == 0;
+        if (fd >= 0) ::close(fd);
+        if (!ok) {
+            LOG_WARN("Failed to record account {}; continuing without one", name);
+            return true;
         }
+        it = accounts.ids.emplace(name, accounts.next_id++).first;
+    }
+    if (!accounts.online.insert(it->second).second) return false;
+    id = it->second;
+    return true;
+}
+
+static void releaseAccount(uint32_t id) {
+    if (!id) return;
+    std::lock_guard<std::mutex> lk(accounts.mutex);
+    accounts.online.erase(id);
+}
+
+// Open orders for a user (all instruments)
+size_t getOpenOrdersCount(const ClientData* client) {
+    return client->live_orders.size();
+}
+
+// Remember how an order left the book, overwriting the oldest entry once the ring is full
+static void rememberFinished(ClientData* cd, uint64_t order_id, OrderStatus status) {
+    if (cd->finished_orders.size() < FINISHED_ORDERS_KEPT) {
+        cd->finished_orders.push_back({order_id, status});
+        return;
     }
-    return count;
+    cd->finished_orders[cd->finished_next] = {order_id, status};
+    cd->finished_next = (cd->finished_next + 1) % FINISHED_ORDERS_KEPT;
+}
+
+static const FinishedOrder* findFinished(const ClientData* cd, uint64_t order_id) {
+    for (const auto& f : cd->finished_orders) if (f.id == order_id) return &f;
+    return nullptr;
 }
-// Helper function to get best bid (highest price)
-double getBestBid() {
-    return orderBook.getBestBidPrice();
+
+// Live, or finished recently enough to still be remembered
+static bool ownsOrder(const ClientData* cd, uint64_t order_id) {
+    return cd->live_orders.count(order_id) || findFinished(cd, order_id);
+}
+
+// Start mirroring a resting order, keeping the client's open-order aggregates in step
+static void addLiveOrder(ClientData* cd, uint64_t order_id, uint32_t instrument, bool is_buy, double price, uint32_t remaining) {
+    auto [it, inserted] = cd->live_orders.try_emplace(order_id);
+    if (!inserted) return;
+    OrderView& view = it->second;
+    view.id = order_id;
+    view.price = price;
+    view.remaining = remaining;
+    view.instrument = instrument;
+    view.is_buy = is_buy;
+    view.prev = cd->newest_order;
+    if (cd->newest_order) cd->newest_order->next = &view;
+    else cd->oldest_order = &view;
+    cd->newest_order = &view;
+    pnlFor(cd, instrument).addOpen(is_buy, price, remaining);
 }
 
-// Helper function to get best ask (lowest price)
-double getBestAsk() {
-    return orderBook.getBestAskPrice();
+static void amendLiveOrder(ClientData* cd, OrderView& view, double price, uint32_t remaining) {
+    PnLTracker& pnl = pnlFor(cd, view.instrument);
+    pnl.removeOpen(view.is_buy, view.price, view.remaining);
+    view.price = price;
+    view.remaining = remaining;
+    pnl.addOpen(view.is_buy, price, remaining);
+}
+
+// A live order left the book (filled or canceled): drop its mirror
+static void finishOrder(ClientData* cd, uint64_t order_id, OrderStatus status) {
+    auto it = cd->live_orders.find(order_id);
+    if (it == cd->live_orders.end()) return; // never rested, e.g. an aggressor filled on arrival
+    OrderView& view = it->second;
+    pnlFor(cd, view.instrument).removeOpen(view.is_buy, view.price, view.remaining);
+    (view.prev ? view.prev->next : cd->oldest_order) = view.next;
+    (view.next ? view.next->prev : cd->newest_order) = view.prev;
+    cd->live_orders.erase(it);
+    rememberFinished(cd, order_id, status);
 }
 
 // Mark price fallback: prefer last trade, else mid, else best side
-double markPriceFallback() {
-    if (last_trade_price > 0) return last_trade_price;
-    double bb = getBestBid();
-    double ba = getBestAsk();
+double markPriceFallback(const Market& m) {
+    if (m.last_trade_price > 0) return m.last_trade_price;
+    double bb = m.best_bid;
+    double ba = m.best_ask;
     if (bb > 0 && ba > 0) return (bb + ba) * 0.5;
     return (bb > 0 ? bb : ba);
 }
 
-// Helper function to calculate unrealized PnL (inventory + optional open order edge effect)
+static double unrealizedIn(const Market& m, const PnLTracker& pnl) {
+    return pnl.unrealized(markPriceFallback(m), m.best_bid, m.best_ask);
+}
+
+// Helper function to calculate unrealized PnL (inventory + optional open order edge effect), all instruments
 double getUnrealizedPnL(const ClientData* client) {
     double pnl = 0.0;
-    // Inventory component
-    if (client->position != 0 && client->avg_cost > 0) {
-        double mark = markPriceFallback();
-        if (mark > 0) {
-            if (client->position > 0) {
-                pnl += (mark - client->avg_cost) * client->position;
-            } else { // short
-                pnl += (client->avg_cost - mark) * (-client->position);
-            }
-        }
-    }
-    // Optional: open order component (can omit for pure inventory mark-to-market)
-    for (auto id : client->my_orders) {
-        OrderStatus status = orderBook.getOrderStatus(id);
-        if (status == OrderStatus::Open) {
-            const Order* order = orderBook.getOrderById(id);
-            if (order) {
-                double market_price = order->is_buy ? getBestAsk() : getBestBid();
-                if (market_price > 0) {
-                    pnl += (market_price - order->price) * order->quantity * (order->is_buy ? 1 : -1);
-                }
-            }
-        }
-    }
+    for (const auto& p : client->pnl) pnl += unrealizedIn(*markets[p.instrument], p.pnl);
     return pnl;
 }
 
-static json buildAllPnL() {
-    json arr = json::array();
+double getRealizedPnL(const ClientData* client) {
+    double pnl = 0.0;
+    for (const auto& p : client->pnl) pnl += p.pnl.realized_pnl;
+    return pnl;
+}
+
+// PnL totals per client; position and avg_cost are for the primary instrument,
+// "instruments" breaks everything down per symbol traded
+static std::mutex pnl_board_mutex;
+static std::vector<std::string> pnl_board; // latest all_pnl rows of each worker, comma-separated objects
+
+// The "clients" array: one row per authenticated client
+static void writeAllPnL(JsonWriter& w) {
+    static thread_local std::string rows;
+    rows.clear();
+    JsonWriter rw(rows);
     for (auto* ws : connected_clients) {
         auto* cd = ws->getUserData();
         if (!cd || !cd->authenticated) continue;
-        double unreal = getUnrealizedPnL(cd);
-        std::string displayName = cd->name.empty() ? (std::string("Client ") + std::to_string(cd->client_id)) : cd->name;
-        arr.push_back({
-            {"client_id", cd->client_id},
-            {"name", displayName},
-            {"position", cd->position},
-            {"realized", cd->realized_pnl},
-            {"unrealized", unreal},
-            {"avg_cost", cd->avg_cost}
-        });
+        const PnLTracker* primary = findPnl(cd, 0);
+        rw.beginObject().field("avg_cost", primary ? primary->avg_cost : 0.0).field("client_id", cd->client_id);
+        // Totals come after "instruments" in key order; sum them on the way
+        double realized = 0.0, unreal = 0.0;
+        rw.key("instruments").beginArray();
+        for (const auto& p : cd->pnl) {
+            double u = unrealizedIn(*markets[p.instrument], p.pnl);
+            realized += p.pnl.realized_pnl;
+            unreal += u;
+            rw.beginObject()
+                .field("avg_cost", p.pnl.avg_cost)
+                .field("position", p.pnl.position)
+                .field("realized", p.pnl.realized_pnl)
+                .field("symbol", markets[p.instrument]->inst->symbol)
+                .field("unrealized", u)
+                .endObject();
+        }
+        rw.endArray();
+        if (cd->name.empty()) rw.field("name", "Client " + std::to_string(cd->client_id));
+        else rw.field("name", cd->name);
+        rw.field("position", primary ? primary->position : 0).field("realized", realized).field("unrealized", unreal).endObject();
     }
-    return arr;
+    w.beginArray();
+    if (workers.size() <= 1) {
+        if (!rows.empty()) w.raw(rows);
+    } else {
+        // Other workers' clients as of their last refresh; they all flush on the same match passes
+        std::lock_guard<std::mutex> lk(pnl_board_mutex);
+        pnl_board.resize(workers.size());
+        pnl_board[worker_index] = rows;
+        for (const auto& board : pnl_board) {
+            if (!board.empty()) w.raw(board);
+        }
+    }
+    w.endArray();
 }
 
 // Pretty separator helper
@@ -222,75 +725,732 @@ static void sep(const std::string& title) {
 
 // Final stats printer (called on graceful shutdown)
 void printFinalStats() {
-    std::vector<Order> bid_snapshot, ask_snapshot;
-    orderBook.getOrderBookSnapshot(bid_snapshot, ask_snapshot);
-    size_t open_buy = 0, open_sell = 0;
-    for (auto& o : bid_snapshot) if (o.status == OrderStatus::Open) ++open_buy;
-    for (auto& o : ask_snapshot) if (o.status == OrderStatus::Open) ++open_sell;
-    auto trades = orderBook.getTradeHistory();
+    // Take every book back from its engine thread before reading it directly
+    instruments.forEach([](Instrument& inst) { inst.engine.stop(); });
 
     sep("SERVER SUMMARY");
-    std::cerr << "Last trade price: " << last_trade_price << "\n";
-    std::cerr << "Total trade prints: " << trades.size() << "\n";
+    std::cerr << "Instruments: " << instruments.size() << "\n";
     std::cerr << "Stat trade events (callback count): " << stat_trade_events.load() << "\n";
     std::cerr << "Total traded quantity: " << stat_traded_quantity.load() << "\n";
     std::cerr << "Orders submitted: " << stat_orders_submitted.load() << "\n";
     std::cerr << "Orders canceled: " << stat_orders_canceled.load() << "\n";
-    {
-        std::lock_guard<std::mutex> lk(filled_set_mutex);
-        std::cerr << "Unique orders filled: " << filled_order_set.size() << "\n";
-    }
-    std::cerr << "Open buy orders: " << open_buy << " | Open sell orders: " << open_sell << "\n";
+    std::cerr << "Unique orders filled: " << stat_orders_filled.load() << "\n";
 
-    sep("TOP OF BOOK");
-    if (!bid_snapshot.empty())
-        std::cerr << "Best Bid: " << bid_snapshot.front().price << " qty=" << bid_snapshot.front().quantity << "\n";
-    else std::cerr << "Best Bid: (none)\n";
-    if (!ask_snapshot.empty())
-        std::cerr << "Best Ask: " << ask_snapshot.front().price << " qty=" << ask_snapshot.front().quantity << "\n";
-    else std::cerr << "Best Ask: (none)\n";
+    for (const auto& mp : markets) {
+        const Market& m = *mp;
+        OrderBook& book = m.inst->book;
+        std::vector<Order> bid_snapshot, ask_snapshot;
+        book.getOrderBookSnapshot(bid_snapshot, ask_snapshot);
+        size_t open_buy = 0, open_sell = 0;
+        for (auto& o : bid_snapshot) if (o.status == OrderStatus::Open) ++open_buy;
+        for (auto& o : ask_snapshot) if (o.status == OrderStatus::Open) ++open_sell;
+        uint64_t trade_count = book.lastTradeSeq();
 
-    sep("FULL BIDS (price desc)");
-    for (const auto& o : bid_snapshot) {
-        std::cerr << "BID id=" << o.id << " px=" << o.price << " qty=" << o.quantity << " status=" << static_cast<int>(o.status) << "\n";
-    }
-    sep("FULL ASKS (price asc)");
-    for (const auto& o : ask_snapshot) {
-        std::cerr << "ASK id=" << o.id << " px=" << o.price << " qty=" << o.quantity << " status=" << static_cast<int>(o.status) << "\n";
-    }
+        sep("INSTRUMENT " + m.inst->symbol + " (tick " + std::to_string(book.tick_size) + ")");
+        std::cerr << "Last trade price: " << m.last_trade_price << "\n";
+        std::cerr << "Total trade prints: " << trade_count << "\n";
+        std::cerr << "Open buy orders: " << open_buy << " | Open sell orders: " << open_sell << "\n";
+        {
+            SlabStats ps = book.getPoolStats();
+            std::cerr << "Order pool: chunks=" << ps.chunks << " (huge=" << ps.huge_page_chunks << ", empty=" << ps.empty_chunks
+                      << ", released=" << ps.chunks_released << ") capacity=" << ps.capacity << " in_use=" << ps.in_use
+                      << " cached=" << ps.cached << " occupancy=" << ps.occupancy << " fragmentation=" << ps.fragmentation << "\n";
+        }
+
+        sep("TOP OF BOOK " + m.inst->symbol);
+        if (!bid_snapshot.empty())
+            std::cerr << "Best Bid: " << bid_snapshot.front().price << " qty=" << bid_snapshot.front().quantity << "\n";
+        else std::cerr << "Best Bid: (none)\n";
+        if (!ask_snapshot.empty())
+            std::cerr << "Best Ask: " << ask_snapshot.front().price << " qty=" << ask_snapshot.front().quantity << "\n";
+        else std::cerr << "Best Ask: (none)\n";
+
+        sep("FULL BIDS " + m.inst->symbol + " (price desc)");
+        for (const auto& o : bid_snapshot) {
+            std::cerr << "BID id=" << o.id << " px=" << o.price << " qty=" << o.quantity << " status=" << static_cast<int>(o.status) << "\n";
+        }
+        sep("FULL ASKS " + m.inst->symbol + " (price asc)");
+        for (const auto& o : ask_snapshot) {
+            std::cerr << "ASK id=" << o.id << " px=" << o.price << " qty=" << o.quantity << " status=" << static_cast<int>(o.status) << "\n";
+        }
 
-    sep("RECENT TRADES (last 20)");
-    size_t start = trades.size() > 20 ? trades.size() - 20 : 0;
-    for (size_t i = start; i < trades.size(); ++i) {
-        const auto& t = trades[i];
-        std::cerr << "Trade #" << i << " qty=" << t.quantity << " px=" << t.price
-                  << " buyOrder=" << t.buy_order_id << " sellOrder=" << t.sell_order_id
-                  << " ts=" << t.timestamp << "\n";
+        sep("RECENT TRADES " + m.inst->symbol + " (last 20)");
+        book.forEachTrade(trade_count > 20 ? trade_count - 20 : 0, 20, [](const Trade& t) {
+            std::cerr << "Trade #" << t.seq << " qty=" << t.quantity << " px=" << t.price
+                      << " buyOrder=" << t.buy_order_id << " sellOrder=" << t.sell_order_id
+                      << " ts=" << t.timestamp << "\n";
+        });
     }
 
-    sep("CLIENT POSITIONS / PnL");
+    sep(workers.size() > 1 ? "CLIENT POSITIONS / PnL (worker 0)" : "CLIENT POSITIONS / PnL");
     for (auto* ws : connected_clients) {
         auto* cd = ws->getUserData();
-        double unreal = getUnrealizedPnL(cd);
-        std::cerr << "Client@" << cd << " pos=" << cd->position
-                  << " avg_cost=" << cd->avg_cost
-                  << " realized=" << cd->realized_pnl
-                  << " unreal=" << unreal
-                  << " open_orders=" << getOpenOrdersCount(cd)
-                  << "\n";
+        for (const auto& p : cd->pnl) {
+            std::cerr << "Client@" << cd << " " << markets[p.instrument]->inst->symbol
+                      << " pos=" << p.pnl.position
+                      << " avg_cost=" << p.pnl.avg_cost
+                      << " realized=" << p.pnl.realized_pnl
+                      << " unreal=" << unrealizedIn(*markets[p.instrument], p.pnl)
+                      << " open_orders=" << p.pnl.open_orders
+                      << "\n";
+        }
     }
     sep("DONE");
 }
 
+// Unsent bytes across this worker's connections (runs on its loop once a second)
+static void refreshWorkerGauges() {
+    uint64_t total = 0, worst = 0;
+    for (auto* ws : connected_clients) {
+        uint64_t buffered = ws->getBufferedAmount();
+        total += buffered;
+        worst = std::max(worst, buffered);
+    }
+    Worker& w = *workers[worker_index];
+    w.clients.store(connected_clients.size(), std::memory_order_relaxed);
+    w.send_backlog.store(total, std::memory_order_relaxed);
+    w.max_client_backlog.store(worst, std::memory_order_relaxed);
+}
+
+// getMetrics: stage latencies since start (microseconds), counters, book and worker gauges
+static json buildMetrics() {
+    json latency = json::object();
+    for (int st = 0; st < metrics::kStageCount; ++st) {
+        metrics::Summary s = metrics::collect(static_cast<metrics::Stage>(st));
+        auto us = [](uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+        latency[metrics::stageName(static_cast<metrics::Stage>(st))] = {
+            {"count", s.count}, {"mean", s.mean() / 1000.0}, {"p50", us(s.quantile(0.50))}, {"p90", us(s.quantile(0.90))},
+            {"p99", us(s.quantile(0.99))}, {"p999", us(s.quantile(0.999))}, {"max", us(s.max)}};
+    }
+    json books = json::array();
+    instruments.forEach([&](const Instrument& inst) {
+        const EngineGauges& g = inst.engine.gauges();
+        SlabStats ps = inst.book.getPoolStats();
+        books.push_back({{"symbol", inst.symbol}, {"commands", g.commands.load()}, {"resting_orders", g.resting_orders.load()},
+                         {"bid_levels", g.bid_levels.load()}, {"ask_levels", g.ask_levels.load()}, {"dropped_events", g.dropped_events.load()},
+                         {"pool_in_use", ps.in_use}, {"pool_capacity", ps.capacity}, {"pool_occupancy", ps.occupancy}});
+    });
+    json loops = json::array();
+    for (const auto& w : workers) {
+        loops.push_back({{"worker", w->index}, {"clients", w->clients.load()}, {"send_backlog_bytes", w->send_backlog.load()},
+                         {"max_client_backlog_bytes", w->max_client_backlog.load()}});
+    }
+    return {
+        {"type", "metrics_response"},
+        {"enabled", metrics::enabled()},
+        {"latency_us", std::move(latency)},
+        {"counters", {{"orders_submitted", stat_orders_submitted.load()}, {"orders_canceled", stat_orders_canceled.load()},
+                      {"trade_events", stat_trade_events.load()}, {"traded_quantity", stat_traded_quantity.load()}}},
+        {"books", std::move(books)},
+        {"workers", std::move(loops)}
+    };
+}
+
+// GET /metrics in Prometheus text format
+static std::string buildPrometheus() {
+    std::string out;
+    out.reserve(16384);
+    metrics::appendPrometheus(out);
+    char line[192];
+    auto counter = [&](const char* name, const char* help, uint64_t v) {
+        std::snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", name, help, name, name, static_cast<unsigned long long>(v));
+        out += line;
+    };
+    counter("trading_orders_submitted_total", "Accepted submits", stat_orders_submitted.load());
+    counter("trading_orders_canceled_total", "Accepted cancels", stat_orders_canceled.load());
+    counter("trading_trade_events_total", "Trades delivered to the gateway", stat_trade_events.load());
+    counter("trading_traded_quantity_total", "Quantity traded", stat_traded_quantity.load());
+
+    auto family = [&](const char* name, const char* type, const char* help) {
+        out += "# HELP "; out += name; out += ' '; out += help; out += '\n';
+        out += "# TYPE "; out += name; out += ' '; out += type; out += '\n';
+    };
+    family("trading_engine_commands_total", "counter", "Commands executed by the engine");
+    instruments.forEach([&](const Instrument& inst) {
+        std::snprintf(line, sizeof(line), "trading_engine_commands_total{symbol=\"%s\"} %llu\n", inst.symbol.c_str(),
+                      static_cast<unsigned long long>(inst.engine.gauges().commands.load()));
+        out += line;
+    });
+    family("trading_engine_dropped_events_total", "counter", "Engine events a consumer missed because its ring was full at shutdown");
+    instruments.forEach([&](const Instrument& inst) {
+        std::snprintf(line, sizeof(line), "trading_engine_dropped_events_total{symbol=\"%s\"} %llu\n", inst.symbol.c_str(),
+                      static_cast<unsigned long long>(inst.engine.gauges().dropped_events.load()));
+        out += line;
+    });
+    family("trading_book_levels", "gauge", "Price levels per side");
+    instruments.forEach([&](const Instrument& inst) {
+        const EngineGauges& g = inst.engine.gauges();
+        std::snprintf(line, sizeof(line), "trading_book_levels{symbol=\"%s\",side=\"bid\"} %u\ntrading_book_levels{symbol=\"%s\",side=\"ask\"} %u\n",
+                      inst.symbol.c_str(), g.bid_levels.load(), inst.symbol.c_str(), g.ask_levels.load());
+        out += line;
+    });
+    family("trading_book_resting_orders", "gauge", "Orders resting in the book");
+    instruments.forEach([&](const Instrument& inst) {
+        std::snprintf(line, sizeof(line), "trading_book_resting_orders{symbol=\"%s\"} %llu\n", inst.symbol.c_str(),
+                      static_cast<unsigned long long>(inst.engine.gauges().resting_orders.load()));
+        out += line;
+    });
+    std::vector<SlabStats> pools;
+    instruments.forEach([&](const Instrument& inst) { pools.push_back(inst.book.getPoolStats()); });
+    family("trading_order_pool_slots", "gauge", "Order pool slots in use and allocated");
+    instruments.forEach([&](const Instrument& inst) {
+        const SlabStats& ps = pools[inst.index];
+        std::snprintf(line, sizeof(line), "trading_order_pool_slots{symbol=\"%s\",state=\"in_use\"} %zu\ntrading_order_pool_slots{symbol=\"%s\",state=\"capacity\"} %zu\n",
+                      inst.symbol.c_str(), ps.in_use, inst.symbol.c_str(), ps.capacity);
+        out += line;
+    });
+    family("trading_order_pool_occupancy", "gauge", "Order pool slots in use / capacity");
+    instruments.forEach([&](const Instrument& inst) {
+        std::snprintf(line, sizeof(line), "trading_order_pool_occupancy{symbol=\"%s\"} %.6f\n", inst.symbol.c_str(), pools[inst.index].occupancy);
+        out += line;
+    });
+    auto perWorker = [&](const char* name, const char* help, const std::atomic<uint64_t> Worker::*field) {
+        family(name, "gauge", help);
+        for (const auto& w : workers) {
+            std::snprintf(line, sizeof(line), "%s{worker=\"%zu\"} %llu\n", name, w->index, static_cast<unsigned long long>(((*w).*field).load()));
+            out += line;
+        }
+    };
+    perWorker("trading_clients", "Connected clients per event loop", &Worker::clients);
+    perWorker("trading_send_backlog_bytes", "Bytes waiting in client send buffers per event loop", &Worker::send_backlog);
+    perWorker("trading_send_backlog_max_bytes", "Largest single-client send buffer per event loop", &Worker::max_client_backlog);
+    return out;
+}
+
+// One execution push per order per match pass: total quantity at its average fill price.
+// Position and PnL fields are for the order's instrument.
+static void sendExecution(const Market& m, const PendingExec& pe) {
+    auto itWs = clients_by_id.find(pe.client_id);
+    if (itWs == clients_by_id.end()) return;
+    auto* ws = itWs->second;
+    ClientData* cd = ws->getUserData();
+    const PnLTracker& pnl = pnlFor(cd, m.inst->index);
+    double avg_px = pe.notional / static_cast<double>(pe.quantity);
+    double unreal_exec = unrealizedIn(m, pnl); // compute fresh unrealized for push
+    if (cd->binary) {
+        auto exec = bin::make<bin::ExecutionMsg>(bin::Execution);
+        exec.is_buy = pe.is_buy;
+        exec.quantity = static_cast<uint32_t>(pe.quantity);
+        exec.order_id = pe.order_id;
+        exec.price = avg_px;
+        exec.position = pnl.position;
+        exec.avg_cost = pnl.avg_cost;
+        exec.realized_pnl = pnl.realized_pnl;
+        exec.unrealized_pnl = unreal_exec;
+        sendBinary(ws, exec);
+        return;
+    }
+    sendWritten(ws, [&](JsonWriter& w) {
+        w.beginObject()
+            .field("avg_cost", pnl.avg_cost)
+            .field("fills", pe.fills)
+            .field("order_id", pe.order_id)
+            .field("position", pnl.position)
+            .field("price", avg_px)
+            .field("quantity", pe.quantity)
+            .field("realized_pnl", pnl.realized_pnl)
+            .field("side", pe.is_buy ? "buy" : "sell")
+            .field("symbol", m.inst->symbol)
+            .field("type", "execution")
+            .field("unrealized_pnl", unreal_exec)
+            .endObject();
+    });
+}
+
+// Publish everything a match pass produced: trades, executions and PnL, once each
+static void flushTradeBatch(Market& m) {
+    try { broadcastTradeBatch(m, m.batch_trades); } catch (...) { LOG_ERROR("Trade broadcast exception"); }
+    for (const auto& pe : m.batch_execs) sendExecution(m, pe);
+    m.batch_trades.clear();
+    m.batch_execs.clear();
+
+    // Broadcast multi-agent PnL snapshot
+    try {
+        if (hasSubscribers(topic_pnl)) {
+            publishWritten(topic_pnl, [](JsonWriter& w) {
+                w.beginObject().key("clients");
+                writeAllPnL(w);
+                w.field("type", "all_pnl_push").endObject();
+            });
+        }
+    } catch (...) { LOG_ERROR("all_pnl_push broadcast error"); }
+}
+
+static uWS::WebSocket<false, true, ClientData>* findClient(int client_id) {
+    auto it = clients_by_id.find(client_id);
+    return it != clients_by_id.end() ? it->second : nullptr;
+}
+
+// Trade event handler: positions and order mirrors are updated per fill,
+// broadcasts go out once the whole match pass has arrived
+void handleTradeEvent(Market& m, const EngineEvent& ev) {
+    const Trade& t = ev.trade;
+    auto& batch_execs = m.batch_execs;
+    // Every worker sees every trade; count each once
+    if (worker_index == 0) {
+        stat_trade_events.fetch_add(1, std::memory_order_relaxed);
+        stat_traded_quantity.fetch_add(t.quantity, std::memory_order_relaxed);
+        stat_orders_filled.fetch_add(ev.buy_filled + ev.sell_filled, std::memory_order_relaxed);
+    }
+    m.last_trade_price = t.price;
+    // The engine stamps each side with the session its order belongs to; an
+    // aggressor's fills arrive before its submit result and only move the position
+    auto handleSide = [&](uint64_t order_id, uint32_t client, bool is_buy_side, bool side_filled){
+        auto* ws = client ? findClient(static_cast<int>(client)) : nullptr;
+        if (!ws) return; // unowned (recovered, owner offline) or owned by another worker's session
+        ClientData* cd = ws->getUserData();
+        if (side_filled) {
+            finishOrder(cd, order_id, OrderStatus::Filled);
+        } else {
+            auto itView = cd->live_orders.find(order_id);
+            if (itView != cd->live_orders.end()) {
+                OrderView& view = itView->second;
+                amendLiveOrder(cd, view, view.price, view.remaining > t.quantity ? view.remaining - t.quantity : 0);
+            }
+        }
+        pnlFor(cd, m.inst->index).applyFill(is_buy_side, t.quantity, t.price);
+
+        // Passes touch few distinct orders; a linear scan beats hashing here
+        auto it = std::find_if(batch_execs.begin(), batch_execs.end(), [&](const PendingExec& pe) { return pe.order_id == order_id; });
+        if (it == batch_execs.end()) it = batch_execs.insert(batch_execs.end(), PendingExec{order_id, cd->client_id, is_buy_side});
+        it->quantity += t.quantity;
+        it->notional += t.price * t.quantity;
+        ++it->fills;
+    };
+
+    // Update both sides (buy, sell)
+    handleSide(t.buy_order_id, t.buy_client, true, ev.buy_filled);
+    handleSide(t.sell_order_id, t.sell_client, false, ev.sell_filled);
+
+    m.batch_trades.push_back(t);
+    if (ev.batch_last) flushTradeBatch(m);
+}
+
+// Mirror an accepted order on its client
+static void recordSubmitted(ClientData* cd, const Market& m, uint64_t order_id, bool is_buy, double price, uint32_t remaining, OrderStatus status) {
+    stat_orders_submitted.fetch_add(1, std::memory_order_relaxed);
+    if (status == OrderStatus::Open) addLiveOrder(cd, order_id, m.inst->index, is_buy, price, remaining);
+    else rememberFinished(cd, order_id, status);
+}
+
+static void recordCanceled(ClientData* cd, uint64_t order_id) {
+    stat_orders_canceled.fetch_add(1, std::memory_order_relaxed);
+    finishOrder(cd, order_id, OrderStatus::Canceled);
+}
+
+// Reply to the request that produced an engine result; mirrors the synchronous handler responses
+void handleCommandResult(Market& m, const EngineEvent& ev) {
+    auto* ws = findClient(static_cast<int>(ev.client_id));
+    if (!ws) return; // requester disconnected while the command was in flight
+    ClientData* cd = ws->getUserData();
+    // The fixed shapes are written directly; anything left in response goes through json
+    json response;
+    const ReplyStamp stamp{ev.has_corr, ev.corr, ev.seq, ev.timestamp};
+    // Rejection reason for binary acks
+    bin::Reason reason = ev.success ? bin::Ok
+        : ev.status == OrderStatus::NotFound && ev.type != EngineEventType::SubmitResult ? bin::NotFound
+        : ev.status != OrderStatus::Open && ev.type != EngineEventType::SubmitResult ? bin::NotOpen
+        : bin::Rejected;
+    switch (ev.type) {
+    case EngineEventType::SubmitResult: {
+        OrderStatus final_status = OrderStatus::NotFound;
+        uint32_t filled_qty = 0;
+        if (ev.success) {
+            final_status = ev.status;
+            filled_qty = ev.filled_qty;
+            recordSubmitted(cd, m, ev.order_id, ev.is_buy, ev.price, ev.remaining, ev.status);
+        }
+        LOG_DEBUG("Submit done {} id={} status={} filled={}", m.inst->symbol, ev.order_id, static_cast<int>(final_status), filled_qty);
+        if (cd->binary) {
+            auto ack = bin::make<bin::SubmitAckMsg>(bin::SubmitAck, ev.has_corr);
+            ack.success = ev.success;
+            ack.status = static_cast<uint8_t>(final_status);
+            ack.reason = reason;
+            ack.filled_qty = filled_qty;
+            ack.corr = ev.corr;
+            ack.order_id = ev.order_id;
+            sendBinary(ws, ack);
+            break;
+        }
+        sendWritten(ws, [&](JsonWriter& w) {
+            w.beginObject();
+            stamp.corrField(w);
+            w.field("filled_qty", filled_qty).field("id", ev.order_id);
+            stamp.seqField(w);
+            w.field("status", static_cast<int>(final_status)).field("success", ev.success).field("symbol", m.inst->symbol);
+            stamp.timestampField(w);
+            w.field("type", "submit_response").endObject();
+        });
+        break;
+    }
+    case EngineEventType::CancelResult: {
+        if (ev.success) recordCanceled(cd, ev.order_id);
+        LOG_DEBUG("Cancel done id={} ok={} took={}ms status={}", ev.order_id, ev.success, ev.elapsed_ms, static_cast<int>(ev.status));
+        if (cd->binary) {
+            auto ack = bin::make<bin::OrderAckMsg>(bin::CancelAck, ev.has_corr);
+            ack.success = ev.success;
+            ack.status = static_cast<uint8_t>(ev.status);
+            ack.reason = reason;
+            ack.elapsed_ms = static_cast<uint32_t>(ev.elapsed_ms);
+            ack.corr = ev.corr;
+            ack.order_id = ev.order_id;
+            sendBinary(ws, ack);
+            break;
+        }
+        sendWritten(ws, [&](JsonWriter& w) {
+            w.beginObject();
+            stamp.corrField(w);
+            w.field("elapsed_ms", ev.elapsed_ms);
+            stamp.seqField(w);
+            w.field("status", static_cast<int>(ev.status)).field("success", ev.success);
+            stamp.timestampField(w);
+            w.field("type", "cancel_response").endObject();
+        });
+        break;
+    }
+    case EngineEventType::ModifyResult: {
+        if (ev.success) {
+            auto itView = cd->live_orders.find(ev.order_id);
+            if (ev.status != OrderStatus::Open) finishOrder(cd, ev.order_id, ev.status);
+            else if (itView != cd->live_orders.end()) amendLiveOrder(cd, itView->second, ev.price, ev.remaining);
+            LOG_DEBUG("Modify done id={} ok={} newStatus={}", ev.order_id, ev.success, static_cast<int>(ev.status));
+        }
+        if (cd->binary) {
+            auto ack = bin::make<bin::OrderAckMsg>(bin::ModifyAck, ev.has_corr);
+            ack.success = ev.success;
+            ack.status = static_cast<uint8_t>(ev.status);
+            ack.reason = reason;
+            ack.corr = ev.corr;
+            ack.order_id = ev.order_id;
+            sendBinary(ws, ack);
+            break;
+        }
+        // Failures explain themselves; "Order not found" carries no status
+        const char* message = nullptr;
+        if (!ev.success && ev.status == OrderStatus::NotFound) message = "Order not found";
+        else if (!ev.success && ev.status != OrderStatus::Open) message = "Order not open";
+        sendWritten(ws, [&](JsonWriter& w) {
+            w.beginObject();
+            stamp.corrField(w);
+            if (message) w.field("message", message);
+            stamp.seqField(w);
+            if (ev.success || ev.status != OrderStatus::NotFound) w.field("status", static_cast<int>(ev.status));
+            w.field("success", ev.success);
+            stamp.timestampField(w);
+            w.field("type", "modify_response").endObject();
+        });
+        break;
+    }
+    case EngineEventType::SnapshotResult:
+        sendWritten(ws, [&](JsonWriter& w) { writeSnapshotResponse(w, m, *ev.snapshot, stamp); });
+        break;
+    case EngineEventType::DepthSnapshotResult:
+        // Deltas published after this snapshot carry seq > snapshot seq
+        setFeeds(ws, m, (feedsOf(cd, m.inst->index) & ~FeedBook) | FeedDepth);
+        sendWritten(ws, [&](JsonWriter& w) { writeDepthSnapshot(w, m, *ev.depth, stamp); });
+        break;
+    case EngineEventType::AccountStateResult: {
+        // Position and resting orders the account already had in this book (earlier session or before a restart).
+        // Requested at auth, so it arrives before the result of anything the new session submits.
+        const AccountState& st = *ev.account;
+        if (st.account != cd->account || (st.position == 0 && st.realized_pnl == 0 && st.orders.empty())) return;
+        PnLTracker& pnl = pnlFor(cd, m.inst->index);
+        pnl.position = st.position;
+        pnl.avg_cost = st.avg_cost;
+        pnl.realized_pnl = st.realized_pnl;
+        json open_orders = json::array();
+        for (const Order& o : st.orders) {
+            if (cd->live_orders.count(o.id)) continue;
+            addLiveOrder(cd, o.id, m.inst->index, o.is_buy, o.price, o.quantity);
+            open_orders.push_back(o.id);
+        }
+        response = {{"type", "account_state"}, {"symbol", m.inst->symbol}, {"position", pnl.position},
+                    {"avg_cost", pnl.avg_cost}, {"realized_pnl", pnl.realized_pnl}, {"open_orders", std::move(open_orders)}};
+        break;
+    }
+    case EngineEventType::SubmitBatchResult: {
+        for (const BatchItemResult& item : *ev.batch) {
+            if (item.success) recordSubmitted(cd, m, item.order_id, item.is_buy, item.price, item.remaining, item.status);
+        }
+        LOG_DEBUG("Submit batch done {} orders={}", m.inst->symbol, ev.batch->size());
+        sendWritten(ws, [&](JsonWriter& w) {
+            w.beginObject();
+            stamp.corrField(w);
+            w.key("results").beginArray();
+            for (const BatchItemResult& item : *ev.batch) {
+                w.beginObject().field("filled_qty", item.filled_qty).field("id", item.order_id)
+                    .field("status", static_cast<int>(item.status)).field("success", item.success).endObject();
+            }
+            w.endArray();
+            stamp.seqField(w);
+            w.field("success", true).field("symbol", m.inst->symbol);
+            stamp.timestampField(w);
+            w.field("type", "submit_batch_response").endObject();
+        });
+        break;
+    }
+    case EngineEventType::CancelBatchResult: {
+        size_t canceled = 0;
+        for (const BatchItemResult& item : *ev.batch) {
+            if (item.success) {
+                recordCanceled(cd, item.order_id);
+                ++canceled;
+            }
+        }
+        LOG_DEBUG("Cancel batch done {} canceled={}/{}", m.inst->symbol, canceled, ev.batch->size());
+        sendWritten(ws, [&](JsonWriter& w) {
+            w.beginObject().field("canceled", canceled);
+            stamp.corrField(w);
+            w.key("results").beginArray();
+            for (const BatchItemResult& item : *ev.batch) {
+                w.beginObject().field("id", item.order_id).field("status", static_cast<int>(item.status))
+                    .field("success", item.success).endObject();
+            }
+            w.endArray();
+            stamp.seqField(w);
+            w.field("success", true).field("symbol", m.inst->symbol);
+            stamp.timestampField(w);
+            w.field("type", "cancel_batch_response").endObject();
+        });
+        break;
+    }
+    case EngineEventType::Trade:
+    case EngineEventType::Depth:
+        return;
+    }
+    if (!response.is_null()) {
+        if (ev.has_corr) response["corr"] = ev.corr;
+        if (ev.seq) {
+            // Position in the book's event stream and engine time (ns) of the command
+            response["seq"] = ev.seq;
+            response["timestamp"] = ev.timestamp;
+        }
+        sendJson(ws, response);
+    }
+}
+
+// Single entry point for everything an instrument's engine publishes (runs on the loop thread)
+void handleEngineEvent(Market& m, const EngineEvent& ev) {
+    m.best_bid = ev.best_bid;
+    m.best_ask = ev.best_ask;
+    if (ev.type == EngineEventType::Trade) {
+        handleTradeEvent(m, ev);
+    } else if (ev.type == EngineEventType::Depth) {
+        broadcastBookDelta(m, ev);
+        scheduleBroadcast(m); // any level change makes the per-order snapshot stale
+    } else if (ev.type == EngineEventType::SnapshotResult && ev.client_id == 0) {
+        sendSnapshotToAll(m, *ev.snapshot);
+    } else {
+        handleCommandResult(m, ev);
+    }
+}
+
+// Queue a client command on the instrument's engine; false (and an error reply) if it is saturated
+template <typename WS>
+static bool postCommand(WS* ws, Market& m, EngineCommand cmd) {
+    if (postToEngine(*m.inst, cmd)) return true;
+    if (ws->getUserData()->binary && cmd.type != EngineCommandType::Snapshot) {
+        sendBinaryError(ws, bin::EngineBusy, cmd.corr, cmd.has_corr);
+        return false;
+    }
+    const char* reason = intakeClosed.load(std::memory_order_relaxed) ? "Server shutting down" : "Engine busy";
+    sendWritten(ws, [&](JsonWriter& w) { writeError(w, reason, ReplyStamp{cmd.has_corr, cmd.corr}); });
+    return false;
+}
+
+// Order entry shared by the JSON and binary decoders. Each call answers the
+// request exactly once: either an immediate rejection or the engine result.
+template <typename WS>
+static void enterSubmit(WS* ws, Market& m, double price, uint32_t qty, bool is_buy, TimeInForce tif, bool market, uint64_t corr, bool hasCorr) {
+    LOG_DEBUG("Submit start {} side={} px={} qty={} tif={}{}", m.inst->symbol, is_buy ? "BUY" : "SELL", price, qty, static_cast<int>(tif), market ? " market" : "");
+    EngineCommand cmd;
+    cmd.type = EngineCommandType::Submit;
+    cmd.price = price;
+    cmd.quantity = qty;
+    cmd.is_buy = is_buy;
+    cmd.tif = tif;
+    cmd.market = market;
+    cmd.client_id = ws->getUserData()->client_id;
+    cmd.account = ws->getUserData()->account;
+    cmd.corr = corr; cmd.has_corr = hasCorr;
+    postCommand(ws, m, cmd);
+}
+
+// Order fields of a submit or submit_batch entry: price (not for market orders),
+// qty, is_buy, optional "order_type" ("limit"/"market") and "tif" ("GTC"/"IOC"/"FOK").
+// Returns the rejection message, or nullptr if `out` was filled in.
+static const char* parseOrderFields(const jreq::Request& r, BatchOrder& out) {
+    std::string_view order_type = r[jreq::FOrderType].str("limit");
+    std::string_view tif_text = r[jreq::FTif].str("GTC");
+    const jreq::Value& price = r[jreq::FPrice];
+    const jreq::Value& qty = r[jreq::FQty];
+    const jreq::Value& is_buy = r[jreq::FIsBuy];
+    out.market = order_type == "market";
+    if ((!out.market && !price.present()) || !qty.present() || !is_buy.present()) return "Missing required fields for submit";
+    if ((price.present() && !price.isNumber()) || !qty.isUnsigned() || !is_buy.isBool()) {
+        return "Invalid field types for submit";
+    }
+    if ((!out.market && order_type != "limit") || (tif_text != "GTC" && tif_text != "IOC" && tif_text != "FOK")) {
+        return "Invalid order_type or tif for submit";
+    }
+    out.tif = tif_text == "IOC" ? TimeInForce::IOC : tif_text == "FOK" ? TimeInForce::FOK : TimeInForce::GTC;
+    out.price = price.num(0.0);
+    out.quantity = static_cast<uint32_t>(qty.u);
+    out.is_buy = is_buy.b;
+    return nullptr;
+}
+
+// Several orders on one instrument, applied by the engine as one command with one combined reply
+template <typename WS>
+static void enterSubmitBatch(WS* ws, Market& m, std::vector<BatchOrder>&& orders, uint64_t corr, bool hasCorr) {
+    LOG_DEBUG("Submit batch start {} orders={}", m.inst->symbol, orders.size());
+    EngineCommand cmd;
+    cmd.type = EngineCommandType::SubmitBatch;
+    cmd.orders = std::make_shared<const std::vector<BatchOrder>>(std::move(orders));
+    cmd.client_id = ws->getUserData()->client_id;
+    cmd.account = ws->getUserData()->account;
+    cmd.corr = corr; cmd.has_corr = hasCorr;
+    postCommand(ws, m, cmd);
+}
+
+// Cancel owned orders of one instrument as a single engine command
+template <typename WS>
+static void enterCancelBatch(WS* ws, Market& m, std::vector<uint64_t>&& ids, uint64_t corr, bool hasCorr) {
+    LOG_DEBUG("Cancel batch start {} orders={}", m.inst->symbol, ids.size());
+    EngineCommand cmd;
+    cmd.type = EngineCommandType::CancelBatch;
+    cmd.order_ids = std::make_shared<const std::vector<uint64_t>>(std::move(ids));
+    cmd.client_id = ws->getUserData()->client_id;
+    cmd.corr = corr; cmd.has_corr = hasCorr;
+    postCommand(ws, m, cmd);
+}
+
+template <typename WS>
+static void rejectNotOwned(WS* ws, bin::MsgType ack_type, const char* response_type, uint64_t id, uint64_t corr, bool hasCorr) {
+    if (ws->getUserData()->binary) {
+        auto ack = bin::make<bin::OrderAckMsg>(ack_type, hasCorr);
+        ack.status = static_cast<uint8_t>(OrderStatus::NotFound);
+        ack.reason = bin::NotOwned;
+        ack.corr = corr;
+        ack.order_id = id;
+        sendBinary(ws, ack);
+        return;
+    }
+    sendWritten(ws, [&](JsonWriter& w) {
+        w.beginObject();
+        if (hasCorr) w.field("corr", corr);
+        w.field("message", "Order not owned by user").field("success", false).field("type", response_type).endObject();
+    });
+}
+
+template <typename WS>
+static void enterCancel(WS* ws, uint64_t id, uint64_t corr, bool hasCorr) {
+    LOG_DEBUG("Cancel request id={}", id);
+    if (!ownsOrder(ws->getUserData(), id)) {
+        rejectNotOwned(ws, bin::CancelAck, "cancel_response", id, corr, hasCorr);
+        return;
+    }
+    Market* m = marketForOrder(id); // owned orders always map to a registered instrument
+    if (!m) return;
+    EngineCommand cmd;
+    cmd.type = EngineCommandType::Cancel;
+    cmd.order_id = id;
+    cmd.client_id = ws->getUserData()->client_id;
+    cmd.corr = corr; cmd.has_corr = hasCorr;
+    postCommand(ws, *m, cmd);
+}
+
+template <typename WS>
+static void enterModify(WS* ws, uint64_t id, double price, uint32_t qty, uint64_t corr, bool hasCorr) {
+    LOG_DEBUG("Modify request id={} new_px={} new_qty={}", id, price, qty);
+    if (!ownsOrder(ws->getUserData(), id)) {
+        rejectNotOwned(ws, bin::ModifyAck, "modify_response", id, corr, hasCorr);
+        return;
+    }
+    Market* m = marketForOrder(id);
+    if (!m) return;
+    // Status checks (not found / not open) happen in the engine against the live book
+    EngineCommand cmd;
+    cmd.type = EngineCommandType::Modify;
+    cmd.order_id = id;
+    cmd.price = price;
+    cmd.quantity = qty;
+    cmd.client_id = ws->getUserData()->client_id;
+    cmd.corr = corr; cmd.has_corr = hasCorr;
+    postCommand(ws, *m, cmd);
+}
+
+// Decode one binary order-entry frame. A client that sends binary is switched
+// to binary acks and pushes for the rest of the session.
+template <typename WS>
+static void handleBinaryMessage(WS* ws, std::string_view frame) {
+    ClientData* cd = ws->getUserData();
+    switchToBinary(ws);
+    uint64_t corr = 0;
+    bool hasCorr = bin::requestCorr(frame, corr);
+    if (!cd->authenticated) {
+        sendBinaryError(ws, bin::NotAuthenticated, corr, hasCorr);
+        return;
+    }
+    switch (bin::frameType(frame)) {
+    case bin::Submit: {
+        bin::SubmitMsg m;
+        if (!bin::decode(frame, m)) break;
+        if (m.instrument >= markets.size()) {
+            sendBinaryError(ws, bin::UnknownInstrument, corr, hasCorr);
+            return;
+        }
+        if ((m.order_flags & bin::kOrderIOC) && (m.order_flags & bin::kOrderFOK)) break;
+        TimeInForce tif = m.order_flags & bin::kOrderFOK ? TimeInForce::FOK
+                        : m.order_flags & bin::kOrderIOC ? TimeInForce::IOC : TimeInForce::GTC;
+        enterSubmit(ws, *markets[m.instrument], m.price, m.qty, m.is_buy != 0, tif, (m.order_flags & bin::kOrderMarket) != 0, corr, hasCorr);
+        return;
+    }
+    case bin::Cancel: {
+        bin::CancelMsg m;
+        if (!bin::decode(frame, m)) break;
+        enterCancel(ws, m.order_id, corr, hasCorr);
+        return;
+    }
+    case bin::Modify: {
+        bin::ModifyMsg m;
+        if (!bin::decode(frame, m)) break;
+        enterModify(ws, m.order_id, m.price, m.qty, corr, hasCorr);
+        return;
+    }
+    default:
+        break;
+    }
+    sendBinaryError(ws, bin::Malformed, corr, hasCorr);
+}
+
+// Stop every worker posting to the engines (runs on worker 0's loop). A worker
+// that has run the deferred no-op has finished whatever handler it was in and
+// sees intakeClosed from then on, so once all have, nothing races the engines'
+// stop() or lands after their final snapshot.
+static void closeIntake() {
+    intakeClosed.store(true, std::memory_order_release);
+    auto remaining = std::make_shared<std::atomic<size_t>>(workers.size() - 1);
+    for (size_t i = 1; i < workers.size(); ++i) {
+        workers[i]->loop->defer([remaining]() { remaining->fetch_sub(1, std::memory_order_acq_rel); });
+    }
+    while (remaining->load(std::memory_order_acquire) != 0) std::this_thread::yield();
+}
+
 // Signal handler (only sets flags or defers heavy work)
 void handleSigInt(int) {
     if (!shutdownRequested.exchange(true)) {
-        if (g_loop) {
-            g_loop->defer([](){
+        if (g_main_loop) {
+            g_main_loop->defer([](){
                 if (shutdownInProgress.exchange(true)) return;
-                LOG("SIGINT received: generating final stats...");
+                LOG_INFO("SIGINT received: closing intake...");
+                closeIntake();
+                LOG_INFO("Generating final stats...");
                 printFinalStats();
-                LOG("Exiting after stats (first SIGINT).");
+                LOG_INFO("Exiting after stats (first SIGINT).");
+                // Other workers are still running their loops; don't tear down statics under them
+                if (workers.size() > 1) { logging::flush(); std::cerr.flush(); std::cout.flush(); std::_Exit(0); }
+                logging::stop();
                 std::exit(0);
             });
         } else {
@@ -301,263 +1461,259 @@ void handleSigInt(int) {
     }
 }
 
-int main() {
-    // Register signal handler early
-    std::signal(SIGINT, handleSigInt);
-    // Seed initial book liquidity before accepting clients (configurable defaults)
-    seedInitialBook(100.0, 0.5, 5, 10);
-    LOG("Server starting; initial seed (if empty) applied");
-
+// One event loop: its own App, client state and per-instrument market state
+static void runWorker(Worker& w, bool compress_topics, std::promise<void> ready, std::shared_future<void> go) {
+    worker_index = w.index;
     uWS::App app;
+    g_app = &app;
     g_loop = uWS::Loop::get();
+    w.loop = g_loop;
+    // Snapshots and PnL pushes are large and repetitive; compress them once per publish
+    topic_pnl.compress = compress_topics;
+    instruments.forEach([&](Instrument& inst) {
+        auto m = std::make_unique<Market>(&inst);
+        m->best_bid = inst.book.getBestBidPrice();
+        m->best_ask = inst.book.getBestAskPrice();
+        m->topic_book.compress = compress_topics;
+        w.markets.push_back(m.get());
+        markets.push_back(std::move(m));
+    });
+    ready.set_value();
+    go.wait(); // engines must be running before the first client command arrives
 
-    // onTradePnLUpdate removed; onTradeEvent handles notifications
+    us_timer_t* gauges_timer = us_create_timer(reinterpret_cast<us_loop_t*>(g_loop), 0, 0);
+    us_timer_set(gauges_timer, [](us_timer_t*) { refreshWorkerGauges(); }, 1000, 1000);
+    // Plain HTTP scrape on the same port; the router prefers this static route over "/*"
+    app.get("/metrics", [](auto* res, auto* /*req*/) {
+        res->writeHeader("Content-Type", "text/plain; version=0.0.4")->end(buildPrometheus());
+    });
 
-    // Comprehensive trade event callback: update positions, realized PnL, broadcast
-    orderBook.onTradeEvent = [](const Trade& t){
-        stat_trade_events.fetch_add(1, std::memory_order_relaxed);
-        stat_traded_quantity.fetch_add(t.quantity, std::memory_order_relaxed);
-        last_trade_price = t.price;
-        auto handleSide = [&](uint64_t order_id, bool is_buy_side){
-            auto itOwner = order_to_client.find(order_id);
-            if (itOwner == order_to_client.end()) return;
-            ClientData* cd = itOwner->second; if (!cd) return;
-            int64_t pos = cd->position;
-            double avg = cd->avg_cost;
-            uint32_t qty = t.quantity;
-            double px = t.price;
-            if (pos == 0) avg = 0.0; // reset anchor
-            if (is_buy_side) {
-                if (pos < 0) { // covering short
-                    uint32_t closing = std::min<uint32_t>(qty, static_cast<uint32_t>(-pos));
-                    cd->realized_pnl += (avg - px) * closing; // short profit if avg>px
-                    pos += closing; // less negative
-                    uint32_t opening = qty - closing;
-                    if (opening > 0) { pos += opening; avg = px; }
-                    else if (pos == 0) avg = 0.0;
-                } else { // adding / starting long
-                    int64_t new_pos = pos + qty;
-                    avg = (pos > 0) ? ((avg * pos) + (px * qty)) / new_pos : px;
-                    pos = new_pos;
-                }
-            } else { // sell side
-                if (pos > 0) { // reducing long
-                    uint32_t closing = std::min<uint32_t>(qty, static_cast<uint32_t>(pos));
-                    cd->realized_pnl += (px - avg) * closing; // long profit if px>avg
-                    pos -= closing;
-                    uint32_t opening = qty - closing;
-                    if (opening > 0) { pos -= opening; avg = px; }
-                    else if (pos == 0) avg = 0.0;
-                } else { // adding / starting short
-                    uint64_t absPos = static_cast<uint64_t>(-pos);
-                    uint64_t new_abs = absPos + qty;
-                    avg = (absPos > 0) ? ((avg * absPos) + (px * qty)) / new_abs : px;
-                    pos -= qty;
-                }
-            }
-            cd->position = pos;
-            cd->avg_cost = avg;
-        };
-
-        // Update both sides (buy, sell)
-        handleSide(t.buy_order_id, true);
-        handleSide(t.sell_order_id, false);
-
-        // Broadcast aggregate trade event
-        try { broadcastTradeEvent(t); } catch (...) { LOG("Trade broadcast exception"); }
-
-        // Send execution events to owners (optional for reducing status polling)
-        auto sendExec = [&](uint64_t order_id, bool is_buy_side){
-            auto itOwner = order_to_client.find(order_id);
-            if (itOwner == order_to_client.end()) return;
-            ClientData* cd = itOwner->second; if (!cd) return;
-            for (auto* ws : connected_clients) {
-                if (ws->getUserData() == cd) {
-                    double unreal_exec = getUnrealizedPnL(cd); // compute fresh unrealized for push
-                    json exec = {
-                        {"type","execution"},
-                        {"order_id", order_id},
-                        {"side", is_buy_side ? "buy" : "sell"},
-                        {"price", t.price},
-                        {"quantity", t.quantity},
-                        {"position", cd->position},
-                        {"avg_cost", cd->avg_cost},
-                        {"realized_pnl", cd->realized_pnl},
-                        {"unrealized_pnl", unreal_exec}
-                    };
-                    ws->send(exec.dump());
-                    break;
-                }
-            }
-        };
-        sendExec(t.buy_order_id, true);
-        sendExec(t.sell_order_id, false);
-
-        // Defer filled detection until after matching engine releases locks & statuses updated
-        if (g_loop) {
-            uint64_t bId = t.buy_order_id;
-            uint64_t sId = t.sell_order_id;
-            g_loop->defer([bId, sId](){
-                auto check = [&](uint64_t id){
-                    if (!id) return;
-                    OrderStatus st = orderBook.getOrderStatus(id);
-                    if (st == OrderStatus::Filled) {
-                        std::lock_guard<std::mutex> lk(filled_set_mutex);
-                        filled_order_set.insert(id);
-                    }
-                };
-                check(bId);
-                check(sId);
-            });
-        }
-
-        scheduleBroadcast();
-        // Broadcast multi-agent PnL snapshot
-        try {
-            json push = { {"type","all_pnl_push"}, {"clients", buildAllPnL()} };
-            std::string s = push.dump();
-            for (auto* ws : connected_clients) ws->send(s);
-        } catch (...) { LOG("all_pnl_push broadcast error"); }
-    };
     app.ws<ClientData>("/*", {
+        .compression = compress_topics ? uWS::SHARED_COMPRESSOR : uWS::DISABLED,
         // Handle new client connection
         .open = [](auto* ws) {
             ws->getUserData()->authenticated = false;
             ws->getUserData()->client_id = next_client_id.fetch_add(1);
             ws->send(R"({"type":"welcome","message":"Please authenticate"})");
             connected_clients.insert(ws);
-            LOG("Client connected");
+            clients_by_id[ws->getUserData()->client_id] = ws;
+            // Market data of the primary instrument; "subscribe" adds others, subscribeDepth
+            // swaps "book" for "depth", binary order entry swaps the trade feed
+            setFeeds(ws, *markets.front(), FeedBook | FeedTrades);
+            ws->subscribe(topic_pnl.name);
+            LOG_INFO("Client connected");
         },
         // Handle incoming messages
     .message = [](auto* ws, std::string_view msg, uWS::OpCode opCode) {
-            LOG("Recv: " << msg);
+            metrics::ScopedTimer handler_timer(metrics::Handler);
+            // Binary order entry; JSON may still arrive in binary frames
+            if (opCode == uWS::OpCode::BINARY && bin::isBinaryFrame(msg)) {
+                handleBinaryMessage(ws, msg);
+                return;
+            }
+            LOG_DEBUG("Recv: {}", msg);
             try {
-                json j = json::parse(msg);
-                std::string type = j.value("type", "");
+                jreq::Request req;
+                json j; // only parsed when the fast decoder gives up; holds the strings req points at
+                {
+                    metrics::ScopedTimer parse_timer(metrics::Parse);
+                    if (!jreq::decode(msg, req)) {
+                        j = json::parse(msg);
+                        if (!jreq::fromJson(j, req)) throw std::invalid_argument("request is not an object");
+                    }
+                }
+                jreq::Type type = jreq::typeOf(req[jreq::FType].str(""));
                 json response;
-        bool triggerBroadcast = false;
+        bool deferred = false; // reply already written, or sent from the engine result instead
         // Correlation id support: echo back any unsigned integer 'corr' provided in request
         uint64_t corr = 0; bool hasCorr = false;
-        try {
-            if (j.contains("corr") && j["corr"].is_number_unsigned()) { corr = j["corr"]; hasCorr = true; }
-        } catch (...) { /* ignore corr extraction issues */ }
+        if (req[jreq::FCorr].isUnsigned()) { corr = req[jreq::FCorr].u; hasCorr = true; }
 
                 // Authentication check
-                if (!ws->getUserData()->authenticated && type != "auth") {
+                if (!ws->getUserData()->authenticated && type != jreq::Type::Auth) {
                     response = {{"type","error"},{"message","Not authenticated"}};
                     if (hasCorr) response["corr"] = corr;
-                    ws->send(response.dump());
+                    sendJson(ws, response);
                     return;
                 }
 
-                if (type == "auth") {
-                    std::string token = j.value("token", "");
-                    std::string providedName = j.value("name", "");
+                switch (type) {
+                case jreq::Type::Auth: {
+                    std::string_view token = req[jreq::FToken].str("");
+                    std::string providedName(req[jreq::FName].str(""));
+                    std::string_view protocol = req[jreq::FProtocol].str("json");
+                    uint32_t account = 0;
+                    bool switching = providedName != ws->getUserData()->name; // re-auth under the same name keeps its account
                     // Replace "your_secret_token" with your real token or validation logic
-                    if (token == "your_secret_token") {
+                    if (token != "your_secret_token") {
+                        response = {{"type", "auth_response"}, {"success", false}, {"message", "Invalid token"}};
+                    } else if (switching && !acquireAccount(providedName, account)) {
+                        response = {{"type", "auth_response"}, {"success", false}, {"message", "Account already connected"}};
+                    } else {
+                        if (switching) {
+                            releaseAccount(ws->getUserData()->account);
+                            ws->getUserData()->account = account;
+                        }
                         ws->getUserData()->authenticated = true;
                         ws->getUserData()->name = providedName;
-                        response = {{"type", "auth_response"}, {"success", true}};
+                        // "protocol":"binary" opts into binary acks, executions and trade prints
+                        if (protocol == "binary") switchToBinary(ws);
+                        json list = json::array();
+                        instruments.forEach([&](const Instrument& inst) {
+                            list.push_back({{"symbol", inst.symbol}, {"index", inst.index}, {"tick_size", inst.book.tick_size}});
+                        });
+                        response = {{"type", "auth_response"}, {"success", true},
+                                    {"protocol", ws->getUserData()->binary ? "binary" : "json"}, {"binary_version", bin::kVersion},
+                                    {"instruments", std::move(list)}};
+                        if (ws->getUserData()->account) response["account"] = ws->getUserData()->account;
+                        if (switching && ws->getUserData()->account) {
+                            // Hand back what the account holds; each book answers with an account_state push
+                            EngineCommand cmd;
+                            cmd.type = EngineCommandType::AccountState;
+                            cmd.client_id = ws->getUserData()->client_id;
+                            cmd.account = ws->getUserData()->account;
+                            for (const auto& m : markets) {
+                                if (!postToEngine(*m->inst, cmd)) LOG_WARN("Account state request dropped: {} engine queue full", m->inst->symbol);
+                            }
+                        }
+                    }
+                    break;
+                }
+                case jreq::Type::Submit: {
+                    Market* m = marketFor(req);
+                    BatchOrder o;
+                    if (const char* error = parseOrderFields(req, o)) {
+                        response = {{"type", "error"}, {"message", error}};
+                    } else if (!m) {
+                        response = {{"type", "error"}, {"message", "Unknown symbol"}};
                     } else {
-                        response = {{"type", "auth_response"}, {"success", false}, {"message", "Invalid token"}};
+                        enterSubmit(ws, *m, o.price, o.quantity, o.is_buy, o.tif, o.market, corr, hasCorr);
+                        deferred = true;
+                    }
+                    break;
+                }
+                case jreq::Type::SubmitBatch: {
+                    // All orders go to one instrument; any invalid entry rejects the whole batch
+                    Market* m = marketFor(req);
+                    // Arrays always come through the nlohmann path, so j holds them
+                    const json* list = req[jreq::FOrders].kind == jreq::Kind::Array ? &j.at("orders") : nullptr;
+                    std::vector<BatchOrder> orders;
+                    std::string error;
+                    if (!list || list->empty() || list->size() > BATCH_MAX_ORDERS) {
+                        error = "orders must be an array of 1 to " + std::to_string(BATCH_MAX_ORDERS) + " orders";
+                    } else {
+                        orders.resize(list->size());
+                        jreq::Request entry;
+                        for (size_t i = 0; i < list->size() && error.empty(); ++i) {
+                            const char* e = jreq::fromJson((*list)[i], entry) ? parseOrderFields(entry, orders[i]) : "Invalid order";
+                            if (e) error = std::string(e) + " (order " + std::to_string(i) + ")";
+                        }
                     }
-                } else if (type == "submit") {
-                    if (!j.contains("price") || !j.contains("qty") || !j.contains("is_buy")) {
-                        response = {{"type", "error"}, {"message", "Missing required fields for submit"}};
-                    } else if (!j["price"].is_number() || !j["qty"].is_number_unsigned() || !j["is_buy"].is_boolean()) {
-                        response = {{"type", "error"}, {"message", "Invalid field types for submit"}};
+                    if (!error.empty()) {
+                        response = {{"type", "error"}, {"message", error}};
+                    } else if (!m) {
+                        response = {{"type", "error"}, {"message", "Unknown symbol"}};
                     } else {
-                        double price = j["price"];
-                        uint32_t qty = j["qty"];
-                        bool is_buy = j["is_buy"];
-                        LOG("Submit start side=" << (is_buy?"BUY":"SELL") << " px=" << price << " qty=" << qty);
-                        uint64_t id = orderBook.submitOrder(price, qty, is_buy);
-                        bool ok = (id != 0);
-                        uint32_t filled_qty = 0;
-                        OrderStatus final_status = OrderStatus::NotFound;
-                        if (ok) {
-                            stat_orders_submitted.fetch_add(1, std::memory_order_relaxed);
-                            ws->getUserData()->my_orders.insert(id);
-                            order_to_client[id] = ws->getUserData();
-                            // entry price cache removed
-                            final_status = orderBook.getOrderStatus(id);
-                            const Order* ord_ptr = orderBook.getOrderById(id);
-                            if (final_status == OrderStatus::Filled) {
-                                filled_qty = qty;
-                            } else if (ord_ptr) {
-                                filled_qty = qty - ord_ptr->quantity;
-                            }
-                            triggerBroadcast = true;
+                        enterSubmitBatch(ws, *m, std::move(orders), corr, hasCorr);
+                        deferred = true;
+                    }
+                    break;
+                }
+                case jreq::Type::CancelBatch: {
+                    // Every id must be owned and belong to the same instrument
+                    const json* list = req[jreq::FIds].kind == jreq::Kind::Array ? &j.at("ids") : nullptr;
+                    const ClientData* cd = ws->getUserData();
+                    std::vector<uint64_t> ids;
+                    Market* m = nullptr;
+                    std::string error;
+                    if (!list || list->empty() || list->size() > BATCH_MAX_ORDERS) {
+                        error = "ids must be an array of 1 to " + std::to_string(BATCH_MAX_ORDERS) + " order ids";
+                    } else {
+                        ids.reserve(list->size());
+                        for (const auto& v : *list) {
+                            if (!v.is_number_unsigned()) { error = "Invalid id for cancel_batch"; break; }
+                            uint64_t id = v.get<uint64_t>();
+                            Market* om = ownsOrder(cd, id) ? marketForOrder(id) : nullptr;
+                            if (!om) { error = "Order not owned by user: " + std::to_string(id); break; }
+                            if (m && om != m) { error = "cancel_batch ids must belong to one symbol"; break; }
+                            m = om;
+                            ids.push_back(id);
                         }
-                        response = {{"type", "submit_response"}, {"success", ok}, {"id", id}, {"filled_qty", filled_qty}, {"status", static_cast<int>(final_status)}};
-                        LOG("Submit done id=" << id << " status=" << static_cast<int>(final_status) << " filled=" << filled_qty);
                     }
-                } else if (type == "cancel") {
-                    if (!j.contains("id") || !j["id"].is_number_unsigned()) {
-                        response = {{"type","error"},{"message","Missing or invalid id for cancel"}};
+                    if (!error.empty()) {
+                        response = {{"type", "error"}, {"message", error}};
                     } else {
-                        uint64_t id = j["id"];
-                        LOG("Cancel request id=" << id);
-                        if (!ws->getUserData()->my_orders.count(id)) {
-                            response = {{"type","cancel_response"},{"success",false},{"message","Order not owned by user"}};
+                        enterCancelBatch(ws, *m, std::move(ids), corr, hasCorr);
+                        deferred = true;
+                    }
+                    break;
+                }
+                case jreq::Type::CancelAll: {
+                    // Open orders of this session on one symbol, optionally one side ("side": "buy"/"sell")
+                    // and an inclusive price range ("min_price" / "max_price")
+                    Market* m = marketFor(req);
+                    std::string_view side = req[jreq::FSide].str("");
+                    const jreq::Value& min_price_field = req[jreq::FMinPrice];
+                    const jreq::Value& max_price_field = req[jreq::FMaxPrice];
+                    bool badRange = (min_price_field.present() && !min_price_field.isNumber()) || (max_price_field.present() && !max_price_field.isNumber());
+                    if (!m) {
+                        response = {{"type", "error"}, {"message", "Unknown symbol"}};
+                    } else if ((!side.empty() && side != "buy" && side != "sell") || badRange) {
+                        response = {{"type", "error"}, {"message", "Invalid side or price range for cancel_all"}};
+                    } else {
+                        double min_price = min_price_field.num(0.0);
+                        double max_price = max_price_field.num(std::numeric_limits<double>::infinity());
+                        // The book's prices are ticks * tick_size; allow for rounding at the bounds
+                        double slack = m->inst->book.tick_size * 1e-6;
+                        std::vector<uint64_t> ids; // oldest first
+                        for (const OrderView* view = ws->getUserData()->oldest_order; view; view = view->next) {
+                            if (view->instrument != m->inst->index) continue;
+                            if (!side.empty() && view->is_buy != (side == "buy")) continue;
+                            if (view->price < min_price - slack || view->price > max_price + slack) continue;
+                            ids.push_back(view->id);
+                        }
+                        if (ids.empty()) {
+                            response = {{"type", "cancel_batch_response"}, {"success", true}, {"symbol", m->inst->symbol},
+                                        {"canceled", 0}, {"results", json::array()}};
                         } else {
-                            auto start = std::chrono::steady_clock::now();
-                            bool ok = orderBook.cancelOrder(id); // single attempt without pre-status query
-                            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now()-start).count();
-                            OrderStatus after = ok ? OrderStatus::Canceled : orderBook.getOrderStatus(id);
-                            if (ok) {
-                                stat_orders_canceled.fetch_add(1, std::memory_order_relaxed);
-                                ws->getUserData()->my_orders.erase(id);
-                                order_to_client.erase(id);
-                                // entry price cache removed
-                                triggerBroadcast = true;
-                            }
-                            response = {{"type","cancel_response"},{"success",ok},{"status", static_cast<int>(after)},{"elapsed_ms", elapsed}};
-                            LOG("Cancel done id=" << id << " ok=" << ok << " took=" << elapsed << "ms status=" << static_cast<int>(after));
+                            enterCancelBatch(ws, *m, std::move(ids), corr, hasCorr);
+                            deferred = true;
                         }
                     }
-                } else if (type == "modify") {
+                    break;
+                }
+                case jreq::Type::Cancel: {
+                    if (!req[jreq::FId].isUnsigned()) {
+                        response = {{"type","error"},{"message","Missing or invalid id for cancel"}};
+                    } else {
+                        enterCancel(ws, req[jreq::FId].u, corr, hasCorr);
+                        deferred = true;
+                    }
+                    break;
+                }
+                case jreq::Type::Modify: {
                     // Check for required fields and types
-                    if (!j.contains("id") || !j["id"].is_number_unsigned() ||
-                        !j.contains("price") || !j["price"].is_number() ||
-                        !j.contains("qty") || !j["qty"].is_number_unsigned()) {
+                    if (!req[jreq::FId].isUnsigned() || !req[jreq::FPrice].isNumber() || !req[jreq::FQty].isUnsigned()) {
                         response = {{"type", "error"}, {"message", "Missing or invalid fields for modify"}};
                     } else {
-                        uint64_t id = j["id"];
-                        double price = j["price"];
-                        uint32_t qty = j["qty"];
-                        LOG("Modify request id=" << id << " new_px=" << price << " new_qty=" << qty);
-                        if (!ws->getUserData()->my_orders.count(id)) {
-                            response = {{"type", "modify_response"}, {"success", false}, {"message", "Order not owned by user"}};
-                        } else {
-                            OrderStatus status = orderBook.getOrderStatus(id);
-                            if (status == OrderStatus::NotFound) {
-                                response = {{"type", "modify_response"}, {"success", false}, {"message", "Order not found"}};
-                            } else if (status != OrderStatus::Open) {
-                                response = {{"type", "modify_response"}, {"success", false}, {"message", "Order not open"}, {"status", static_cast<int>(status)}};
-                            } else {
-                                bool ok = orderBook.modifyOrder(id, price, qty);
-                                OrderStatus newStatus = orderBook.getOrderStatus(id);
-                                if (ok) {
-                                    order_to_client[id] = ws->getUserData();
-                                    // entry price cache removed
-                                    triggerBroadcast = true;
-                                }
-                                response = {{"type", "modify_response"}, {"success", ok}, {"status", static_cast<int>(newStatus)}};
-                                LOG("Modify done id=" << id << " ok=" << ok << " newStatus=" << static_cast<int>(newStatus));
-                            }
-                        }
+                        enterModify(ws, req[jreq::FId].u, req[jreq::FPrice].d, static_cast<uint32_t>(req[jreq::FQty].u), corr, hasCorr);
+                        deferred = true;
                     }
-                } else if (type == "getOrderStatus") {
+                    break;
+                }
+                case jreq::Type::GetOrderStatus: {
                     // Check for required fields and types
-                    if (!j.contains("id") || !j["id"].is_number_unsigned()) {
+                    if (!req[jreq::FId].isUnsigned()) {
                         response = {{"type", "error"}, {"message", "Missing or invalid id for getOrderStatus"}};
                     } else {
-                        uint64_t id = j["id"];
-                        if (!ws->getUserData()->my_orders.count(id)) {
+                        uint64_t id = req[jreq::FId].u;
+                        const ClientData* cd = ws->getUserData();
+                        bool live = cd->live_orders.count(id) != 0;
+                        const FinishedOrder* finished = live ? nullptr : findFinished(cd, id);
+                        if (!live && !finished) {
                             response = {{"type", "order_status_response"}, {"success", false}, {"message", "Order not owned by user"}};
                         } else {
-                            OrderStatus status = orderBook.getOrderStatus(id);
+                            OrderStatus status = finished ? finished->status : OrderStatus::Open;
                             std::string status_text = (status == OrderStatus::Open ? "open" : status == OrderStatus::Filled ? "filled" : status == OrderStatus::Canceled ? "canceled" : "not_found");
                             response = {
                                 {"type", "order_status_response"},
@@ -568,26 +1724,73 @@ int main() {
                             };
                         }
                     }
-                } else if (type == "getOrderBookSnapshot") {
-                    std::vector<Order> bid_snapshot, ask_snapshot;
-                    orderBook.getOrderBookSnapshot(bid_snapshot, ask_snapshot);
-                    response["type"] = "order_book_snapshot_response";
-                    response["bids"] = json::array();
-                    response["asks"] = json::array();
-                    for (const auto& o : bid_snapshot) {
-                        response["bids"].push_back({{"id", o.id}, {"price", o.price}, {"quantity", o.quantity}, {"is_buy", o.is_buy}, {"status", static_cast<int>(o.status)}});
+                    break;
+                }
+                case jreq::Type::GetTradeHistory: {
+                    // Read straight from the trade ring / journal; safe while the engine keeps matching
+                    Market* m = marketFor(req);
+                    size_t limit = TRADE_HISTORY_DEFAULT_LIMIT;
+                    if (req[jreq::FLimit].isUnsigned()) limit = std::min<size_t>(req[jreq::FLimit].u, TRADE_HISTORY_MAX_LIMIT);
+                    if (!m) {
+                        response = {{"type", "error"}, {"message", "Unknown symbol"}};
+                    } else {
+                        const OrderBook& book = m->inst->book;
+                        uint64_t last_seq = book.lastTradeSeq();
+                        uint64_t since_seq = last_seq > limit ? last_seq - limit : 0; // default: most recent trades
+                        if (req[jreq::FSinceSeq].isUnsigned()) since_seq = req[jreq::FSinceSeq].u;
+                        sendWritten(ws, [&](JsonWriter& w) {
+                            w.beginObject();
+                            if (hasCorr) w.field("corr", corr);
+                            w.field("last_seq", last_seq).field("symbol", m->inst->symbol).key("trades").beginArray();
+                            book.forEachTrade(since_seq, limit, [&](const Trade& t) { writeTrade(w, t); });
+                            w.endArray().field("type", "trade_history_response").endObject();
+                        });
+                        deferred = true;
+                    }
+                    break;
+                }
+                case jreq::Type::GetOrderBookSnapshot:
+                case jreq::Type::SubscribeDepth: {
+                    // subscribeDepth: snapshot of aggregated levels, then book_delta per changed level
+                    Market* m = marketFor(req);
+                    if (!m) {
+                        response = {{"type", "error"}, {"message", "Unknown symbol"}};
+                    } else {
+                        EngineCommand cmd;
+                        cmd.type = type == jreq::Type::SubscribeDepth ? EngineCommandType::DepthSnapshot : EngineCommandType::Snapshot;
+                        cmd.client_id = ws->getUserData()->client_id;
+                        cmd.corr = corr; cmd.has_corr = hasCorr;
+                        postCommand(ws, *m, cmd);
+                        deferred = true;
                     }
-                    for (const auto& o : ask_snapshot) {
-                        response["asks"].push_back({{"id", o.id}, {"price", o.price}, {"quantity", o.quantity}, {"is_buy", o.is_buy}, {"status", static_cast<int>(o.status)}});
+                    break;
+                }
+                case jreq::Type::UnsubscribeDepth: {
+                    Market* m = marketFor(req);
+                    if (!m) {
+                        response = {{"type", "error"}, {"message", "Unknown symbol"}};
+                    } else {
+                        uint8_t feeds = feedsOf(ws->getUserData(), m->inst->index);
+                        if (feeds & FeedDepth) setFeeds(ws, *m, (feeds & ~FeedDepth) | FeedBook);
+                        response = {{"type", "unsubscribe_depth_response"}, {"success", true}, {"symbol", m->inst->symbol}};
                     }
-                } else if (type == "getTradeHistory") {
-                    auto trades = orderBook.getTradeHistory();
-                    response["type"] = "trade_history_response";
-                    response["trades"] = json::array();
-                    for (const auto& t : trades) {
-                        response["trades"].push_back({{"buy_order_id", t.buy_order_id}, {"sell_order_id", t.sell_order_id}, {"price", t.price}, {"quantity", t.quantity}, {"timestamp", t.timestamp}});
+                    break;
+                }
+                case jreq::Type::Subscribe:
+                case jreq::Type::Unsubscribe: {
+                    // Book snapshots and trade prints of one more (or one less) instrument
+                    Market* m = marketFor(req);
+                    if (!m) {
+                        response = {{"type", "error"}, {"message", "Unknown symbol"}};
+                    } else {
+                        uint8_t feeds = feedsOf(ws->getUserData(), m->inst->index);
+                        if (type == jreq::Type::Subscribe) setFeeds(ws, *m, (feeds & FeedDepth ? FeedDepth : FeedBook) | FeedTrades);
+                        else setFeeds(ws, *m, 0);
+                        response = {{"type", type == jreq::Type::Subscribe ? "subscribe_response" : "unsubscribe_response"}, {"success", true}, {"symbol", m->inst->symbol}};
                     }
-                } else if (type == "getRealizedPnL") {
+                    break;
+                }
+                case jreq::Type::GetRealizedPnL: {
                     auto* cd = ws->getUserData();
                     auto &bucket = pnlRate[cd];
                     auto now = std::chrono::steady_clock::now();
@@ -599,10 +1802,12 @@ int main() {
                     } else {
                         response = {
                             {"type", "realized_pnl_response"},
-                            {"pnl", cd->realized_pnl}
+                            {"pnl", getRealizedPnL(cd)}
                         };
                     }
-                } else if (type == "getUnrealizedPnL") {
+                    break;
+                }
+                case jreq::Type::GetUnrealizedPnL: {
                     auto* cd = ws->getUserData();
                     auto &bucket = pnlRate[cd];
                     auto now = std::chrono::steady_clock::now();
@@ -618,56 +1823,272 @@ int main() {
                             {"pnl", pnl}
                         };
                     }
-                } else if (type == "getAllPnL") {
-                    response = {
-                        {"type", "all_pnl_response"},
-                        {"clients", buildAllPnL()}
-                    };
-                } else if (type == "getOpenOrdersCount") {
+                    break;
+                }
+                case jreq::Type::GetAllPnL: {
+                    sendWritten(ws, [&](JsonWriter& w) {
+                        w.beginObject().key("clients");
+                        writeAllPnL(w);
+                        if (hasCorr) w.field("corr", corr);
+                        w.field("type", "all_pnl_response").endObject();
+                    });
+                    deferred = true;
+                    break;
+                }
+                case jreq::Type::GetMetrics: {
+                    response = buildMetrics();
+                    break;
+                }
+                case jreq::Type::GetOpenOrdersCount: {
                     size_t count = getOpenOrdersCount(ws->getUserData());
                     response = {
                         {"type", "open_orders_count_response"},
                         {"count", count}
                     };
-                } else {
+                    break;
+                }
+                default:
                     response = {
                         {"type", "error"},
                         {"message", "Unknown request type"}
                     };
+                    break;
                 }
+                if (deferred) return;
                 if (hasCorr) {
                     // Only tag responses that are direct replies (not broadcasts)
                     // All responses built above qualify here
                     response["corr"] = corr;
                 }
-                ws->send(response.dump());
-                if (triggerBroadcast) {
-                    scheduleBroadcast();
-                }
+                sendJson(ws, response);
             } catch (const std::exception& e) {
-                LOG("Top-level message exception: " << e.what());
+                LOG_ERROR("Top-level message exception: {}", e.what());
                 ws->send(R"({"type":"error","message":"Invalid JSON or missing fields"})");
             }
         },
         // Handle client disconnect
         .close = [](auto* ws, int code, std::string_view reason) {
             // Optional: log disconnects
-            // Clean up order_to_client for this user
-            for (auto id : ws->getUserData()->my_orders) {
-                order_to_client.erase(id);
-            }
             pnlRate.erase(ws->getUserData());
+            releaseAccount(ws->getUserData()->account);
             connected_clients.erase(ws);
-            LOG("Client disconnected");
+            clients_by_id.erase(ws->getUserData()->client_id);
+            LOG_INFO("Client disconnected");
         }
     }).listen("0.0.0.0", 9001, [](auto* listen_socket) {
         if (listen_socket) {
-            std::cout << "Listening on port 9001" << std::endl;
-            LOG("Listening on 9001");
+            std::cout << "Listening on port 9001 (worker " << worker_index << ")" << std::endl;
+            LOG_INFO("Listening on 9001");
         } else {
             std::cout << "Failed to listen on port 9001" << std::endl;
-            LOG("Failed to listen on 9001");
+            LOG_ERROR("Failed to listen on 9001");
         }
     }).run();
+}
+
+// "SYMBOL", "SYMBOL:TICK", "SYMBOL:TICK:DEPTH" or "SYMBOL:TICK:DEPTH:HISTORY"
+static bool parseInstrument(const std::string& spec, InstrumentConfig& cfg) {
+    auto colon = spec.find(':');
+    cfg.symbol = spec.substr(0, colon);
+    if (colon != std::string::npos) {
+        char* end = nullptr;
+        cfg.tick_size = std::strtod(spec.c_str() + colon + 1, &end);
+        if (*end == ':') cfg.queue_depth = std::strtoull(end + 1, &end, 10);
+        if (*end == ':') cfg.trade_history = std::strtoull(end + 1, nullptr, 10);
+    }
+    return !cfg.symbol.empty() && cfg.tick_size > 0;
+}
+
+// One instrument per line: "SYMBOL [TICK [DEPTH [HISTORY]]]"; blank lines and '#' comments are skipped
+static bool loadInstruments(const char* path, std::vector<InstrumentConfig>& out) {
+    std::ifstream in(path);
+    if (!in) return false;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line.substr(0, line.find('#')));
+        InstrumentConfig cfg;
+        if (!(fields >> cfg.symbol)) continue;
+        fields >> cfg.tick_size >> cfg.queue_depth >> cfg.trade_history;
+        if (cfg.tick_size > 0) out.push_back(cfg);
+        else LOG_WARN("Ignoring instrument {}: bad tick size", cfg.symbol);
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    // --engine-thread runs matching off the event loops, sharding the instruments over
+    // --engine-threads N threads (default: up to half the cores); --engine-cpu C pins
+    // engine thread i to core C + i
+    // --trade-journal PATH appends every trade to a memory-mapped journal (PATH.SYMBOL with several instruments)
+    // --compress-topics enables permessage-deflate for the snapshot and PnL topics
+    // --instrument SYM[:TICK[:DEPTH[:HISTORY]]] (repeatable) and --instruments FILE register symbols; default is one "DEFAULT" book
+    // --workers N serves clients from N event loop threads (0 = one per core)
+    // --data-dir DIR write-ahead logs every book and snapshots it (plus positions of named
+    // accounts) every --snapshot-interval SEC; startup recovers from it. --group-commit-us N
+    // sets the fsync batching window.
+    // --no-metrics stops recording stage latencies (getMetrics and /metrics still serve counters and gauges)
+    // --log-level debug|info|warn|error (default info; per-message logs are debug) and --log-file PATH
+    // (default stderr); logging is asynchronous either way
+    bool engine_thread = false;
+    bool record_metrics = true;
+    logging::Level log_level = logging::Info;
+    const char* log_file = nullptr;
+    size_t n_workers = 1;
+    int engine_cpu = -1;
+    size_t n_engine_threads = 0;
+    const char* trade_journal = nullptr;
+    bool compress_topics = false;
+    JournalConfig journal;
+    std::vector<InstrumentConfig> configs;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--engine-thread") == 0) engine_thread = true;
+        else if (std::strcmp(argv[i], "--engine-cpu") == 0 && i + 1 < argc) { engine_thread = true; engine_cpu = std::atoi(argv[++i]); }
+        else if (std::strcmp(argv[i], "--engine-threads") == 0 && i + 1 < argc) {
+            engine_thread = true;
+            n_engine_threads = static_cast<size_t>(std::max(0, std::atoi(argv[++i])));
+        }
+        else if (std::strcmp(argv[i], "--trade-journal") == 0 && i + 1 < argc) trade_journal = argv[++i];
+        else if (std::strcmp(argv[i], "--compress-topics") == 0) compress_topics = true;
+        else if (std::strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            int n = std::atoi(argv[++i]);
+            n_workers = n > 0 ? static_cast<size_t>(n) : std::max(1u, std::thread::hardware_concurrency());
+        } else if (std::strcmp(argv[i], "--instrument") == 0 && i + 1 < argc) {
+            InstrumentConfig cfg;
+            if (parseInstrument(argv[++i], cfg)) configs.push_back(cfg);
+            else LOG_WARN("Ignoring bad instrument spec {}", argv[i]);
+        } else if (std::strcmp(argv[i], "--instruments") == 0 && i + 1 < argc) {
+            if (!loadInstruments(argv[++i], configs)) LOG_WARN("Failed to read instrument file {}", argv[i]);
+        } else if (std::strcmp(argv[i], "--data-dir") == 0 && i + 1 < argc) journal.dir = argv[++i];
+        else if (std::strcmp(argv[i], "--snapshot-interval") == 0 && i + 1 < argc) journal.snapshot_interval = std::chrono::seconds(std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--group-commit-us") == 0 && i + 1 < argc) journal.group_commit = std::chrono::microseconds(std::atoi(argv[++i]));
+        else if (std::strcmp(argv[i], "--no-metrics") == 0) record_metrics = false;
+        else if (std::strcmp(argv[i], "--log-level") == 0 && i + 1 < argc) {
+            if (!logging::parseLevel(argv[++i], log_level)) LOG_WARN("Unknown log level {}; using info", argv[i]);
+        } else if (std::strcmp(argv[i], "--log-file") == 0 && i + 1 < argc) log_file = argv[++i];
+    }
+    logging::setLevel(log_level);
+    FILE* log_out = log_file ? std::fopen(log_file, "a") : stderr;
+    if (!log_out) {
+        std::cerr << "Cannot open log file " << log_file << "; logging to stderr" << std::endl;
+        log_out = stderr;
+    }
+    logging::start(log_out);
+    metrics::setEnabled(record_metrics);
+    if (configs.empty()) {
+        InstrumentConfig cfg;
+        cfg.symbol = "DEFAULT";
+        configs.push_back(cfg);
+    }
+    // Unless given, ring depth and in-memory trade history shrink as instruments are added,
+    // so the rings of a many-symbol server stay within what 16 default-sized instruments take
+    size_t scale = std::max<size_t>(configs.size(), 16);
+    size_t auto_depth = std::max<size_t>(1024, MatchingEngine::kDefaultQueueDepth * 16 / scale);
+    size_t auto_history = std::max<size_t>(1024, TradeLogConfig{}.ring_capacity * 16 / scale);
+    for (auto& cfg : configs) {
+        if (cfg.queue_depth == 0) cfg.queue_depth = auto_depth;
+        if (cfg.trade_history == 0) cfg.trade_history = auto_history;
+        Instrument* inst = instruments.add(cfg);
+        if (!inst) LOG_WARN("Skipping instrument {} (duplicate or registry full)", cfg.symbol);
+    }
+    // Register signal handler early
+    std::signal(SIGINT, handleSigInt);
+    if (!journal.dir.empty()) {
+        ::mkdir(journal.dir.c_str(), 0755);
+        loadAccounts(journal.dir + "/accounts");
+    }
+    bool recovery_failed = false;
+    instruments.forEach([&](Instrument& inst) {
+        OrderBook& book = inst.book;
+        if (recovery_failed) return;
+        if (trade_journal) {
+            std::string path = instruments.size() == 1 ? std::string(trade_journal) : std::string(trade_journal) + "." + inst.symbol;
+            if (book.openTradeJournal(path)) LOG_INFO("Trade journal: {} (last seq {})", path, book.lastTradeSeq());
+            else LOG_WARN("Failed to open trade journal {}; keeping in-memory ring only", path);
+        }
+        if (!journal.dir.empty()) {
+            // Latest snapshot plus the WAL after it; must precede seeding so a recovered book is not re-seeded
+            auto start = std::chrono::steady_clock::now();
+            if (inst.engine.openJournal(journal, inst.symbol)) {
+                auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+                LOG_INFO("Recovered {}: {} resting orders, {} commands replayed in {}ms", inst.symbol, book.order_directory.liveCount(), inst.engine.recoveredCommands(), ms);
+            } else {
+                // A corrupt snapshot or a hole in the log: serving would fork the log or lose orders
+                LOG_ERROR("Cannot recover {} from {} (corrupt snapshot, unreadable or missing log segment)", inst.symbol, journal.dir);
+                recovery_failed = true;
+                return;
+            }
+            // A recovered book is what it was, even if that is empty
+            if (inst.engine.resumed()) return;
+        }
+        // Seed initial book liquidity before accepting clients (configurable defaults)
+        seedInitialBook(inst, 100.0, 0.5, 5, 10);
+    });
+    if (recovery_failed) {
+        std::cerr << "Refusing to start: journal recovery failed" << std::endl;
+        logging::stop();
+        return 1;
+    }
+    LOG_INFO("Server starting with {} instrument(s); initial seed (if empty) applied", instruments.size());
+
+    if (n_workers > 1 && !engine_thread) {
+        engine_thread = true; // workers post from several threads; only the engine thread may touch a book
+        LOG_INFO("--workers implies --engine-thread");
+    }
+    for (size_t i = 0; i < n_workers; ++i) {
+        workers.push_back(std::make_unique<Worker>());
+        workers.back()->index = i;
+    }
+    // Workers build their loops and market state, then wait until the engines run
+    std::promise<void> go;
+    std::shared_future<void> go_future = go.get_future().share();
+    std::vector<std::future<void>> ready;
+    std::vector<std::thread> threads;
+    for (auto& w : workers) {
+        std::promise<void> worker_ready;
+        ready.push_back(worker_ready.get_future());
+        threads.emplace_back(runWorker, std::ref(*w), compress_topics, std::move(worker_ready), go_future);
+    }
+    for (auto& f : ready) f.wait();
+    g_main_loop = workers.front()->loop;
+
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    if (engine_thread) {
+        // Bounded: never more threads than instruments, nor (pinned) than cores
+        if (n_engine_threads == 0) n_engine_threads = std::max(1u, cores / 2);
+        n_engine_threads = std::min(n_engine_threads, instruments.size());
+        if (engine_cpu >= 0) n_engine_threads = std::min<size_t>(n_engine_threads, cores);
+        for (size_t i = 0; i < n_engine_threads; ++i) engine_threads.push_back(std::make_unique<EngineThread>());
+    }
+    instruments.forEach([&](Instrument& inst) {
+        uint32_t k = inst.index;
+        MatchingEngine& engine = inst.engine;
+        // Runs on the thread that polls (or, inline, posts): that worker's own Market
+        engine.onEvent = [k](const EngineEvent& ev) { handleEngineEvent(*markets[k], ev); };
+        if (!engine_thread) return;
+        // Engine thread publishes into one event ring per worker; each drains its ring on its loop
+        engine.onEventsReady = [k](){
+            for (auto& w : workers) {
+                Market* m = w->markets[k];
+                size_t consumer = w->index;
+                if (!m->drainScheduled.exchange(true)) {
+                    w->loop->defer([m, consumer](){
+                        m->drainScheduled.store(false);
+                        m->inst->engine.poll(consumer);
+                    });
+                }
+            }
+        };
+        engine.attach(*engine_threads[k % engine_threads.size()], workers.size());
+    });
+    for (size_t i = 0; i < engine_threads.size(); ++i) {
+        engine_threads[i]->start(engine_cpu >= 0 ? static_cast<int>((engine_cpu + i) % cores) : -1);
+    }
+    if (engine_thread) {
+        LOG_INFO("Matching {} instrument(s) on {} engine thread(s){}", instruments.size(), engine_threads.size(), engine_cpu >= 0 ? " pinned from cpu " + std::to_string(engine_cpu) : std::string());
+    }
+    LOG_INFO("Serving on {} event loop thread(s)", workers.size());
+    go.set_value();
+    for (auto& t : threads) t.join();
+    logging::stop();
     return 0;
 }